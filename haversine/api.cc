@@ -0,0 +1,171 @@
+#include "api.h"
+#include "cpu_dispatch.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace Haversine::Api {
+
+namespace {
+// Lines of NDJSON input are parsed in ranges of this many bytes.
+constexpr std::uint64_t NDJSON_RANGE_BYTES = std::uint64_t(1) << 20;
+
+struct NdjsonPartial {
+  NdjsonPairs mResult;
+  // First malformed line of the range, counted from 1 within it.
+  std::string mError;
+  std::uint64_t mErrorLine{0};
+};
+
+NdjsonPartial parseNdjsonRange(std::string_view text, std::uint64_t begin,
+                               std::uint64_t end) {
+  const auto &kernels = CpuDispatch::kernels();
+  auto findNewline = [&](std::uint64_t from) {
+    return from + kernels.mFindNewline(text.data() + from, text.size() - from);
+  };
+  NdjsonPartial partial;
+  auto &result = partial.mResult;
+  auto position = begin == 0 ? 0 : findNewline(begin - 1) + 1;
+  while (position < end) {
+    const auto lineEnd = findNewline(position);
+    const auto line = text.substr(position, lineEnd - position);
+    position = lineEnd + 1;
+    ++result.mLines;
+    if (kernels.mSkipWhitespace(line.data(), line.size()) == line.size()) {
+      ++result.mBlankLines;
+      continue;
+    }
+    try {
+      json_parser::Value json;
+      json_parser::parse(line, json);
+      result.mPairs.push(json.getMemberValue("x0").getAsFloatingPoint(),
+                         json.getMemberValue("y0").getAsFloatingPoint(),
+                         json.getMemberValue("x1").getAsFloatingPoint(),
+                         json.getMemberValue("y1").getAsFloatingPoint());
+    } catch (const std::exception &e) {
+      if (lineEnd == text.size()) {
+        result.mSkippedPartialLine = true;
+        continue;
+      }
+      partial.mError = e.what();
+      partial.mErrorLine = result.mLines;
+      break;
+    }
+  }
+  return partial;
+}
+
+// The chunks, and the order their results are folded in, do not depend on
+// whether a pool is used.
+template <typename T, typename Map, typename Combine>
+T reduceChunks(const Options &options, std::uint64_t end, std::uint64_t grain,
+               T init, Map &&map, Combine &&combine) {
+  if (options.mPool)
+    return options.mPool->parallelReduce(0, end, grain, std::move(init), map,
+                                         combine);
+  for (std::uint64_t chunkBegin = 0; chunkBegin < end; chunkBegin += grain)
+    init = combine(std::move(init),
+                   map(chunkBegin, std::min(chunkBegin + grain, end)));
+  return init;
+}
+} // namespace
+
+PairSpans PairSpans::of(const MathUtils::CoordinatePairs<double> &pairs) {
+  return PairSpans{
+      .mX0 = pairs.mX0, .mY0 = pairs.mY0, .mX1 = pairs.mX1, .mY1 = pairs.mY1};
+}
+
+MathUtils::CoordinatePairs<double> pairsFromJson(std::string_view document) {
+  json_parser::Value json;
+  json_parser::parse(document, json);
+  return pairsOf<double>(json);
+}
+
+NdjsonPairs pairsFromNdjson(std::string_view text, const Options &options) {
+  const auto ranges =
+      (text.size() + NDJSON_RANGE_BYTES - 1) / NDJSON_RANGE_BYTES;
+  auto total = reduceChunks(
+      options, ranges, 1, NdjsonPartial{},
+      [&](std::uint64_t range, std::uint64_t) {
+        const auto begin = range * NDJSON_RANGE_BYTES;
+        return parseNdjsonRange(
+            text, begin,
+            std::min<std::uint64_t>(begin + NDJSON_RANGE_BYTES, text.size()));
+      },
+      [](NdjsonPartial total, const NdjsonPartial &partial) {
+        auto &result = total.mResult;
+        if (total.mError.empty() && !partial.mError.empty()) {
+          total.mError = partial.mError;
+          total.mErrorLine = result.mLines + partial.mErrorLine;
+        }
+        result.mPairs.append(partial.mResult.mPairs);
+        result.mLines += partial.mResult.mLines;
+        result.mBlankLines += partial.mResult.mBlankLines;
+        result.mSkippedPartialLine |= partial.mResult.mSkippedPartialLine;
+        return total;
+      });
+  if (!total.mError.empty())
+    throw std::runtime_error("Line " + std::to_string(total.mErrorLine) +
+                             ": " + total.mError);
+  return std::move(total.mResult);
+}
+
+double meanDistance(const PairSpans &pairs, std::span<double> distances,
+                    const Options &options) {
+  const auto sumCoeficient = pairs.size() ? (1. / double(pairs.size())) : 0.;
+  return reduceChunks(
+      options, pairs.size(), MathUtils::SUM_CHUNK_PAIRS, 0.,
+      [&](std::uint64_t chunkBegin, std::uint64_t chunkEnd) {
+        double partial = 0;
+        for (auto i = chunkBegin; i < chunkEnd; ++i) {
+          auto haversineDistance = MathUtils::referenceHaversine(
+              pairs.mX0[i], pairs.mY0[i], pairs.mX1[i], pairs.mY1[i],
+              options.mEarthRadius);
+          partial += sumCoeficient * haversineDistance;
+          if (!distances.empty())
+            distances[i] = haversineDistance;
+        }
+        return partial;
+      },
+      [](double total, double partial) { return total + partial; });
+}
+
+Aggregates::Summary aggregate(std::span<const double> distances,
+                              const Aggregates::Config &config,
+                              const Options &options) {
+  using Aggregates::State;
+  const auto total = reduceChunks(
+      options, distances.size(), State::chunkPairs(distances.size()),
+      State{config},
+      [&](std::uint64_t chunkBegin, std::uint64_t chunkEnd) {
+        State partial{config};
+        partial.add(distances.subspan(chunkBegin, chunkEnd - chunkBegin),
+                    chunkBegin);
+        return partial;
+      },
+      [](State total, const State &partial) {
+        total.merge(partial);
+        return total;
+      });
+  return total.summary();
+}
+
+Result process(const PairSpans &pairs, const Aggregates::Config &config,
+               const Options &options) {
+  Result result{.mPairCount = pairs.size()};
+  std::vector<double> distances(config.mKinds ? pairs.size() : 0);
+  result.mMeanDistance = meanDistance(pairs, distances, options);
+  if (config.mKinds)
+    result.mAggregates = aggregate(distances, config, options);
+  return result;
+}
+
+Result processJson(std::string_view document,
+                   const Aggregates::Config &config, const Options &options) {
+  const auto pairs = pairsFromJson(document);
+  return process(PairSpans::of(pairs), config, options);
+}
+
+} // namespace Haversine::Api
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "aggregates.h"
+#include "json_parser.h"
+#include "math_utils.h"
+#include "thread_pool.h"
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <type_traits>
+
+// Entry points for embedding the library. Everything works on caller-owned
+// memory and nothing touches files. Calls share no mutable state, so any
+// number of threads may call at once; a pool passed in Options must only be
+// used by one of them at a time.
+namespace Haversine::Api {
+
+struct PairSpans {
+  static PairSpans of(const MathUtils::CoordinatePairs<double> &pairs);
+
+  std::size_t size() const { return mX0.size(); }
+
+  std::span<const double> mX0;
+  std::span<const double> mY0;
+  std::span<const double> mX1;
+  std::span<const double> mY1;
+};
+
+struct Options {
+  // Runs on the pool when set, on the calling thread otherwise; results are
+  // the same either way.
+  ThreadPool::Pool *mPool{nullptr};
+  double mEarthRadius{MathUtils::EARTH_RADIUS};
+};
+
+struct Result {
+  std::uint64_t mPairCount{0};
+  double mMeanDistance{0};
+  // mKinds is 0 unless the Config selected aggregates.
+  Aggregates::Summary mAggregates;
+};
+
+// Pairs of a parsed {"pairs":[{"x0":..,"y0":..,"x1":..,"y1":..},...]}
+// document. Integer coordinates are accepted; a document parsed with
+// mSinglePrecision needs T = float.
+template <typename T>
+MathUtils::CoordinatePairs<T> pairsOf(const json_parser::Value &json) {
+  auto coordinate = [](const json_parser::Value &elem, std::string_view name) {
+    if constexpr (std::is_same_v<T, float>)
+      return elem.getMemberValue(name).getAsFloat32();
+    else
+      return elem.getMemberValue(name).getAsFloatingPoint();
+  };
+  const auto &arrayOfPairs = json.getMemberValue("pairs").getArray();
+  MathUtils::CoordinatePairs<T> pairs;
+  pairs.reserve(arrayOfPairs.size());
+  for (const auto &elem : arrayOfPairs) {
+    pairs.push(coordinate(*elem, "x0"), coordinate(*elem, "y0"),
+               coordinate(*elem, "x1"), coordinate(*elem, "y1"));
+  }
+  return pairs;
+}
+
+// Throws std::runtime_error for malformed documents.
+MathUtils::CoordinatePairs<double> pairsFromJson(std::string_view document);
+
+struct NdjsonPairs {
+  MathUtils::CoordinatePairs<double> mPairs;
+  std::uint64_t mLines{0};
+  std::uint64_t mBlankLines{0};
+  // The last line had no '\n' and did not parse, as left by a writer that is
+  // still appending it; its pair is left out.
+  bool mSkippedPartialLine{false};
+};
+
+// One {"x0":..,"y0":..,"x1":..,"y1":..} object per line, blank lines
+// skipped. The text is cut into byte ranges, each taking the lines that
+// start in it, which are parsed on the pool when there is one. Throws
+// std::runtime_error naming the first malformed line.
+NdjsonPairs pairsFromNdjson(std::string_view text,
+                            const Options &options = {});
+
+// Mean referenceHaversine distance, folded in SUM_CHUNK_PAIRS chunks in
+// order, so it matches the generator's answer bit for bit. Every distance is
+// also written to `distances` unless it is empty.
+double meanDistance(const PairSpans &pairs, std::span<double> distances = {},
+                    const Options &options = {});
+
+// distances[i] belongs to pair i.
+Aggregates::Summary aggregate(std::span<const double> distances,
+                              const Aggregates::Config &config,
+                              const Options &options = {});
+
+Result process(const PairSpans &pairs, const Aggregates::Config &config = {},
+               const Options &options = {});
+Result processJson(std::string_view document,
+                   const Aggregates::Config &config = {},
+                   const Options &options = {});
+
+} // namespace Haversine::Api
@@ -0,0 +1,463 @@
+#include "api.h"
+#include "cli_utils.h"
+#include "corpus_format.h"
+#include "cpu_dispatch.h"
+#include "json_parser.h"
+#include "math_utils.h"
+#include "timing_utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+}
+
+#ifndef HAVERSINE_BENCH_BASELINE
+#define HAVERSINE_BENCH_BASELINE "baseline.json"
+#endif
+
+namespace {
+using namespace Haversine::CliUtils;
+using namespace Haversine::MathUtils;
+using namespace Haversine::TimingUtils;
+
+constexpr std::string_view OPTIONS_HELP =
+    "Usage: haversine_bench [options]\n"
+    "Options:\n"
+    "  --baseline=path    baseline to compare against (default: "
+    "the stored baseline.json)\n"
+    "  --output=path      results file (default: bench_results.json)\n"
+    "  --threshold=ratio  allowed slowdown before failing (default: 0.10)\n"
+    "  --samples=count    samples per benchmark (default: 15)\n"
+    "  --cpu=index        CPU to pin to (default: the current one)\n"
+    "  --filter=text      only run benchmarks whose name contains text\n"
+    "  --update-baseline  overwrite the baseline with this run\n";
+
+constexpr std::uint64_t MIN_SAMPLE_NS = 5'000'000;
+constexpr std::uint64_t WARMUP_NS = 50'000'000;
+constexpr std::size_t BATCH_PAIRS = 4096;
+
+template <typename T> void doNotOptimize(const T &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct BenchmarkResult {
+  std::string mName;
+  double mMinNs{0};
+  double mMedianNs{0};
+  double mBytesPerOp{0};
+  std::uint64_t mOpsPerSample{0};
+};
+
+struct BenchmarkSettings {
+  std::uint64_t mSamples{15};
+  std::string_view mFilter;
+};
+
+class BenchmarkRunner {
+public:
+  explicit BenchmarkRunner(const BenchmarkSettings &settings)
+      : mSettings{settings} {}
+
+  // `op` performs one operation of `bytesPerOp` bytes of input.
+  template <typename Op>
+  void run(std::string_view name, double bytesPerOp, Op &&op) {
+    if (!mSettings.mFilter.empty() &&
+        name.find(mSettings.mFilter) == std::string_view::npos)
+      return;
+
+    std::uint64_t opsPerSample = 1;
+    for (;;) {
+      const auto elapsed = timeOps(op, opsPerSample);
+      if (elapsed >= MIN_SAMPLE_NS)
+        break;
+      opsPerSample *= 2;
+    }
+
+    const auto warmupStart = readOsTimer();
+    while (readOsTimer() - warmupStart < WARMUP_NS)
+      timeOps(op, opsPerSample);
+
+    std::vector<double> samples;
+    samples.reserve(mSettings.mSamples);
+    for (std::uint64_t i = 0; i < mSettings.mSamples; ++i)
+      samples.push_back(double(timeOps(op, opsPerSample)) /
+                        double(opsPerSample));
+    std::sort(samples.begin(), samples.end());
+
+    mResults.push_back(BenchmarkResult{.mName = std::string(name),
+                                       .mMinNs = samples.front(),
+                                       .mMedianNs = samples[samples.size() / 2],
+                                       .mBytesPerOp = bytesPerOp,
+                                       .mOpsPerSample = opsPerSample});
+  }
+
+  const std::vector<BenchmarkResult> &results() const { return mResults; }
+
+private:
+  template <typename Op> std::uint64_t timeOps(Op &op, std::uint64_t count) {
+    const auto start = readOsTimer();
+    for (std::uint64_t i = 0; i < count; ++i)
+      op();
+    return readOsTimer() - start;
+  }
+
+  BenchmarkSettings mSettings;
+  std::vector<BenchmarkResult> mResults;
+};
+
+std::string generatePairsDocument(
+    std::uint64_t pairCount, std::uint64_t seed,
+    const Haversine::CorpusFormat::Format &format = {}) {
+  std::mt19937_64 randomNumberGenerator{seed};
+  std::string result;
+  format.appendHeader(result);
+  for (std::uint64_t i = 0; i < pairCount; ++i) {
+    std::array<double, 4> coordinates;
+    coordinates[0] = randomDegree(randomNumberGenerator, 0., 180., 180.);
+    coordinates[1] = randomDegree(randomNumberGenerator, 0., 90., 90.);
+    coordinates[2] = randomDegree(randomNumberGenerator, 0., 180., 180.);
+    coordinates[3] = randomDegree(randomNumberGenerator, 0., 90., 90.);
+    format.appendPair(result, i, coordinates);
+  }
+  format.appendFooter(result);
+  return result;
+}
+
+CoordinatePairs<double> generatePairs(std::size_t count, std::uint64_t seed) {
+  std::mt19937_64 randomNumberGenerator{seed};
+  CoordinatePairs<double> result;
+  result.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    result.push(randomDegree(randomNumberGenerator, 0., 180., 180.),
+                randomDegree(randomNumberGenerator, 0., 90., 90.),
+                randomDegree(randomNumberGenerator, 0., 180., 180.),
+                randomDegree(randomNumberGenerator, 0., 90., 90.));
+  }
+  return result;
+}
+
+// Runs `op` over every token of `tokens`, each parsed from its own Context.
+template <typename Op>
+void forEachToken(const std::vector<std::string> &tokens, Op &&op) {
+  for (const auto &token : tokens) {
+    json_parser::Context ctx{.mInput = token};
+    op(ctx);
+  }
+}
+
+void runBenchmarks(BenchmarkRunner &runner) {
+  const auto pairs = generatePairs(BATCH_PAIRS, 1);
+  std::vector<double> distances(BATCH_PAIRS);
+
+  runner.run("referenceHaversine", BATCH_PAIRS * 4 * sizeof(double), [&] {
+    double sum = 0;
+    for (std::size_t i = 0; i < BATCH_PAIRS; ++i)
+      sum += referenceHaversine(pairs.mX0[i], pairs.mY0[i], pairs.mX1[i],
+                                pairs.mY1[i]);
+    doNotOptimize(sum);
+  });
+
+  runner.run("haversineBatch/f64", BATCH_PAIRS * 4 * sizeof(double), [&] {
+    haversineBatch(pairs.mX0, pairs.mY0, pairs.mX1, pairs.mY1, distances);
+    doNotOptimize(distances.data());
+  });
+
+  std::mt19937_64 tokenGenerator{2};
+  std::vector<std::string> numbers;
+  std::vector<std::string> strings;
+  std::vector<std::string> whitespace;
+  double numberBytes = 0;
+  double stringBytes = 0;
+  double whitespaceBytes = 0;
+  for (int i = 0; i < 1024; ++i) {
+    std::array<char, 32> buffer;
+    auto [ptr, ec] = std::to_chars(
+        buffer.data(), buffer.data() + buffer.size(),
+        randomDegree(tokenGenerator, 0., 180., 180.), std::chars_format::fixed,
+        16);
+    numbers.emplace_back(buffer.data(), ptr);
+    numberBytes += double(numbers.back().size());
+
+    strings.emplace_back(i % 4 == 0 ? "\"a longer key with \\\"escapes\\\"\""
+                                    : "\"x0\"");
+    stringBytes += double(strings.back().size());
+
+    whitespace.emplace_back(std::string(std::size_t(1 + i % 64), ' ') + "\n{");
+    whitespaceBytes += double(whitespace.back().size() - 1);
+  }
+
+  runner.run("Number::parse", numberBytes, [&] {
+    forEachToken(numbers, [](json_parser::Context &ctx) {
+      json_parser::Number number;
+      json_parser::Number::parse(ctx, number);
+      doNotOptimize(number.mInternalNumber.mFloat);
+    });
+  });
+
+  runner.run("String::parse", stringBytes, [&] {
+    forEachToken(strings, [](json_parser::Context &ctx) {
+      json_parser::String string;
+      json_parser::String::parse(ctx, string);
+      doNotOptimize(string.mValue.size());
+    });
+  });
+
+  runner.run("skipWhiteSpace", whitespaceBytes, [&] {
+    forEachToken(whitespace, [](json_parser::Context &ctx) {
+      json_parser::skipWhiteSpace(ctx);
+      doNotOptimize(ctx.mCurrentPos);
+    });
+  });
+
+  for (std::uint64_t pairCount : {1000ULL, 10000ULL, 100000ULL}) {
+    const auto document = generatePairsDocument(pairCount, 3);
+    const auto name = "json_parser::parse/" + std::to_string(pairCount);
+    runner.run(name, double(document.size()), [&] {
+      json_parser::Value json;
+      json_parser::parse(document, json);
+      doNotOptimize(json.mValueType);
+    });
+  }
+
+  const auto lazyDocument = generatePairsDocument(100000, 3);
+  runner.run("json_parser::parse/100000-lazy", double(lazyDocument.size()),
+             [&] {
+               json_parser::Value json;
+               json_parser::parse(
+                   lazyDocument, json,
+                   json_parser::ParseOptions{.mLazyNumbers = true});
+               doNotOptimize(json.mValueType);
+             });
+  runner.run("json_parser::materializeAll/100000",
+             double(lazyDocument.size()), [&] {
+               json_parser::Value json;
+               json_parser::parse(
+                   lazyDocument, json,
+                   json_parser::ParseOptions{.mLazyNumbers = true});
+               json_parser::materializeAll(json);
+               doNotOptimize(json.mValueType);
+             });
+
+  // The same pairs in every corpus variant, one feature at a time.
+  for (std::size_t feature = 0;
+       feature < Haversine::CorpusFormat::FEATURE_NAMES.size(); ++feature) {
+    const auto format = Haversine::CorpusFormat::Format::of(1U << feature, 3);
+    const auto document = generatePairsDocument(10000, 3, format);
+    // NDJSON is a sequence of documents rather than one.
+    if (format.mFeatures & Haversine::CorpusFormat::NDJSON) {
+      runner.run("Api::pairsFromNdjson/corpus-" + format.name(),
+                 double(document.size()), [&] {
+                   const auto lines = Haversine::Api::pairsFromNdjson(document);
+                   doNotOptimize(lines.mLines);
+                 });
+      continue;
+    }
+    const auto name = "json_parser::parse/corpus-" + format.name();
+    runner.run(name, double(document.size()), [&] {
+      json_parser::Value json;
+      json_parser::parse(document, json);
+      doNotOptimize(json.mValueType);
+    });
+  }
+
+  const auto validateDocument = generatePairsDocument(100000, 3);
+  runner.run("json_parser::validate/100000", double(validateDocument.size()),
+             [&] {
+               const auto result = json_parser::validate(validateDocument);
+               doNotOptimize(result.mOffset);
+             });
+
+  const auto pairDocument = generatePairsDocument(1, 4);
+  json_parser::Value pairJson;
+  json_parser::parse(pairDocument, pairJson);
+  const auto &pairObject = *pairJson.getMemberValue("pairs").getArray()[0];
+  runner.run("Object::getMemberValue", 4, [&] {
+    for (auto name : {"x0", "y0", "x1", "y1"})
+      doNotOptimize(&pairObject.getMemberValue(name));
+  });
+
+  auto devNull = FileHandle::open("/dev/null", O_WRONLY);
+  IoBufferedWriter devNullWriter(devNull);
+  runner.run("IoBufferedWriter::printNumber", BATCH_PAIRS * 4 * sizeof(double),
+             [&] {
+               for (std::size_t i = 0; i < BATCH_PAIRS; ++i) {
+                 devNullWriter.printSv(",\n{\"x0\":");
+                 devNullWriter.printNumber(pairs.mX0[i],
+                                           std::chars_format::fixed, 16);
+                 devNullWriter.printSv(",\"y0\":");
+                 devNullWriter.printNumber(pairs.mY0[i],
+                                           std::chars_format::fixed, 16);
+                 devNullWriter.printSv(",\"x1\":");
+                 devNullWriter.printNumber(pairs.mX1[i],
+                                           std::chars_format::fixed, 16);
+                 devNullWriter.printSv(",\"y1\":");
+                 devNullWriter.printNumber(pairs.mY1[i],
+                                           std::chars_format::fixed, 16);
+                 devNullWriter.printSv("}");
+               }
+             });
+}
+
+void writeResults(std::string_view filename,
+                  const std::vector<BenchmarkResult> &results) {
+  auto file = FileHandle::open(filename, O_WRONLY | O_CREAT | O_TRUNC,
+                               S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  IoBufferedWriter out(file);
+  out.printSv("{\"isa\":\"");
+  out.printSv(Haversine::CpuDispatch::isaToStrView(
+      Haversine::CpuDispatch::selection().mSelected));
+  out.printSv("\",\"benchmarks\":[");
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const auto &result = results[i];
+    out.printSv(i == 0 ? "\n" : ",\n");
+    out.printSv("{\"name\":\"");
+    out.printSv(result.mName);
+    out.printSv("\",\"min_ns\":");
+    out.printNumber(result.mMinNs, std::chars_format::fixed, 3);
+    out.printSv(",\"median_ns\":");
+    out.printNumber(result.mMedianNs, std::chars_format::fixed, 3);
+    out.printSv(",\"bytes_per_op\":");
+    out.printNumber(result.mBytesPerOp, std::chars_format::fixed, 3);
+    out.printSv("}");
+  }
+  out.printSv("\n]}\n");
+}
+
+struct BaselineEntry {
+  std::string mName;
+  double mMinNs;
+};
+
+std::vector<BaselineEntry> readBaseline(std::string_view filename) {
+  std::vector<BaselineEntry> result;
+  std::string path{filename};
+  auto fd = ::open(path.c_str(), O_RDONLY);
+  if (fd == -1)
+    return result;
+  FileHandle file{
+      .mIsOpen = true, .mNeedsClosing = true, .mFileDescriptor = fd};
+  std::string contents;
+  std::array<char, 4096> buffer;
+  for (;;) {
+    auto bytesRead = ::read(fd, buffer.data(), buffer.size());
+    if (bytesRead <= 0)
+      break;
+    contents.append(buffer.data(), std::size_t(bytesRead));
+  }
+
+  json_parser::Value json;
+  json_parser::parse(contents, json);
+  for (const auto &entry : json.getMemberValue("benchmarks").getArray()) {
+    result.push_back(BaselineEntry{
+        .mName = entry->getMemberValue("name").mInternalValue.mString.mValue,
+        .mMinNs = entry->getMemberValue("min_ns").getFloatingPoint()});
+  }
+  return result;
+}
+
+void pinToCpu(int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (sched_setaffinity(0, sizeof(set), &set) != 0)
+    throw std::runtime_error("Unable to pin to CPU " + std::to_string(cpu));
+}
+} // namespace
+
+int main(int argc, const char *argv[]) {
+  auto stdOutHandle = FileHandle{.mIsOpen = true,
+                                 .mNeedsClosing = false,
+                                 .mFileDescriptor = STDOUT_FILENO};
+  IoBufferedWriter stdOutWriter(stdOutHandle);
+
+  BenchmarkSettings settings;
+  std::string baselineFilename{HAVERSINE_BENCH_BASELINE};
+  std::string outputFilename{"bench_results.json"};
+  double threshold = 0.10;
+  int cpu = sched_getcpu();
+  CommandLineOptions options;
+  try {
+    options = CommandLineOptions::from(argc, argv, 1);
+    if (auto value = options.value("baseline"))
+      baselineFilename = *value;
+    if (auto value = options.value("output"))
+      outputFilename = *value;
+    if (auto value = options.value("threshold"))
+      threshold = doubleFrom(*value, "Invalid threshold: ");
+    if (auto value = options.value("samples"))
+      settings.mSamples =
+          std::max<std::uint64_t>(1, u64From(*value, "Invalid samples: "));
+    if (auto value = options.value("cpu"))
+      cpu = int(u64From(*value, "Invalid cpu: "));
+    if (auto value = options.value("filter"))
+      settings.mFilter = *value;
+    pinToCpu(cpu);
+  } catch (const std::exception &e) {
+    stdOutWriter.printSv(e.what());
+    stdOutWriter.printSv("\n");
+    stdOutWriter.printSv(OPTIONS_HELP);
+    return 1;
+  }
+
+  stdOutWriter.printSv("Pinned to CPU ");
+  stdOutWriter.printNumber(cpu);
+  stdOutWriter.printSv(", kernel variant ");
+  stdOutWriter.printSv(Haversine::CpuDispatch::isaToStrView(
+      Haversine::CpuDispatch::selection().mSelected));
+  stdOutWriter.printSv("\n");
+  stdOutWriter.flush();
+
+  BenchmarkRunner runner{settings};
+  runBenchmarks(runner);
+  const auto &results = runner.results();
+  writeResults(outputFilename, results);
+
+  const auto baseline = options.has("update-baseline")
+                            ? std::vector<BaselineEntry>{}
+                            : readBaseline(baselineFilename);
+  int regressions = 0;
+  for (const auto &result : results) {
+    stdOutWriter.printSv(result.mName);
+    stdOutWriter.printSv(": min ");
+    stdOutWriter.printNumber(result.mMinNs, std::chars_format::fixed, 1);
+    stdOutWriter.printSv(" ns, median ");
+    stdOutWriter.printNumber(result.mMedianNs, std::chars_format::fixed, 1);
+    stdOutWriter.printSv(" ns, ");
+    stdOutWriter.printNumber(result.mBytesPerOp / result.mMinNs * 1e3,
+                             std::chars_format::fixed, 1);
+    stdOutWriter.printSv(" MB/s");
+    auto entry = std::find_if(
+        baseline.begin(), baseline.end(),
+        [&](const auto &e) { return e.mName == result.mName; });
+    if (entry != baseline.end()) {
+      const auto change = result.mMinNs / entry->mMinNs - 1.;
+      stdOutWriter.printSv(", vs baseline ");
+      stdOutWriter.printSv(change >= 0 ? "+" : "");
+      stdOutWriter.printNumber(change * 100., std::chars_format::fixed, 1);
+      stdOutWriter.printSv("%");
+      if (change > threshold) {
+        stdOutWriter.printSv(" REGRESSION");
+        regressions++;
+      }
+    }
+    stdOutWriter.printSv("\n");
+  }
+
+  if (options.has("update-baseline")) {
+    writeResults(baselineFilename, results);
+    stdOutWriter.printSv("Baseline updated: ");
+    stdOutWriter.printSv(baselineFilename);
+    stdOutWriter.printSv("\n");
+  }
+  stdOutWriter.printSv("Results written to ");
+  stdOutWriter.printSv(outputFilename);
+  stdOutWriter.printSv("\n");
+  return regressions > 0 ? 1 : 0;
+}
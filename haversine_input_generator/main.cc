@@ -1,14 +1,45 @@
+#include "chunk_index.h"
 #include "cli_utils.h"
+#include "corpus_format.h"
 #include "math_utils.h"
+#include "pair_generator.h"
+#include "perf_counters.h"
+#include "thread_pool.h"
+#include "trace.h"
 
-#include <charconv>
+#include <array>
 #include <cmath>
+#include <functional>
 #include <iostream>
-#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+// The pair sequence depends on the block size, so it stays at 4096; each
+// SUM_CHUNK_PAIRS chunk of a block is formatted by one task.
+constexpr std::uint64_t BLOCK_PAIRS = 4096;
+static_assert(BLOCK_PAIRS % Haversine::MathUtils::SUM_CHUNK_PAIRS == 0);
+
+constexpr std::string_view OPTIONS_HELP =
+    "Options:\n"
+    "  --counters             report hardware performance counters per stage\n"
+    "  --trace=path           write a per-thread timeline as Chrome "
+    "trace-event JSON\n"
+    "  --threads=N            worker threads (default: one per available "
+    "CPU)\n"
+    "  --pin=none|cores|numa  pin workers to single CPUs or NUMA nodes\n"
+    "  --corpus=feature,...   write the same pairs in a parser-stress "
+    "variant:\n"
+    "                         shuffled, extra, nested, escaped, precision,\n"
+    "                         exponent, integer, pretty, minified, crlf,\n"
+    "                         ndjson (one pair per line, no chunk index)\n";
+
+} // namespace
 
 int main(int argc, const char *argv[]) {
   using namespace Haversine::CliUtils;
   using namespace Haversine::MathUtils;
+  using namespace Haversine::PerfCounters;
   CommandLineArgument argMode{"uniform/cluster", &modeFrom, &dumpMode};
   CommandLineArgument argSeed{"random seed", &randomSeedFrom, &dumpU64};
   CommandLineArgument argNCoord{"number of coordinate pairs to generate",
@@ -23,32 +54,40 @@ int main(int argc, const char *argv[]) {
   auto stdOutHandle = FileHandle{.mIsOpen = true,
                                  .mNeedsClosing = false,
                                  .mFileDescriptor = STDOUT_FILENO};
+  CommandLineOptions options;
+  Haversine::ThreadPool::PoolOptions poolOptions;
+  Haversine::CorpusFormat::Format format;
   IoBufferedWriter stdOutWriter(stdOutHandle);
   try {
     cli.parse(argc, argv, mode, seed, coordinatePairs);
+    options = CommandLineOptions::from(argc, argv, 4);
+    poolOptions = Haversine::ThreadPool::PoolOptions::from(options);
+    format = Haversine::CorpusFormat::Format::from(options, seed);
   } catch (const std::exception &e) {
     stdOutWriter.printSv(e.what());
     stdOutWriter.printSv("\n");
     stdOutWriter.printSv(help);
+    stdOutWriter.printSv(OPTIONS_HELP);
     return 1;
   }
+  if (auto traceFilename = options.value("trace"))
+    Haversine::Trace::enable(*traceFilename);
+  StageProfiler profiler{options.has("counters")};
 
-  auto jsonFilename =
-      std::string("data_") + std::to_string(coordinatePairs) + "_flex.json";
+  // Variants keep their own answers: rounded coordinates change distances.
+  const auto filePrefix = std::string("data_") +
+                          std::to_string(coordinatePairs) + "_";
+  const auto jsonFilename =
+      filePrefix + format.name() + std::string(format.extension());
+  // Newline-delimited output splits at any line, so it needs no index.
+  const bool writeChunkIndex =
+      !(format.mFeatures & Haversine::CorpusFormat::NDJSON);
+  const auto binFilename =
+      filePrefix + (format.mFeatures ? format.name() + "_" : std::string()) +
+      "haveanswer.f64";
 
-  auto binFilename = std::string("data_") + std::to_string(coordinatePairs) +
-                     "_haveanswer.f64";
-
-  std::mt19937_64 randomNumberGenerator{seed};
-  std::uniform_real_distribution<double> xRandomCenterGenerator{-180., 180.};
-  std::uniform_real_distribution<double> yRandomCenterGenerator{-90., 90.};
-  std::uniform_real_distribution<double> xRandomRadiusGenerator{0., 180.};
-  std::uniform_real_distribution<double> yRandomRadiusGenerator{0., 90.};
-
-  double xCenter = 0.;
-  double yCenter = 0.;
-  double xRadius = 180.;
-  double yRadius = 90.;
+  Haversine::PairGenerator::Generator pairGenerator{mode, seed,
+                                                    coordinatePairs};
 
   auto jsonFileHandle =
       FileHandle::open(jsonFilename, O_WRONLY | O_CREAT | O_TRUNC,
@@ -61,44 +100,86 @@ int main(int argc, const char *argv[]) {
   IoBufferedWriter binFileWriter(binFileHandle);
 
   double sum = 0;
-  const double clusterCountMax = 1 + (coordinatePairs / 64);
-  std::uint64_t clusterCountLeft = 0;
   auto sumCoeficient =
       coordinatePairs > 0 ? (1. / double(coordinatePairs)) : 0.;
 
-  jsonFileWriter.printSv("{\"pairs\":[");
-  for (auto i = 0ULL; i < coordinatePairs; ++i) {
-    if (mode == Mode::CLUSTER && clusterCountLeft-- == 0) {
-      clusterCountLeft = clusterCountMax;
-      xCenter = xRandomCenterGenerator(randomNumberGenerator);
-      yCenter = yRandomCenterGenerator(randomNumberGenerator);
-      xRadius = xRandomRadiusGenerator(randomNumberGenerator);
-      yRadius = yRandomRadiusGenerator(randomNumberGenerator);
-    }
-    auto x0 = randomDegree(randomNumberGenerator, xCenter, xRadius, 180.);
-    auto y0 = randomDegree(randomNumberGenerator, yCenter, yRadius, 90.);
-    auto x1 = randomDegree(randomNumberGenerator, xCenter, xRadius, 180.);
-    auto y1 = randomDegree(randomNumberGenerator, yCenter, yRadius, 90.);
-    auto haversineDistance = referenceHaversine(x0, y0, x1, y1);
-    sum += sumCoeficient * haversineDistance;
-
-    if (i == 0) {
-      jsonFileWriter.printSv("\n{\"x0\":");
-    } else {
-      jsonFileWriter.printSv(",\n{\"x0\":");
+  Haversine::ThreadPool::Pool pool{poolOptions};
+  CoordinatePairs<double> block;
+  std::vector<double> distances;
+  std::vector<std::string> chunkText(BLOCK_PAIRS / SUM_CHUNK_PAIRS);
+  block.reserve(BLOCK_PAIRS);
+  distances.reserve(BLOCK_PAIRS);
+
+  Haversine::CorpusFormat::Checksum checksum;
+  Haversine::ChunkIndex::Index chunkIndex;
+  std::string frame;
+  format.appendHeader(frame);
+  checksum.add(frame);
+  jsonFileWriter.printStr(frame);
+  for (auto blockStart = 0ULL; blockStart < coordinatePairs;
+       blockStart += BLOCK_PAIRS) {
+    const auto blockEnd =
+        std::min<std::uint64_t>(blockStart + BLOCK_PAIRS, coordinatePairs);
+
+    profiler.begin("random");
+    const std::size_t count = blockEnd - blockStart;
+    pairGenerator.next(block, count);
+    profiler.end();
+
+    // Distances and text are produced per chunk in parallel; the partial
+    // sums are folded in chunk order.
+    profiler.begin("compute");
+    distances.resize(count);
+    sum = pool.parallelReduce(
+        0, count, SUM_CHUNK_PAIRS, sum,
+        [&](std::uint64_t chunkBegin, std::uint64_t chunkEnd) {
+          Haversine::Trace::Scope scope{
+              "format chunk", (blockStart + chunkBegin) / SUM_CHUNK_PAIRS};
+          auto &text = chunkText[chunkBegin / SUM_CHUNK_PAIRS];
+          text.clear();
+          double partial = 0;
+          for (auto j = chunkBegin; j < chunkEnd; ++j) {
+            std::array<double, 4> coordinates{block.mX0[j], block.mY0[j],
+                                              block.mX1[j], block.mY1[j]};
+            format.appendPair(text, blockStart + j, coordinates);
+            auto haversineDistance =
+                referenceHaversine(coordinates[0], coordinates[1],
+                                   coordinates[2], coordinates[3]);
+            partial += sumCoeficient * haversineDistance;
+            distances[j] = haversineDistance;
+          }
+          return partial;
+        },
+        std::plus<>{});
+    profiler.end();
+
+    profiler.begin("output");
+    const auto chunks = (count + SUM_CHUNK_PAIRS - 1) / SUM_CHUNK_PAIRS;
+    for (std::size_t chunk = 0; chunk < chunks; ++chunk) {
+      const auto ordinal = blockStart + chunk * SUM_CHUNK_PAIRS;
+      if (writeChunkIndex && ordinal % chunkIndex.mStride == 0)
+        chunkIndex.mEntries.push_back({jsonFileWriter.mBytesWritten, ordinal});
+      checksum.add(chunkText[chunk]);
+      jsonFileWriter.printStr(chunkText[chunk]);
     }
-    jsonFileWriter.printNumber(x0, std::chars_format::fixed, 16);
-    jsonFileWriter.printSv(",\"y0\":");
-    jsonFileWriter.printNumber(y0, std::chars_format::fixed, 16);
-    jsonFileWriter.printSv(",\"x1\":");
-    jsonFileWriter.printNumber(x1, std::chars_format::fixed, 16);
-    jsonFileWriter.printSv(",\"y1\":");
-    jsonFileWriter.printNumber(y1, std::chars_format::fixed, 16);
-    jsonFileWriter.printSv("}");
-
-    binFileWriter.writeBin(haversineDistance);
+    for (std::size_t j = 0; j < count; ++j)
+      binFileWriter.writeBin(distances[j]);
+    profiler.end();
   }
-  jsonFileWriter.printSv("\n]}\n");
+  profiler.begin("output");
+  chunkIndex.mEntries.push_back(
+      {jsonFileWriter.mBytesWritten, coordinatePairs});
+  frame.clear();
+  format.appendFooter(frame);
+  checksum.add(frame);
+  jsonFileWriter.printStr(frame);
+  jsonFileWriter.flush();
+  binFileWriter.flush();
+  const auto chunkIndexFilename = jsonFilename + ".hvci";
+  if (writeChunkIndex)
+    chunkIndex.save(chunkIndexFilename,
+                    FileIdentity::of(jsonFileHandle.mFileDescriptor));
+  profiler.end();
 
   stdOutWriter.printSv("Method: ");
   stdOutWriter.printSv(modeToStrView(mode));
@@ -108,6 +189,26 @@ int main(int argc, const char *argv[]) {
   stdOutWriter.printNumber(coordinatePairs);
   stdOutWriter.printSv("\nExpected sum: ");
   stdOutWriter.printNumber(sum, std::chars_format::fixed, 16);
+  stdOutWriter.printSv("\nCorpus: ");
+  stdOutWriter.printSv(format.name());
+  stdOutWriter.printSv(", ");
+  stdOutWriter.printSv(jsonFilename);
+  stdOutWriter.printSv(", ");
+  stdOutWriter.printNumber(jsonFileWriter.mBytesWritten);
+  stdOutWriter.printSv(" bytes, FNV-1a ");
+  stdOutWriter.printNumber(checksum.mHash, 16);
+  if (writeChunkIndex) {
+    stdOutWriter.printSv("\nChunk index: ");
+    stdOutWriter.printSv(chunkIndexFilename);
+    stdOutWriter.printSv(", ");
+    stdOutWriter.printNumber(chunkIndex.chunkCount());
+    stdOutWriter.printSv(" chunks of ");
+    stdOutWriter.printNumber(chunkIndex.mStride);
+    stdOutWriter.printSv(" pairs");
+  }
   stdOutWriter.printSv("\n\n");
+  profiler.report(stdOutWriter, jsonFileWriter.mBytesWritten, coordinatePairs);
+  if (profiler.countersEnabled())
+    pool.printStats(stdOutWriter);
   return 0;
 }
@@ -0,0 +1,319 @@
+#include "aggregates.h"
+#include "cpu_dispatch.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+namespace Haversine::Aggregates {
+
+namespace {
+// Distances are reduced in blocks that stay in L1 between the kernel's two
+// passes and the scalar aggregates.
+constexpr std::size_t BLOCK_DISTANCES = 1024;
+constexpr std::uint64_t MIN_CHUNK_PAIRS = 64 * 1024;
+constexpr std::uint64_t MAX_PARTIAL_STATES = 256;
+
+constexpr std::size_t SUB_BUCKETS = std::size_t(1)
+                                    << QuantileSketch::SUB_BUCKET_BITS;
+constexpr std::size_t SKETCH_BUCKETS =
+    2 + std::size_t(QuantileSketch::MAX_EXPONENT -
+                    QuantileSketch::MIN_EXPONENT) *
+            SUB_BUCKETS;
+
+// Entries that should leave the top list first compare smaller.
+bool evictsBefore(const TopEntry &lhs, const TopEntry &rhs) {
+  if (lhs.mDistance != rhs.mDistance)
+    return lhs.mDistance < rhs.mDistance;
+  return lhs.mIndex > rhs.mIndex;
+}
+
+// std heap functions keep the largest element in front.
+bool heapOrder(const TopEntry &lhs, const TopEntry &rhs) {
+  return evictsBefore(rhs, lhs);
+}
+
+void printValue(CliUtils::IoBufferedWriter &out, double value) {
+  out.printNumber(value, std::chars_format::fixed, 6);
+}
+} // namespace
+
+Kind kindFrom(std::string_view rawText) {
+  if (rawText == "count")
+    return COUNT;
+  if (rawText == "min")
+    return MIN;
+  if (rawText == "max")
+    return MAX;
+  if (rawText == "mean")
+    return MEAN;
+  if (rawText == "variance")
+    return VARIANCE;
+  if (rawText == "histogram")
+    return HISTOGRAM;
+  if (rawText == "quantiles")
+    return QUANTILES;
+  if (rawText == "top")
+    return TOP_K;
+  if (rawText == "all")
+    return ALL;
+
+  std::string errorMessage = "Unrecognized aggregate: ";
+  errorMessage.append(rawText);
+  throw std::runtime_error(errorMessage);
+}
+
+Config Config::from(const CliUtils::CommandLineOptions &options) {
+  Config result;
+  for (auto name : options.list("aggregates"))
+    result.mKinds |= kindFrom(name);
+  if (auto rawBuckets = options.value("buckets")) {
+    result.mHistogramBuckets =
+        std::uint32_t(CliUtils::u64From(*rawBuckets, "Invalid buckets: "));
+    if (result.mHistogramBuckets == 0)
+      throw std::runtime_error("Invalid buckets: 0");
+  }
+  if (auto rawTop = options.value("top"))
+    result.mTopK = std::uint32_t(CliUtils::u64From(*rawTop, "Invalid top: "));
+  if (options.has("quantiles")) {
+    result.mQuantiles.clear();
+    for (auto rawQuantile : options.list("quantiles")) {
+      const auto q = CliUtils::doubleFrom(rawQuantile, "Invalid quantile: ");
+      if (!(q >= 0. && q <= 1.))
+        throw std::runtime_error("Invalid quantile: " +
+                                 std::string(rawQuantile));
+      result.mQuantiles.push_back(q);
+    }
+  }
+  return result;
+}
+
+QuantileSketch::QuantileSketch() : mCounts(SKETCH_BUCKETS) {}
+
+std::size_t QuantileSketch::bucketOf(double value) {
+  constexpr auto MIN_BITS = std::uint64_t(1023 + MIN_EXPONENT) << 52;
+  constexpr auto MAX_BITS = std::uint64_t(1023 + MAX_EXPONENT) << 52;
+  // Distances are never negative, so the sign bit is clear and the bit
+  // pattern orders like the value; NaN ends up in the last bucket.
+  const auto bits = std::bit_cast<std::uint64_t>(value);
+  if (bits < MIN_BITS)
+    return 0;
+  if (bits >= MAX_BITS)
+    return SKETCH_BUCKETS - 1;
+  return 1 + std::size_t((bits - MIN_BITS) >> (52 - SUB_BUCKET_BITS));
+}
+
+double QuantileSketch::valueOf(std::size_t bucket) {
+  if (bucket == 0)
+    return 0.;
+  if (bucket == SKETCH_BUCKETS - 1)
+    return std::ldexp(1., MAX_EXPONENT);
+  const auto exponent = int((bucket - 1) / SUB_BUCKETS) + MIN_EXPONENT;
+  const auto subBucket = double((bucket - 1) % SUB_BUCKETS);
+  return std::ldexp(1. + (subBucket + 0.5) / double(SUB_BUCKETS), exponent);
+}
+
+void QuantileSketch::merge(const QuantileSketch &other) {
+  for (std::size_t i = 0; i < mCounts.size(); ++i)
+    mCounts[i] += other.mCounts[i];
+}
+
+double QuantileSketch::quantile(double q, std::uint64_t count) const {
+  if (count == 0)
+    return 0.;
+  const auto rank = std::uint64_t(q * double(count - 1));
+  std::uint64_t seen = 0;
+  for (std::size_t i = 0; i < mCounts.size(); ++i) {
+    seen += mCounts[i];
+    if (seen > rank)
+      return valueOf(i);
+  }
+  return valueOf(mCounts.size() - 1);
+}
+
+State::State(const Config &config) : mConfig{&config} {
+  if (config.mKinds & HISTOGRAM)
+    mHistogram.resize(config.mHistogramBuckets);
+}
+
+std::uint64_t State::chunkPairs(std::uint64_t pairCount) {
+  return std::max(MIN_CHUNK_PAIRS,
+                  (pairCount + MAX_PARTIAL_STATES - 1) / MAX_PARTIAL_STATES);
+}
+
+void State::addMoments(std::uint64_t count, double mean, double m2,
+                       double minimum, double maximum) {
+  if (count == 0)
+    return;
+  if (mCount == 0) {
+    mCount = count;
+    mMean = mean;
+    mM2 = m2;
+    mMin = minimum;
+    mMax = maximum;
+    return;
+  }
+  // Chan et al.: Welford's update for two partitions at once.
+  const auto total = mCount + count;
+  const auto delta = mean - mMean;
+  mMean += delta * double(count) / double(total);
+  mM2 += m2 + delta * delta * double(mCount) * double(count) / double(total);
+  mCount = total;
+  mMin = std::min(mMin, minimum);
+  mMax = std::max(mMax, maximum);
+}
+
+void State::pushTop(const TopEntry &entry) {
+  if (mConfig->mTopK == 0)
+    return;
+  if (mTop.size() < mConfig->mTopK) {
+    mTop.push_back(entry);
+    std::push_heap(mTop.begin(), mTop.end(), heapOrder);
+  } else if (evictsBefore(mTop.front(), entry)) {
+    std::pop_heap(mTop.begin(), mTop.end(), heapOrder);
+    mTop.back() = entry;
+    std::push_heap(mTop.begin(), mTop.end(), heapOrder);
+  }
+}
+
+void State::add(std::span<const double> distances, std::uint64_t firstIndex) {
+  const auto &kernels = CpuDispatch::kernels();
+  const auto kinds = mConfig->mKinds;
+  const auto bucketScale =
+      double(mConfig->mHistogramBuckets) / mConfig->mHistogramMax;
+  for (std::size_t offset = 0; offset < distances.size();
+       offset += BLOCK_DISTANCES) {
+    const auto block = distances.subspan(
+        offset, std::min(BLOCK_DISTANCES, distances.size() - offset));
+    const auto moments = kernels.mBlockMoments(block.data(), block.size());
+    addMoments(block.size(), moments.mSum / double(block.size()), moments.mM2,
+               moments.mMin, moments.mMax);
+
+    if (kinds & HISTOGRAM) {
+      const auto lastBucket = std::size_t(mConfig->mHistogramBuckets - 1);
+      for (auto distance : block) {
+        mHistogram[std::min(std::size_t(distance * bucketScale), lastBucket)]++;
+      }
+    }
+    if (kinds & QUANTILES) {
+      for (auto distance : block)
+        mSketch.add(distance);
+    }
+    if (kinds & TOP_K) {
+      for (std::size_t i = 0; i < block.size(); ++i) {
+        // Most distances lose against a full list; skip the heap for them.
+        if (mTop.size() == mConfig->mTopK &&
+            (mTop.empty() || block[i] < mTop.front().mDistance))
+          continue;
+        pushTop(TopEntry{.mDistance = block[i],
+                         .mIndex = firstIndex + offset + i});
+      }
+    }
+  }
+}
+
+void State::merge(const State &other) {
+  addMoments(other.mCount, other.mMean, other.mM2, other.mMin, other.mMax);
+  for (std::size_t i = 0; i < mHistogram.size(); ++i)
+    mHistogram[i] += other.mHistogram[i];
+  if (mConfig->mKinds & QUANTILES)
+    mSketch.merge(other.mSketch);
+  for (const auto &entry : other.mTop)
+    pushTop(entry);
+}
+
+Summary State::summary() const {
+  Summary result{.mKinds = mConfig->mKinds,
+                 .mCount = mCount,
+                 .mMin = mMin,
+                 .mMax = mMax,
+                 .mMean = mMean,
+                 .mVariance = mCount > 1 ? mM2 / double(mCount - 1) : 0.,
+                 .mHistogramMax = mConfig->mHistogramMax,
+                 .mHistogram = mHistogram};
+  if (mConfig->mKinds & QUANTILES) {
+    for (auto q : mConfig->mQuantiles) {
+      result.mQuantiles.emplace_back(
+          q, std::clamp(mSketch.quantile(q, mCount), mMin, mMax));
+    }
+  }
+  result.mTop = mTop;
+  std::sort(result.mTop.begin(), result.mTop.end(),
+            [](const auto &lhs, const auto &rhs) {
+              return evictsBefore(rhs, lhs);
+            });
+  return result;
+}
+
+void Summary::print(CliUtils::IoBufferedWriter &out) const {
+  out.printSv("Aggregates:\n");
+  if (mKinds & COUNT) {
+    out.printSv("  count: ");
+    out.printNumber(mCount);
+    out.printSv("\n");
+  }
+  if (mKinds & MIN) {
+    out.printSv("  min: ");
+    printValue(out, mMin);
+    out.printSv("\n");
+  }
+  if (mKinds & MAX) {
+    out.printSv("  max: ");
+    printValue(out, mMax);
+    out.printSv("\n");
+  }
+  if (mKinds & MEAN) {
+    out.printSv("  mean: ");
+    printValue(out, mMean);
+    out.printSv("\n");
+  }
+  if (mKinds & VARIANCE) {
+    out.printSv("  variance: ");
+    printValue(out, mVariance);
+    out.printSv(" (standard deviation ");
+    printValue(out, std::sqrt(mVariance));
+    out.printSv(")\n");
+  }
+  if (mKinds & HISTOGRAM) {
+    const auto width = mHistogramMax / double(mHistogram.size());
+    out.printSv("  histogram:\n");
+    for (std::size_t i = 0; i < mHistogram.size(); ++i) {
+      out.printSv("    [");
+      out.printNumber(double(i) * width, std::chars_format::fixed, 1);
+      out.printSv(", ");
+      out.printNumber(double(i + 1) * width, std::chars_format::fixed, 1);
+      out.printSv(i + 1 == mHistogram.size() ? "]: " : "): ");
+      out.printNumber(mHistogram[i]);
+      out.printSv("\n");
+    }
+  }
+  if (mKinds & QUANTILES) {
+    out.printSv("  quantiles (within ");
+    out.printNumber(QuantileSketch::RELATIVE_ERROR * 100.,
+                    std::chars_format::fixed, 2);
+    out.printSv("%):\n");
+    for (const auto &[q, value] : mQuantiles) {
+      out.printSv("    p");
+      out.printNumber(q * 100., std::chars_format::general);
+      out.printSv(": ");
+      printValue(out, value);
+      out.printSv("\n");
+    }
+  }
+  if (mKinds & TOP_K) {
+    out.printSv("  top ");
+    out.printNumber(mTop.size());
+    out.printSv(":\n");
+    for (const auto &entry : mTop) {
+      out.printSv("    pair ");
+      out.printNumber(entry.mIndex);
+      out.printSv(": ");
+      printValue(out, entry.mDistance);
+      out.printSv("\n");
+    }
+  }
+}
+
+} // namespace Haversine::Aggregates
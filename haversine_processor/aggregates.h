@@ -0,0 +1,128 @@
+#pragma once
+
+#include "cli_utils.h"
+#include "math_utils.h"
+
+#include <cstdint>
+#include <numbers>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace Haversine::Aggregates {
+
+enum Kind : std::uint32_t {
+  COUNT = 1 << 0,
+  MIN = 1 << 1,
+  MAX = 1 << 2,
+  MEAN = 1 << 3,
+  VARIANCE = 1 << 4,
+  HISTOGRAM = 1 << 5,
+  QUANTILES = 1 << 6,
+  TOP_K = 1 << 7,
+  ALL = (1 << 8) - 1
+};
+
+Kind kindFrom(std::string_view rawText);
+
+struct Config {
+  // From --aggregates=kind,...|all, --buckets=N, --top=K and
+  // --quantiles=q,...; mKinds is 0 without --aggregates.
+  static Config from(const CliUtils::CommandLineOptions &options);
+
+  std::uint32_t mKinds{0};
+  std::uint32_t mHistogramBuckets{16};
+  // Half the circumference: no haversine distance is longer.
+  double mHistogramMax{std::numbers::pi * MathUtils::EARTH_RADIUS};
+  std::uint32_t mTopK{10};
+  std::vector<double> mQuantiles{0.5, 0.9, 0.99};
+};
+
+// Log-linear buckets over the bit pattern of the value (as in HDR
+// histograms): every power of two is split into 2^SUB_BUCKET_BITS buckets,
+// so a quantile is off by at most half a bucket, 2^-(SUB_BUCKET_BITS+1)
+// relative. Sketches merge by adding counts.
+class QuantileSketch {
+public:
+  static constexpr int SUB_BUCKET_BITS = 7;
+  // Values below 2^MIN_EXPONENT share the first bucket, values from
+  // 2^MAX_EXPONENT on the last one.
+  static constexpr int MIN_EXPONENT = -10;
+  static constexpr int MAX_EXPONENT = 16;
+  static constexpr double RELATIVE_ERROR = 1. / (2 << SUB_BUCKET_BITS);
+
+  QuantileSketch();
+
+  void add(double value) { mCounts[bucketOf(value)]++; }
+  void merge(const QuantileSketch &other);
+  // Representative value of the bucket holding rank q * (count - 1).
+  double quantile(double q, std::uint64_t count) const;
+
+private:
+  static std::size_t bucketOf(double value);
+  static double valueOf(std::size_t bucket);
+
+  std::vector<std::uint64_t> mCounts;
+};
+
+struct TopEntry {
+  double mDistance;
+  std::uint64_t mIndex;
+};
+
+// The aggregates of a State, resolved for reporting.
+struct Summary {
+  void print(CliUtils::IoBufferedWriter &out) const;
+
+  std::uint32_t mKinds{0};
+  std::uint64_t mCount{0};
+  double mMin{0};
+  double mMax{0};
+  double mMean{0};
+  // Sample variance.
+  double mVariance{0};
+  // Bucket i counts distances in [i, i + 1) * mHistogramMax / buckets; the
+  // last one also holds everything above.
+  double mHistogramMax{0};
+  std::vector<std::uint64_t> mHistogram;
+  // (q, value) pairs, within QuantileSketch::RELATIVE_ERROR of the value.
+  std::vector<std::pair<double, double>> mQuantiles;
+  // Longest first, ties broken by the lower index.
+  std::vector<TopEntry> mTop;
+};
+
+// Everything selected in a Config, for one range of pairs. States of
+// neighbouring ranges merge into the state of their union.
+class State {
+public:
+  explicit State(const Config &config);
+
+  // distances[i] belongs to pair firstIndex + i.
+  void add(std::span<const double> distances, std::uint64_t firstIndex);
+  void merge(const State &other);
+
+  // Ranges of about this many pairs keep the number of partial states, and
+  // the order they are merged in, independent of the thread count.
+  static std::uint64_t chunkPairs(std::uint64_t pairCount);
+
+  Summary summary() const;
+
+private:
+  void addMoments(std::uint64_t count, double mean, double m2, double minimum,
+                  double maximum);
+  void pushTop(const TopEntry &entry);
+
+  const Config *mConfig;
+  std::uint64_t mCount{0};
+  double mMean{0};
+  double mM2{0};
+  double mMin{0};
+  double mMax{0};
+  std::vector<std::uint64_t> mHistogram;
+  QuantileSketch mSketch;
+  // Min-heap on (distance, -index): the front is the entry to evict.
+  std::vector<TopEntry> mTop;
+};
+
+} // namespace Haversine::Aggregates
@@ -0,0 +1,189 @@
+#include "checkpoint.h"
+#include "chunk_index.h"
+#include "cli_utils.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+extern "C" {
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+namespace Haversine::Checkpoint {
+
+namespace {
+constexpr std::array<char, 8> CHECKPOINT_MAGIC{'H', 'V', 'C', 'K',
+                                               'P', 'T', '0', '1'};
+constexpr std::uint64_t SAMPLE_BLOCKS = 16;
+constexpr std::uint64_t SAMPLE_BLOCK_SIZE = 4096;
+static_assert(SAMPLE_BLOCKS > 1);
+
+struct CheckpointRecord {
+  std::array<char, 8> mMagic;
+  SpatialIndex::FileIdentity mSource;
+  std::uint64_t mArrayOffset;
+  std::uint64_t mResumeOffset;
+  std::uint64_t mPrefixHash;
+  std::uint64_t mPairCount;
+  double mSum;
+  double mCompensation;
+};
+
+bool isWhitespace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// FNV-1a.
+std::uint64_t hashBytes(std::uint64_t hash, std::string_view bytes) {
+  for (unsigned char c : bytes) {
+    hash ^= c;
+    hash *= 0x100000001B3ULL;
+  }
+  return hash;
+}
+} // namespace
+
+std::optional<PairsLayout> PairsLayout::of(std::string_view text) {
+  const auto arrayOffset = ChunkIndex::findPairsArray(text);
+  if (!arrayOffset)
+    return std::nullopt;
+  PairsLayout result;
+  result.mArrayOffset = *arrayOffset;
+
+  // The document must end in "]}" so that appended pairs only replace it.
+  auto end = text.size();
+  auto expectBackward = [&](char c) {
+    while (end > result.mArrayOffset && isWhitespace(text[end - 1]))
+      --end;
+    if (end <= result.mArrayOffset - 1 || text[end - 1] != c)
+      return false;
+    --end;
+    return true;
+  };
+  if (!expectBackward('}') || !expectBackward(']'))
+    return std::nullopt;
+  while (end > result.mArrayOffset && isWhitespace(text[end - 1]))
+    --end;
+  if (end == result.mArrayOffset) {
+    result.mResumeOffset = end;
+    return result;
+  }
+  if (text[end - 1] != '}')
+    return std::nullopt;
+  result.mResumeOffset = end;
+  return result;
+}
+
+std::optional<Checkpoint> Checkpoint::load(std::string_view filename) {
+  std::string path{filename};
+  auto fd = ::open(path.c_str(), O_RDONLY);
+  if (fd == -1)
+    return std::nullopt;
+  CliUtils::FileHandle handle{
+      .mIsOpen = true, .mNeedsClosing = true, .mFileDescriptor = fd};
+
+  CheckpointRecord record{};
+  if (::read(fd, &record, sizeof(record)) != ssize_t(sizeof(record)) ||
+      record.mMagic != CHECKPOINT_MAGIC)
+    return std::nullopt;
+  Checkpoint result;
+  result.mSource = record.mSource;
+  result.mLayout = PairsLayout{.mArrayOffset = record.mArrayOffset,
+                               .mResumeOffset = record.mResumeOffset};
+  result.mPrefixHash = record.mPrefixHash;
+  result.mPairCount = record.mPairCount;
+  result.mSum = MathUtils::CompensatedSum{.mSum = record.mSum,
+                                          .mCompensation =
+                                              record.mCompensation};
+  return result;
+}
+
+void Checkpoint::save(std::string_view filename) const {
+  auto file = CliUtils::FileHandle::open(filename, O_WRONLY | O_CREAT | O_TRUNC,
+                                         S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  const CheckpointRecord record{.mMagic = CHECKPOINT_MAGIC,
+                                .mSource = mSource,
+                                .mArrayOffset = mLayout.mArrayOffset,
+                                .mResumeOffset = mLayout.mResumeOffset,
+                                .mPrefixHash = mPrefixHash,
+                                .mPairCount = mPairCount,
+                                .mSum = mSum.mSum,
+                                .mCompensation = mSum.mCompensation};
+  if (::write(file.mFileDescriptor, &record, sizeof(record)) !=
+      ssize_t(sizeof(record)))
+    throw std::runtime_error("Unable to write checkpoint file");
+}
+
+std::string Checkpoint::readRange(int fileDescriptor, std::uint64_t offset,
+                                  std::uint64_t size) {
+  std::string result(size, '\0');
+  std::uint64_t done = 0;
+  while (done < size) {
+    const auto bytesRead = ::pread(fileDescriptor, result.data() + done,
+                                   size - done, off_t(offset + done));
+    if (bytesRead < 0)
+      throw std::runtime_error("Unable to read input file");
+    if (bytesRead == 0)
+      break;
+    done += std::uint64_t(bytesRead);
+  }
+  result.resize(done);
+  return result;
+}
+
+std::uint64_t Checkpoint::prefixHash(int fileDescriptor,
+                                     std::uint64_t prefixSize) {
+  const std::string_view sizeBytes(reinterpret_cast<const char *>(&prefixSize),
+                                   sizeof(prefixSize));
+  std::uint64_t hash = hashBytes(0xCBF29CE484222325ULL, sizeBytes);
+  const auto blockSize = std::min(SAMPLE_BLOCK_SIZE, prefixSize);
+  const auto lastStart = prefixSize - blockSize;
+  std::uint64_t previousEnd = 0;
+  for (std::uint64_t i = 0; i < SAMPLE_BLOCKS; ++i) {
+    const auto start =
+        std::max(previousEnd, lastStart * i / (SAMPLE_BLOCKS - 1));
+    const auto end = std::min(start + blockSize, prefixSize);
+    if (start >= end)
+      continue;
+    hash = hashBytes(hash, readRange(fileDescriptor, start, end - start));
+    previousEnd = end;
+  }
+  return hash;
+}
+
+bool Checkpoint::matches(int fileDescriptor,
+                         const SpatialIndex::FileIdentity &identity) const {
+  if (identity.mSize < mLayout.mResumeOffset ||
+      mLayout.mArrayOffset > mLayout.mResumeOffset)
+    return false;
+  // The header is re-read on resume, so a checkpoint whose array offset is
+  // not the root "pairs" array's would splice the appended pairs into it.
+  if (ChunkIndex::findPairsArray(
+          readRange(fileDescriptor, 0, mLayout.mArrayOffset)) !=
+      mLayout.mArrayOffset)
+    return false;
+  return prefixHash(fileDescriptor, mLayout.mResumeOffset) == mPrefixHash;
+}
+
+std::string
+Checkpoint::appendedDocument(int fileDescriptor,
+                             const SpatialIndex::FileIdentity &identity,
+                             std::uint64_t &bodyOffset) const {
+  auto document = readRange(fileDescriptor, 0, mLayout.mArrayOffset);
+  auto appended =
+      readRange(fileDescriptor, mLayout.mResumeOffset,
+                identity.mSize - mLayout.mResumeOffset);
+  std::size_t skip = 0;
+  while (skip < appended.size() && isWhitespace(appended[skip]))
+    ++skip;
+  if (mPairCount != 0 && skip < appended.size() && appended[skip] == ',')
+    ++skip;
+  bodyOffset = mLayout.mResumeOffset + skip;
+  document.append(appended, skip);
+  return document;
+}
+
+} // namespace Haversine::Checkpoint
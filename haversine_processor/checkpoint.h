@@ -0,0 +1,59 @@
+#pragma once
+
+#include "math_utils.h"
+#include "spatial_index.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace Haversine::Checkpoint {
+
+// Where the pair array sits in a {"pairs":[...]} document.
+struct PairsLayout {
+  // Returns nullopt for documents whose pair array is not the last thing in
+  // them; those cannot be extended by appending.
+  static std::optional<PairsLayout> of(std::string_view text);
+
+  // First byte after the array's '['.
+  std::uint64_t mArrayOffset{0};
+  // First byte after the last complete pair, or mArrayOffset if empty.
+  std::uint64_t mResumeOffset{0};
+};
+
+// State of a processed append-only input, kept in a sidecar next to it. A
+// later run that finds the bytes before mResumeOffset unchanged only has to
+// parse what was appended after them.
+struct Checkpoint {
+  static std::optional<Checkpoint> load(std::string_view filename);
+  void save(std::string_view filename) const;
+
+  // Hash of the prefix size and of sampled blocks of the prefix. Blocks are
+  // spread over it and always include the first one, which holds the header,
+  // and the one ending at the resume offset; rewrites and truncations are
+  // caught without reading everything.
+  static std::uint64_t prefixHash(int fileDescriptor, std::uint64_t prefixSize);
+
+  // The file still starts with the prefix this checkpoint was taken on.
+  bool matches(int fileDescriptor,
+               const SpatialIndex::FileIdentity &identity) const;
+
+  // `size` bytes of the file from `offset`, fewer at its end.
+  static std::string readRange(int fileDescriptor, std::uint64_t offset,
+                               std::uint64_t size);
+  // A document holding only the pairs appended after mResumeOffset: the
+  // original header followed by the appended bytes minus their leading ','.
+  // Byte mLayout.mArrayOffset of the document is byte bodyOffset of the file.
+  std::string appendedDocument(int fileDescriptor,
+                               const SpatialIndex::FileIdentity &identity,
+                               std::uint64_t &bodyOffset) const;
+
+  SpatialIndex::FileIdentity mSource;
+  PairsLayout mLayout;
+  std::uint64_t mPrefixHash{0};
+  std::uint64_t mPairCount{0};
+  MathUtils::CompensatedSum mSum;
+};
+
+} // namespace Haversine::Checkpoint
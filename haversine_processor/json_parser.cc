@@ -1,27 +1,64 @@
 #include "json_parser.h"
+#include "json_serializer.h"
 
+#include <algorithm>
+#include <array>
 #include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <string>
 
 namespace json_parser {
 
 namespace {
+bool isWhiteSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// 1-based line, and column counted in bytes from the last '\n' or '\r'.
+// Only errors need them, so they are recomputed from the byte offset instead
+// of being tracked while parsing.
+struct TextPosition {
+  std::uint64_t mLine;
+  std::uint64_t mColumn;
+};
+
+TextPosition positionOf(std::string_view input, std::uint64_t offset) {
+  const auto before = input.substr(0, offset);
+  const auto lastBreak = before.find_last_of("\n\r");
+  const auto lines = std::count(before.begin(), before.end(), '\n');
+  return TextPosition{.mLine = 1 + std::uint64_t(lines),
+                      .mColumn = lastBreak == std::string_view::npos
+                                     ? offset
+                                     : offset - lastBreak - 1};
+}
+} // namespace
+
 void skipWhiteSpace(Context &ctx) {
-  while (ctx.mCurrentPos < ctx.mInput.size()) {
-    auto currChar = ctx.mInput[ctx.mCurrentPos];
-    if (currChar == '\n') {
-      ctx.mCurrentLine++;
-      ctx.mCurrentColumn = 0;
-      ctx.mCurrentPos++;
-    } else if (currChar == '\r') {
-      ctx.mCurrentColumn = 0;
-      ctx.mCurrentPos++;
-    } else if (currChar == ' ' || currChar == '\t') {
-      ctx.mCurrentPos++;
-      ctx.mCurrentColumn++;
-    } else {
-      break;
-    }
+  const auto position = ctx.mCurrentPos;
+  if (position >= ctx.mInput.size() || !isWhiteSpace(ctx.mInput[position]))
+    return;
+  // Most runs between tokens are a single separator byte.
+  if (position + 1 == ctx.mInput.size() ||
+      !isWhiteSpace(ctx.mInput[position + 1])) {
+    ctx.mCurrentPos = position + 1;
+    return;
   }
+  ctx.mCurrentPos += ctx.mKernels->mSkipWhitespace(
+      ctx.mInput.data() + position, ctx.mInput.size() - position);
+}
+
+namespace {
+bool isHexDigit(char c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') ||
+         (c >= 'A' && c <= 'F');
+}
+
+// Bounds-checked, so a number may end the input.
+bool digitAt(const Context &ctx) {
+  return ctx.mCurrentPos < ctx.mInput.size() &&
+         ctx.mInput[ctx.mCurrentPos] >= '0' &&
+         ctx.mInput[ctx.mCurrentPos] <= '9';
 }
 
 void parseFraction(Context &ctx, std::string_view &fraction) {
@@ -30,55 +67,35 @@ void parseFraction(Context &ctx, std::string_view &fraction) {
     return;
   }
   const auto beginFraction = ctx.mCurrentPos++;
-  auto endFraction = ctx.mCurrentPos;
-  ctx.mCurrentColumn++;
-  char currChar = ctx.mInput[ctx.mCurrentPos];
-  if (ctx.mCurrentPos >= ctx.mInput.size() ||
-      (currChar < '0' || currChar > '9')) {
+  if (!digitAt(ctx)) {
     ctx.mAbort = true;
     ctx.mErrorMessage = "Unexpected end of input while parsing a number";
     return;
   }
-  do {
-    endFraction++;
+  while (digitAt(ctx))
     ctx.mCurrentPos++;
-    ctx.mCurrentColumn++;
-    currChar = ctx.mInput[ctx.mCurrentPos];
-  } while (ctx.mCurrentPos < ctx.mInput.size() &&
-           (currChar >= '0' && currChar <= '9'));
-  fraction =
-      std::string_view(&ctx.mInput[beginFraction], endFraction - beginFraction);
+  fraction = ctx.mInput.substr(beginFraction, ctx.mCurrentPos - beginFraction);
 }
 
 void parseExponent(Context &ctx, std::string_view &exponent) {
   if (ctx.mCurrentPos >= ctx.mInput.size() ||
-      ctx.mInput[ctx.mCurrentPos] != 'e' ||
-      ctx.mInput[ctx.mCurrentPos] != 'E') {
+      (ctx.mInput[ctx.mCurrentPos] != 'e' &&
+       ctx.mInput[ctx.mCurrentPos] != 'E')) {
     return;
   }
   const auto beginExponent = ctx.mCurrentPos++;
-  auto endExponent = ctx.mCurrentPos;
-  ctx.mCurrentColumn++;
-  char currChar = ctx.mInput[ctx.mCurrentPos];
-  if (currChar == '+' || currChar == '-') {
+  if (ctx.mCurrentPos < ctx.mInput.size() &&
+      (ctx.mInput[ctx.mCurrentPos] == '+' ||
+       ctx.mInput[ctx.mCurrentPos] == '-'))
     ctx.mCurrentPos++;
-    ctx.mCurrentColumn++;
-    endExponent++;
-    currChar = ctx.mInput[ctx.mCurrentPos];
-  }
-  if (ctx.mCurrentPos >= ctx.mInput.size() ||
-      (currChar < '0' || currChar > '9')) {
+  if (!digitAt(ctx)) {
     ctx.mAbort = true;
     ctx.mErrorMessage = "Unexpected end of input while parsing a number";
     return;
   }
-  do {
-    endExponent++;
-    currChar = ctx.mInput[ctx.mCurrentPos];
-  } while (ctx.mCurrentPos < ctx.mInput.size() &&
-           (currChar >= '0' && currChar <= '9'));
-  exponent =
-      std::string_view(&ctx.mInput[beginExponent], endExponent - beginExponent);
+  while (digitAt(ctx))
+    ctx.mCurrentPos++;
+  exponent = ctx.mInput.substr(beginExponent, ctx.mCurrentPos - beginExponent);
 }
 
 void parseInteger(Context &ctx, std::string_view &integer) {
@@ -94,7 +111,6 @@ void parseInteger(Context &ctx, std::string_view &integer) {
   if (currChar == '-') {
     isNegative = true;
     ctx.mCurrentPos++;
-    ctx.mCurrentColumn++;
     if (ctx.mInput.size() <= ctx.mCurrentPos) {
       ctx.mAbort = true;
       ctx.mErrorMessage = "Unexpected end of input while parsing a number";
@@ -106,7 +122,6 @@ void parseInteger(Context &ctx, std::string_view &integer) {
   if (currChar == '0') {
     const auto beginNumber = (ctx.mCurrentPos++) - unsigned(isNegative);
     auto endNumber = ctx.mCurrentPos;
-    ctx.mCurrentColumn++;
     integer =
         std::string_view(&ctx.mInput[beginNumber], endNumber - beginNumber);
     return;
@@ -115,20 +130,42 @@ void parseInteger(Context &ctx, std::string_view &integer) {
   if (currChar >= '1' && currChar <= '9') {
     const auto beginNumber = (ctx.mCurrentPos++) - unsigned(isNegative);
     auto endNumber = ctx.mCurrentPos;
-    ctx.mCurrentColumn++;
     while (ctx.mCurrentPos < ctx.mInput.size()) {
       auto c = ctx.mInput[ctx.mCurrentPos];
       if (c < '0' || c > '9') {
         break;
       }
       endNumber = ++ctx.mCurrentPos;
-      ctx.mCurrentColumn++;
     }
     integer =
         std::string_view(&ctx.mInput[beginNumber], endNumber - beginNumber);
   }
 }
 
+bool convertNumber(std::string_view text, Number::NumberType type,
+                   Number::InternalNumber &out) {
+  const auto *first = text.data();
+  const auto *last = text.data() + text.size();
+  std::errc errc{};
+  switch (type) {
+  case Number::NumberType::FLOATING_POINT_32:
+    errc = std::from_chars(first, last, out.mFloat32).ec;
+    break;
+  case Number::NumberType::FLOATING_POINT:
+    errc = std::from_chars(first, last, out.mFloat).ec;
+    break;
+  case Number::NumberType::SIGNED:
+    errc = std::from_chars(first, last, out.mSigned).ec;
+    break;
+  case Number::NumberType::UNSIGNED:
+    errc = std::from_chars(first, last, out.mUnsigned).ec;
+    break;
+  case Number::NumberType::UNINITIALIZED:
+    return false;
+  }
+  return errc == std::errc();
+}
+
 void parseElement(Context &ctx, Value &out) {
   skipWhiteSpace(ctx);
   Value::parse(ctx, out);
@@ -138,71 +175,25 @@ void parseElement(Context &ctx, Value &out) {
   skipWhiteSpace(ctx);
 }
 
-void printIndent(std::string &out, json_parser::PrintContext &ctx) {
-  const auto newSize = out.size() + ctx.mCurrentIndentation;
-  out.resize(newSize, ' ');
-}
-
 } // namespace
 
-void parse(std::string_view input, Value &json) {
+void parse(std::string_view input, Value &json, const ParseOptions &options) {
   Context ctx{.mInput = input,
               .mCurrentPos = 0,
-              .mCurrentLine = 1,
-              .mCurrentColumn = 0,
               .mAbort = false,
-              .mErrorMessage = ""};
+              .mErrorMessage = "",
+              .mSinglePrecision = options.mSinglePrecision,
+              .mLazyNumbers = options.mLazyNumbers,
+              .mMaxDepth = options.mMaxDepth};
   parseElement(ctx, json);
   if (ctx.mAbort) {
-    ctx.mErrorMessage += " at " + std::to_string(ctx.mCurrentLine) + ":" +
-                         std::to_string(ctx.mCurrentColumn);
+    const auto position = positionOf(input, ctx.mCurrentPos);
+    ctx.mErrorMessage += " at " + std::to_string(position.mLine) + ":" +
+                         std::to_string(position.mColumn);
     throw std::runtime_error(ctx.mErrorMessage);
   }
 }
 
-void Value::parse(Context &ctx, Value &out) {
-  if (ctx.mCurrentPos >= ctx.mInput.size()) {
-    ctx.mAbort = true;
-    ctx.mErrorMessage = "Unexpected end of input while parsing json value";
-    return;
-  }
-
-  auto currChar = ctx.mInput[ctx.mCurrentPos];
-
-  if (currChar == '{') {
-    out.mValueType = ValueType::OBJECT;
-    new (&out.mInternalValue.mObject) Object();
-    Object::parse(ctx, out.mInternalValue.mObject);
-  } else if (currChar == '[') {
-    out.mValueType = ValueType::ARRAY;
-    new (&out.mInternalValue.mArray) Array();
-    Array::parse(ctx, out.mInternalValue.mArray);
-  } else if (currChar == '"') {
-    out.mValueType = ValueType::STRING;
-    new (&out.mInternalValue.mString) String();
-    String::parse(ctx, out.mInternalValue.mString);
-  } else if ((currChar >= '0' && currChar <= '9') || (currChar == '-')) {
-    out.mValueType = ValueType::NUMBER;
-    new (&out.mInternalValue.mNumber) Number();
-    Number::parse(ctx, out.mInternalValue.mNumber);
-  } else if (currChar == 't') {
-    out.mValueType = ValueType::TRUE;
-    new (&out.mInternalValue.mTrue) True();
-    True::parse(ctx, out.mInternalValue.mTrue);
-  } else if (currChar == 'f') {
-    out.mValueType = ValueType::FALSE;
-    new (&out.mInternalValue.mFalse) False();
-    False::parse(ctx, out.mInternalValue.mFalse);
-  } else if (currChar == 'n') {
-    out.mValueType = ValueType::JSON_NULL;
-    new (&out.mInternalValue.mNull) Null();
-    Null::parse(ctx, out.mInternalValue.mNull);
-  } else {
-    ctx.mAbort = true;
-    ctx.mErrorMessage = "Unexpected character while parsing json value";
-  }
-}
-
 void Null::parse(Context &ctx, Null &out) {
   if ((ctx.mInput.size() - ctx.mCurrentPos) < 4) {
     ctx.mAbort = true;
@@ -218,7 +209,6 @@ void Null::parse(Context &ctx, Null &out) {
     return;
   }
   ctx.mCurrentPos += 4;
-  ctx.mCurrentColumn += 4;
 }
 
 void True::parse(Context &ctx, True &out) {
@@ -236,7 +226,6 @@ void True::parse(Context &ctx, True &out) {
     return;
   }
   ctx.mCurrentPos += 4;
-  ctx.mCurrentColumn += 4;
 }
 
 void False::parse(Context &ctx, False &out) {
@@ -255,7 +244,6 @@ void False::parse(Context &ctx, False &out) {
     return;
   }
   ctx.mCurrentPos += 5;
-  ctx.mCurrentColumn += 5;
 }
 
 void Number::parse(Context &ctx, Number &out) {
@@ -264,6 +252,13 @@ void Number::parse(Context &ctx, Number &out) {
   if (ctx.mAbort) {
     return;
   }
+  // A '-' without digits; the fraction or exponent must not be read as the
+  // whole number.
+  if (integer.empty()) {
+    ctx.mAbort = true;
+    ctx.mErrorMessage = "Unexpected error while parsing a number";
+    return;
+  }
   std::string_view fraction;
   parseFraction(ctx, fraction);
   if (ctx.mAbort) {
@@ -281,38 +276,31 @@ void Number::parse(Context &ctx, Number &out) {
     ctx.mErrorMessage = "Unexpected error while parsing a number";
     return;
   }
-  if (!fraction.empty() || !exponent.empty()) {
-    out.mNumberType = NumberType::FLOATING_POINT;
-    auto [ptr, errc] = std::from_chars(fullNumber.data(),
-                                       fullNumber.data() + fullNumber.size(),
-                                       out.mInternalNumber.mFloat);
-    if (errc != std::errc()) {
-      ctx.mAbort = true;
-      ctx.mErrorMessage = "Unexpected error while parsing a number";
-    }
-    return;
-  }
-  if (fullNumber[0] == '-') {
-    out.mNumberType = NumberType::SIGNED;
-    auto [ptr, errc] = std::from_chars(fullNumber.data(),
-                                       fullNumber.data() + fullNumber.size(),
-                                       out.mInternalNumber.mSigned);
-    if (errc != std::errc()) {
-      ctx.mAbort = true;
-      ctx.mErrorMessage = "Unexpected error while parsing a number";
-    }
+  if (!fraction.empty() || !exponent.empty())
+    out.mNumberType = ctx.mSinglePrecision ? NumberType::FLOATING_POINT_32
+                                           : NumberType::FLOATING_POINT;
+  else
+    out.mNumberType =
+        fullNumber[0] == '-' ? NumberType::SIGNED : NumberType::UNSIGNED;
+  if (ctx.mLazyNumbers) {
+    out.mText = fullNumber;
+    out.mPending = true;
     return;
   }
-  out.mNumberType = NumberType::UNSIGNED;
-  auto [ptr, errc] =
-      std::from_chars(fullNumber.data(), fullNumber.data() + fullNumber.size(),
-                      out.mInternalNumber.mUnsigned);
-  if (errc != std::errc()) {
+  if (!convertNumber(fullNumber, out.mNumberType, out.mInternalNumber)) {
     ctx.mAbort = true;
     ctx.mErrorMessage = "Unexpected error while parsing a number";
   }
 }
 
+void Number::materialize() const {
+  if (!mPending)
+    return;
+  if (!convertNumber(mText, mNumberType, mInternalNumber))
+    throw std::runtime_error("Unexpected error while parsing a number");
+  mPending = false;
+}
+
 void String::parse(Context &ctx, String &out) {
   if (ctx.mCurrentPos >= ctx.mInput.size() ||
       ctx.mInput[ctx.mCurrentPos] != '"') {
@@ -321,62 +309,288 @@ void String::parse(Context &ctx, String &out) {
     return;
   }
 
-  bool escapeSequenceInitiated = false;
-  bool hexInitiated = false;
   ctx.mCurrentPos++;
-  ctx.mCurrentColumn++;
+  if (ctx.mCurrentPos >= ctx.mInput.size()) {
+    ctx.mAbort = true;
+    ctx.mErrorMessage = "Unexpected character while parsing a string";
+    return;
+  }
 
   const auto beginString = ctx.mCurrentPos;
-  auto endString = ctx.mCurrentPos;
-  do {
+  auto endString = ctx.mInput.size();
+  while (ctx.mCurrentPos < ctx.mInput.size()) {
+    const auto plain =
+        ctx.mKernels->mFindStringSpecial(ctx.mInput.data() + ctx.mCurrentPos,
+                                         ctx.mInput.size() - ctx.mCurrentPos);
+    ctx.mCurrentPos += plain;
+    if (ctx.mCurrentPos >= ctx.mInput.size())
+      break;
+
     auto currChar = ctx.mInput[ctx.mCurrentPos];
+    if (currChar == '"') {
+      endString = ctx.mCurrentPos;
+      ctx.mCurrentPos++;
+      break;
+    }
+    if (currChar != '\\') {
+      ctx.mAbort = true;
+      ctx.mErrorMessage = "Unexpected character while parsing a string";
+      return;
+    }
 
-    if (hexInitiated) {
-      if (currChar == '"') {
-        ctx.mCurrentPos++;
-        ctx.mCurrentColumn++;
-        break;
-      }
-      if ((currChar < '0' || currChar > '9') &&
-          (currChar < 'a' || currChar > 'f') &&
-          (currChar < 'A' || currChar > 'F')) {
-        ctx.mAbort = true;
-        ctx.mErrorMessage = "Unexpected character while parsing a string";
-        return;
-      }
-    } else if (escapeSequenceInitiated) {
-      if (currChar != '"' && currChar != '\\' && currChar != '/' &&
-          currChar != 'b' && currChar != 'f' && currChar != 'n' &&
-          currChar != 'r' && currChar != 't') {
-        if (currChar == 'u') {
-          hexInitiated = true;
-        } else {
+    ctx.mCurrentPos++;
+    if (ctx.mCurrentPos >= ctx.mInput.size())
+      break;
+    currChar = ctx.mInput[ctx.mCurrentPos];
+    if (currChar == 'u') {
+      ctx.mCurrentPos++;
+      for (int digit = 0; digit < 4 && ctx.mCurrentPos < ctx.mInput.size();
+           ++digit) {
+        if (!isHexDigit(ctx.mInput[ctx.mCurrentPos])) {
           ctx.mAbort = true;
           ctx.mErrorMessage = "Unexpected character while parsing a string";
           return;
         }
+        ctx.mCurrentPos++;
       }
-      escapeSequenceInitiated = false;
-    } else if (currChar == '"') {
+    } else if (currChar == '"' || currChar == '\\' || currChar == '/' ||
+               currChar == 'b' || currChar == 'f' || currChar == 'n' ||
+               currChar == 'r' || currChar == 't') {
       ctx.mCurrentPos++;
-      ctx.mCurrentColumn++;
-      break;
-    } else if (currChar == '\\') {
-      escapeSequenceInitiated = true;
-    } else if (currChar < ' ') {
+    } else {
       ctx.mAbort = true;
       ctx.mErrorMessage = "Unexpected character while parsing a string";
       return;
     }
-    ctx.mCurrentPos++;
-    ctx.mCurrentColumn++;
-    endString++;
-  } while (ctx.mCurrentPos < ctx.mInput.size());
+  }
 
   out.mValue = std::string(ctx.mInput.begin() + beginString,
                            ctx.mInput.begin() + endString);
 }
 
+namespace {
+// Value type by the first byte of its text; UNINITIALIZED for bytes no value
+// starts with.
+constexpr auto VALUE_START = [] {
+  std::array<Value::ValueType, 256> table{};
+  table['{'] = Value::OBJECT;
+  table['['] = Value::ARRAY;
+  table['"'] = Value::STRING;
+  table['-'] = Value::NUMBER;
+  for (char c = '0'; c <= '9'; ++c)
+    table[std::uint8_t(c)] = Value::NUMBER;
+  table['t'] = Value::TRUE;
+  table['f'] = Value::FALSE;
+  table['n'] = Value::JSON_NULL;
+  return table;
+}();
+
+constexpr std::size_t OBJECT_MEMBERS_RESERVE = 4;
+
+bool atEnd(const Context &ctx) { return ctx.mCurrentPos >= ctx.mInput.size(); }
+
+void fail(Context &ctx, const char *message) {
+  ctx.mAbort = true;
+  ctx.mErrorMessage = message;
+}
+
+void advance(Context &ctx) {
+  ctx.mCurrentPos++;
+}
+
+// Parses nested values without recursion: open containers are kept on an
+// explicit stack, and every step either descends into a new value or returns
+// to the innermost open container for its next separator. Positions and
+// messages of errors are those of the original recursive descent.
+class Parser {
+public:
+  explicit Parser(Context &ctx) : mCtx{ctx} {}
+
+  // Parses into `target` and everything after it up to the close of the
+  // containers opened so far.
+  void run(Value *target) {
+    while (target && !mCtx.mAbort) {
+      target = value(*target);
+      if (!target && !mCtx.mAbort)
+        target = next();
+    }
+  }
+
+  // Both expect the opening bracket at the current position and return the
+  // first element to parse, or nullptr for an empty container or an error.
+  Value *openObject(Object &object) {
+    if (!push({.mObject = &object, .mArray = nullptr}))
+      return nullptr;
+    advance(mCtx);
+    skipWhiteSpace(mCtx);
+    if (atEnd(mCtx)) {
+      fail(mCtx, "Unexpected end of input while parsing an object");
+      return nullptr;
+    }
+    if (mCtx.mInput[mCtx.mCurrentPos] == '}') {
+      advance(mCtx);
+      mStack.pop_back();
+      return nullptr;
+    }
+    // Room for a pair without regrowing, instead of growing 1, 2, 4.
+    object.mMembers.reserve(OBJECT_MEMBERS_RESERVE);
+    return member(object);
+  }
+
+  Value *openArray(Array &array) {
+    if (!push({.mObject = nullptr, .mArray = &array}))
+      return nullptr;
+    advance(mCtx);
+    skipWhiteSpace(mCtx);
+    if (atEnd(mCtx)) {
+      fail(mCtx, "Unexpected end of input while parsing an array");
+      return nullptr;
+    }
+    if (mCtx.mInput[mCtx.mCurrentPos] == ']') {
+      advance(mCtx);
+      mStack.pop_back();
+      return nullptr;
+    }
+    return array.mElements.emplace_back(std::make_unique<Value>()).get();
+  }
+
+private:
+  // One open container; exactly one pointer is set.
+  struct Frame {
+    Object *mObject;
+    Array *mArray;
+  };
+
+  bool push(Frame frame) {
+    if (mStack.size() >= mCtx.mMaxDepth) {
+      fail(mCtx, "Maximum nesting depth exceeded while parsing json value");
+      return false;
+    }
+    mStack.push_back(frame);
+    return true;
+  }
+
+  // Scalars are parsed whole; containers are opened.
+  Value *value(Value &out) {
+    if (atEnd(mCtx)) {
+      fail(mCtx, "Unexpected end of input while parsing json value");
+      return nullptr;
+    }
+    auto &internal = out.mInternalValue;
+    switch (VALUE_START[std::uint8_t(mCtx.mInput[mCtx.mCurrentPos])]) {
+    case Value::OBJECT:
+      out.mValueType = Value::OBJECT;
+      new (&internal.mObject) Object();
+      return openObject(internal.mObject);
+    case Value::ARRAY:
+      out.mValueType = Value::ARRAY;
+      new (&internal.mArray) Array();
+      return openArray(internal.mArray);
+    case Value::STRING:
+      out.mValueType = Value::STRING;
+      new (&internal.mString) String();
+      String::parse(mCtx, internal.mString);
+      return nullptr;
+    case Value::NUMBER:
+      out.mValueType = Value::NUMBER;
+      new (&internal.mNumber) Number();
+      Number::parse(mCtx, internal.mNumber);
+      return nullptr;
+    case Value::TRUE:
+      out.mValueType = Value::TRUE;
+      new (&internal.mTrue) True();
+      True::parse(mCtx, internal.mTrue);
+      return nullptr;
+    case Value::FALSE:
+      out.mValueType = Value::FALSE;
+      new (&internal.mFalse) False();
+      False::parse(mCtx, internal.mFalse);
+      return nullptr;
+    case Value::JSON_NULL:
+      out.mValueType = Value::JSON_NULL;
+      new (&internal.mNull) Null();
+      Null::parse(mCtx, internal.mNull);
+      return nullptr;
+    case Value::UNINITIALIZED:
+      break;
+    }
+    fail(mCtx, "Unexpected character while parsing json value");
+    return nullptr;
+  }
+
+  // Name and ':' of a member; returns its value to parse.
+  Value *member(Object &object) {
+    if (mCtx.mInput[mCtx.mCurrentPos] != '"') {
+      fail(mCtx, "Unexpected character while parsing an object");
+      return nullptr;
+    }
+    auto &newMember = object.mMembers.emplace_back();
+    String::parse(mCtx, newMember.mName);
+    if (mCtx.mAbort)
+      return nullptr;
+    skipWhiteSpace(mCtx);
+    if (atEnd(mCtx)) {
+      fail(mCtx, "Unexpected end of input while parsing an object");
+      return nullptr;
+    }
+    if (mCtx.mInput[mCtx.mCurrentPos] != ':') {
+      fail(mCtx, "Unexpected character while parsing an object");
+      return nullptr;
+    }
+    advance(mCtx);
+    skipWhiteSpace(mCtx);
+    if (atEnd(mCtx)) {
+      fail(mCtx, "Unexpected end of input while parsing an object");
+      return nullptr;
+    }
+    newMember.mElement = std::make_unique<Value>();
+    return newMember.mElement.get();
+  }
+
+  // After a complete value: closes finished containers and returns the next
+  // element of the innermost open one, or nullptr once none is left open.
+  Value *next() {
+    while (!mStack.empty()) {
+      const auto frame = mStack.back();
+      skipWhiteSpace(mCtx);
+      if (atEnd(mCtx)) {
+        fail(mCtx, "Unexpected end of input while parsing an array");
+        return nullptr;
+      }
+      const auto c = mCtx.mInput[mCtx.mCurrentPos];
+      if (c == (frame.mObject ? '}' : ']')) {
+        advance(mCtx);
+        mStack.pop_back();
+        continue;
+      }
+      const auto endMessage =
+          frame.mObject ? "Unexpected end of input while parsing an object"
+                        : "Unexpected end of input while parsing an array";
+      if (c != ',') {
+        fail(mCtx, endMessage);
+        return nullptr;
+      }
+      advance(mCtx);
+      skipWhiteSpace(mCtx);
+      if (atEnd(mCtx)) {
+        fail(mCtx, endMessage);
+        return nullptr;
+      }
+      if (frame.mObject)
+        return member(*frame.mObject);
+      return frame.mArray->mElements.emplace_back(std::make_unique<Value>())
+          .get();
+    }
+    return nullptr;
+  }
+
+  Context &mCtx;
+  std::vector<Frame> mStack;
+};
+} // namespace
+
+void Value::parse(Context &ctx, Value &out) { Parser{ctx}.run(&out); }
+
 void Array::parse(Context &ctx, Array &out) {
   if (ctx.mCurrentPos >= ctx.mInput.size() ||
       ctx.mInput[ctx.mCurrentPos] != '[') {
@@ -384,46 +598,8 @@ void Array::parse(Context &ctx, Array &out) {
     ctx.mErrorMessage = "Unexpected end of input while parsing an array";
     return;
   }
-  ctx.mCurrentPos++;
-  ctx.mCurrentColumn++;
-  skipWhiteSpace(ctx);
-  if (ctx.mCurrentPos >= ctx.mInput.size()) {
-    ctx.mAbort = true;
-    ctx.mErrorMessage = "Unexpected end of input while parsing an array";
-    return;
-  }
-  auto currChar = ctx.mInput[ctx.mCurrentPos];
-  while (currChar != ']') {
-    if (!out.mElements.empty()) {
-      if (currChar != ',') {
-        ctx.mAbort = true;
-        ctx.mErrorMessage = "Unexpected end of input while parsing an array";
-        return;
-      }
-      ctx.mCurrentPos++;
-      ctx.mCurrentColumn++;
-      skipWhiteSpace(ctx);
-      if (ctx.mCurrentPos >= ctx.mInput.size()) {
-        ctx.mAbort = true;
-        ctx.mErrorMessage = "Unexpected end of input while parsing an array";
-        return;
-      }
-      currChar = ctx.mInput[ctx.mCurrentPos];
-    }
-    auto &newElem = out.mElements.emplace_back(std::make_unique<Value>());
-    parseElement(ctx, *newElem);
-    if (ctx.mAbort)
-      return;
-    skipWhiteSpace(ctx);
-    if (ctx.mCurrentPos >= ctx.mInput.size()) {
-      ctx.mAbort = true;
-      ctx.mErrorMessage = "Unexpected end of input while parsing an array";
-      return;
-    }
-    currChar = ctx.mInput[ctx.mCurrentPos];
-  }
-  ctx.mCurrentPos++;
-  ctx.mCurrentColumn++;
+  Parser parser{ctx};
+  parser.run(parser.openArray(out));
 }
 
 void Object::parse(Context &ctx, Object &out) {
@@ -433,76 +609,289 @@ void Object::parse(Context &ctx, Object &out) {
     ctx.mErrorMessage = "Unexpected end of input while parsing an object";
     return;
   }
-  ctx.mCurrentPos++;
-  ctx.mCurrentColumn++;
-  skipWhiteSpace(ctx);
-  if (ctx.mCurrentPos >= ctx.mInput.size()) {
-    ctx.mAbort = true;
-    ctx.mErrorMessage = "Unexpected end of input while parsing an object";
-    return;
+  Parser parser{ctx};
+  parser.run(parser.openObject(out));
+}
+
+namespace {
+constexpr std::uint64_t SWAR_ONES = 0x0101010101010101ULL;
+constexpr std::uint64_t SWAR_HIGH_BITS = 0x8080808080808080ULL;
+
+std::uint64_t loadWord(const char *text) {
+  std::uint64_t word;
+  std::memcpy(&word, text, sizeof(word));
+  return word;
+}
+
+// Leading ASCII digits among the 8 bytes at `text`.
+unsigned leadingDigits(const char *text) {
+  const auto word = loadWord(text);
+  const auto nibbles = 0xF0F0F0F0F0F0F0F0ULL;
+  // A carry out of a non-digit byte only disturbs the bytes after it.
+  const auto nonDigit = ((word & nibbles) ^ (0x30 * SWAR_ONES)) |
+                        (((word + 0x06 * SWAR_ONES) & nibbles) ^
+                         (0x30 * SWAR_ONES));
+  return nonDigit ? unsigned(__builtin_ctzll(nonDigit)) / 8 : 8;
+}
+
+// Offset of the first '"', '\\' or control character among the 8 bytes at
+// `text`, or 8. Each test only over-reports above a true match, so the
+// lowest flagged byte is exact.
+unsigned stringSpecialInWord(const char *text) {
+  const auto word = loadWord(text);
+  auto zeroBytes = [](std::uint64_t v) {
+    return (v - SWAR_ONES) & ~v & SWAR_HIGH_BITS;
+  };
+  const auto special = zeroBytes(word ^ ('"' * SWAR_ONES)) |
+                       zeroBytes(word ^ ('\\' * SWAR_ONES)) |
+                       ((word - 0x20 * SWAR_ONES) & ~word & SWAR_HIGH_BITS);
+  return special ? unsigned(__builtin_ctzll(special)) / 8 : 8;
+}
+
+class Validator {
+public:
+  explicit Validator(std::string_view input)
+      : mInput{input}, mKernels{&Haversine::CpuDispatch::kernels()} {}
+
+  // Offset of the first grammar error, with its message, or the input size.
+  std::uint64_t run() {
+    if (!value())
+      return mPos;
+    skip();
+    while (!mStack.empty()) {
+      const char open = mStack.back();
+      const char close = open == '{' ? '}' : ']';
+      if (atEnd())
+        return fail("Unexpected end of input inside a container");
+      if (mInput[mPos] == close) {
+        mStack.pop_back();
+        ++mPos;
+        skip();
+        continue;
+      }
+      if (mInput[mPos] != ',')
+        return fail(open == '{' ? "Expected ',' or '}' in an object"
+                                : "Expected ',' or ']' in an array");
+      ++mPos;
+      skip();
+      if (open == '{' && !memberName())
+        return mPos;
+      if (!value())
+        return mPos;
+      skip();
+    }
+    if (!atEnd())
+      return fail("Unexpected character after the json value");
+    return mPos;
   }
-  auto currChar = ctx.mInput[ctx.mCurrentPos];
-  while (currChar != '}') {
-    if (!out.mMembers.empty()) {
-      if (currChar != ',') {
-        ctx.mAbort = true;
-        ctx.mErrorMessage = "Unexpected end of input while parsing an object";
-        return;
+
+  std::string_view mErrorMessage;
+
+private:
+  bool atEnd() const { return mPos >= mInput.size(); }
+
+  std::uint64_t fail(std::string_view message) {
+    mErrorMessage = message;
+    return mPos;
+  }
+
+  void skip() {
+    if (!atEnd() && isWhiteSpace(mInput[mPos]))
+      mPos += mKernels->mSkipWhitespace(mInput.data() + mPos,
+                                        mInput.size() - mPos);
+  }
+
+  // Parses `"name"` and the following ':' of an object member.
+  bool memberName() {
+    if (atEnd() || mInput[mPos] != '"') {
+      fail("Expected a string member name");
+      return false;
+    }
+    if (!string())
+      return false;
+    skip();
+    if (atEnd() || mInput[mPos] != ':') {
+      fail("Expected ':' after a member name");
+      return false;
+    }
+    ++mPos;
+    skip();
+    return true;
+  }
+
+  // Parses one value. Containers are left open on the stack, so nesting
+  // never recurses.
+  bool value() {
+    while (true) {
+      skip();
+      if (atEnd()) {
+        fail("Unexpected end of input while expecting a value");
+        return false;
       }
-      ctx.mCurrentPos++;
-      ctx.mCurrentColumn++;
-      skipWhiteSpace(ctx);
-      if (ctx.mCurrentPos >= ctx.mInput.size()) {
-        ctx.mAbort = true;
-        ctx.mErrorMessage = "Unexpected end of input while parsing an object";
-        return;
+      const char open = mInput[mPos];
+      if (open != '{' && open != '[')
+        break;
+      // The same limit and error offset as parse, empty containers included.
+      if (mStack.size() >= DEFAULT_MAX_DEPTH) {
+        fail("Maximum nesting depth exceeded while parsing json value");
+        return false;
       }
-      currChar = ctx.mInput[ctx.mCurrentPos];
+      const char close = open == '{' ? '}' : ']';
+      ++mPos;
+      skip();
+      if (!atEnd() && mInput[mPos] == close) {
+        ++mPos;
+        return true;
+      }
+      mStack.push_back(open);
+      if (open == '{' && !memberName())
+        return false;
     }
-    if (currChar != '"') {
-      ctx.mAbort = true;
-      ctx.mErrorMessage = "Unexpected character while parsing an object";
-      return;
+    switch (mInput[mPos]) {
+    case '"':
+      return string();
+    case 't':
+      return literal("true");
+    case 'f':
+      return literal("false");
+    case 'n':
+      return literal("null");
+    default:
+      return number();
     }
-    Member newMember;
-    String::parse(ctx, newMember.mName);
-    if (ctx.mAbort)
-      return;
-    skipWhiteSpace(ctx);
-    if (ctx.mCurrentPos >= ctx.mInput.size()) {
-      ctx.mAbort = true;
-      ctx.mErrorMessage = "Unexpected end of input while parsing an object";
-      return;
+  }
+
+  bool literal(std::string_view text) {
+    if (mInput.substr(mPos, text.size()) != text) {
+      fail("Invalid literal");
+      return false;
     }
-    currChar = ctx.mInput[ctx.mCurrentPos];
-    if (currChar != ':') {
-      ctx.mAbort = true;
-      ctx.mErrorMessage = "Unexpected character while parsing an object";
-      return;
+    mPos += text.size();
+    return true;
+  }
+
+  bool digits() {
+    const auto start = mPos;
+    while (mInput.size() - mPos >= 8) {
+      const auto count = leadingDigits(mInput.data() + mPos);
+      mPos += count;
+      if (count < 8)
+        return mPos != start;
     }
-    ctx.mCurrentPos++;
-    ctx.mCurrentColumn++;
-    skipWhiteSpace(ctx);
-    if (ctx.mCurrentPos >= ctx.mInput.size()) {
-      ctx.mAbort = true;
-      ctx.mErrorMessage = "Unexpected end of input while parsing an object";
-      return;
+    while (!atEnd() && mInput[mPos] >= '0' && mInput[mPos] <= '9')
+      ++mPos;
+    return mPos != start;
+  }
+
+  bool number() {
+    if (!atEnd() && mInput[mPos] == '-')
+      ++mPos;
+    if (!atEnd() && mInput[mPos] == '0') {
+      ++mPos;
+    } else if (atEnd() || mInput[mPos] < '1' || mInput[mPos] > '9') {
+      fail("Expected a value");
+      return false;
+    } else {
+      digits();
     }
-    newMember.mElement = std::make_unique<Value>();
-    parseElement(ctx, *newMember.mElement);
-    if (ctx.mAbort)
-      return;
-    skipWhiteSpace(ctx);
-    if (ctx.mCurrentPos >= ctx.mInput.size()) {
-      ctx.mAbort = true;
-      ctx.mErrorMessage = "Unexpected end of input while parsing an array";
-      return;
+    if (!atEnd() && mInput[mPos] == '.') {
+      ++mPos;
+      if (!digits()) {
+        fail("Expected a digit after the decimal point");
+        return false;
+      }
     }
-    out.mMembers.push_back(std::move(newMember));
-    currChar = ctx.mInput[ctx.mCurrentPos];
+    if (!atEnd() && (mInput[mPos] == 'e' || mInput[mPos] == 'E')) {
+      ++mPos;
+      if (!atEnd() && (mInput[mPos] == '+' || mInput[mPos] == '-'))
+        ++mPos;
+      if (!digits()) {
+        fail("Expected a digit in the exponent");
+        return false;
+      }
+    }
+    return true;
   }
-  ctx.mCurrentPos++;
-  ctx.mCurrentColumn++;
+
+  bool string() {
+    ++mPos;
+    while (true) {
+      // Member names are short; a word-sized check usually finds the quote
+      // without calling into the vector kernel.
+      const auto inWord = mInput.size() - mPos >= 8
+                              ? stringSpecialInWord(mInput.data() + mPos)
+                              : 0;
+      mPos += inWord;
+      if (inWord == 8 || mInput.size() - mPos < 8)
+        mPos += mKernels->mFindStringSpecial(mInput.data() + mPos,
+                                             mInput.size() - mPos);
+      if (atEnd()) {
+        fail("Unterminated string");
+        return false;
+      }
+      const char c = mInput[mPos];
+      if (c == '"') {
+        ++mPos;
+        return true;
+      }
+      if (c != '\\') {
+        fail("Unescaped control character in a string");
+        return false;
+      }
+      ++mPos;
+      if (atEnd()) {
+        fail("Unterminated string");
+        return false;
+      }
+      const char escaped = mInput[mPos++];
+      if (escaped == 'u') {
+        for (int digit = 0; digit < 4; ++digit, ++mPos) {
+          if (atEnd() || !isHexDigit(mInput[mPos])) {
+            fail("Invalid unicode escape in a string");
+            return false;
+          }
+        }
+      } else if (escaped != '"' && escaped != '\\' && escaped != '/' &&
+                 escaped != 'b' && escaped != 'f' && escaped != 'n' &&
+                 escaped != 'r' && escaped != 't') {
+        --mPos;
+        fail("Invalid escape sequence in a string");
+        return false;
+      }
+    }
+  }
+
+  std::string_view mInput;
+  const Haversine::CpuDispatch::KernelTable *mKernels;
+  std::uint64_t mPos = 0;
+  // Open containers, '{' or '['.
+  std::vector<char> mStack;
+};
+} // namespace
+
+ValidationResult validate(std::string_view input) {
+  const auto &kernels = Haversine::CpuDispatch::kernels();
+  const std::uint64_t encodingError =
+      kernels.mValidateUtf8(input.data(), input.size());
+
+  Validator validator{input};
+  const auto grammarError = validator.run();
+
+  ValidationResult result;
+  if (encodingError < input.size() && encodingError <= grammarError) {
+    result.mErrorMessage = "Invalid UTF-8 sequence";
+    result.mOffset = encodingError;
+  } else if (!validator.mErrorMessage.empty()) {
+    result.mErrorMessage = validator.mErrorMessage;
+    result.mOffset = grammarError;
+  } else {
+    return result;
+  }
+  result.mValid = false;
+  const auto position = positionOf(input, result.mOffset);
+  result.mLine = position.mLine;
+  result.mColumn = position.mColumn;
+  return result;
 }
 
 Value::InternalValue::InternalValue() {}
@@ -542,125 +931,39 @@ Number::InternalNumber::~InternalNumber() {}
 
 Number::~Number() {}
 
-void print(std::string &out, Value &json) {
-  PrintContext ctx{};
-  json.print(out, ctx);
-}
-
-void Value::print(std::string &out, PrintContext &ctx) const {
-  switch (mValueType) {
-  case OBJECT: {
-    mInternalValue.mObject.print(out, ctx);
-  } break;
-  case ARRAY: {
-    mInternalValue.mArray.print(out, ctx);
-  } break;
-  case STRING: {
-    mInternalValue.mString.print(out, ctx);
-  } break;
-  case NUMBER: {
-    mInternalValue.mNumber.print(out, ctx);
-  } break;
-  case TRUE: {
-    mInternalValue.mTrue.print(out, ctx);
-  } break;
-  case FALSE: {
-    mInternalValue.mFalse.print(out, ctx);
-  } break;
-  case JSON_NULL: {
-    mInternalValue.mNull.print(out, ctx);
-  } break;
-  case UNINITIALIZED:
-  default: {
-    out += "uninitialized";
-    return;
-  } break;
+void materializeAll(const Value &json) {
+  // Gathered in document order first, so the conversions run as one loop
+  // reading the text front to back instead of being interleaved with the
+  // walk over the tree.
+  std::vector<const Number *> pending;
+  std::vector<const Value *> stack{&json};
+  while (!stack.empty()) {
+    const auto &value = *stack.back();
+    stack.pop_back();
+    if (value.mValueType == Value::OBJECT) {
+      const auto &members = value.mInternalValue.mObject.mMembers;
+      for (auto it = members.rbegin(); it != members.rend(); ++it)
+        if (it->mElement)
+          stack.push_back(it->mElement.get());
+    } else if (value.mValueType == Value::ARRAY) {
+      const auto &elements = value.mInternalValue.mArray.mElements;
+      for (auto it = elements.rbegin(); it != elements.rend(); ++it)
+        if (*it)
+          stack.push_back(it->get());
+    } else if (value.mValueType == Value::NUMBER &&
+               value.mInternalValue.mNumber.mPending) {
+      pending.push_back(&value.mInternalValue.mNumber);
+    }
   }
+  for (const auto *number : pending)
+    number->materialize();
 }
 
-void Object::print(std::string &out, PrintContext &ctx) const {
-  out += "{\n";
-  ctx.mCurrentIndentation += ctx.mIndentationSpaces;
-  for (auto i = 0ULL; i < mMembers.size(); ++i) {
-    const auto &member = mMembers[i];
-    printIndent(out, ctx);
-    member.mName.print(out, ctx);
-    out += ": ";
-    if (member.mElement)
-      member.mElement->print(out, ctx);
-    else
-      out += "uninitialized";
-    if (i < (mMembers.size() - 1))
-      out += ",\n";
-    else
-      out += "\n";
-  }
-  ctx.mCurrentIndentation -= ctx.mIndentationSpaces;
-  printIndent(out, ctx);
-  out += "}";
-}
-
-void Array::print(std::string &out, PrintContext &ctx) const {
-  out += "[\n";
-  ctx.mCurrentIndentation += ctx.mIndentationSpaces;
-  for (auto i = 0ULL; i < mElements.size(); ++i) {
-    const auto &element = mElements[i];
-    printIndent(out, ctx);
-    if (element)
-      element->print(out, ctx);
-    else
-      out += "uninitialized";
-    if (i < (mElements.size() - 1))
-      out += ",\n";
-    else
-      out += "\n";
-  }
-  ctx.mCurrentIndentation -= ctx.mIndentationSpaces;
-  printIndent(out, ctx);
-  out += "]";
-}
-
-void String::print(std::string &out, PrintContext &ctx) const {
-  out += '"';
-  out += mValue;
-  out += '"';
-}
-
-void Number::print(std::string &out, PrintContext &ctx) const {
-  std::array<char, 24> buffer;
-  switch (mNumberType) {
-  case UNSIGNED: {
-    auto [ptr, ec] = std::to_chars(buffer.data(), buffer.data() + buffer.size(),
-                                   mInternalNumber.mUnsigned);
-    const auto numberSv = std::string_view(buffer.data(), ptr);
-    out += numberSv;
-  } break;
-  case SIGNED: {
-    auto [ptr, ec] = std::to_chars(buffer.data(), buffer.data() + buffer.size(),
-                                   mInternalNumber.mSigned);
-    const auto numberSv = std::string_view(buffer.data(), ptr);
-    out += numberSv;
-  } break;
-  case FLOATING_POINT: {
-    auto [ptr, ec] =
-        std::to_chars(buffer.data(), buffer.data() + buffer.size(),
-                      mInternalNumber.mFloat, std::chars_format::fixed, 16);
-    const auto numberSv = std::string_view(buffer.data(), ptr);
-    out += numberSv;
-  } break;
-
-  case UNINITIALIZED:
-  default:
-    break;
-  }
+void print(std::string &out, Value &json) {
+  StringSink sink{.mOut = &out};
+  Serializer<StringSink>{sink}.value(json);
 }
 
-void True::print(std::string &out, PrintContext &ctx) const { out += "true"; }
-
-void False::print(std::string &out, PrintContext &ctx) const { out += "false"; }
-
-void Null::print(std::string &out, PrintContext &ctx) const { out += "null"; }
-
 const Value &Value::getMemberValue(std::string_view name) const {
   if (mValueType == ValueType::OBJECT)
     return mInternalValue.mObject.getMemberValue(name);
@@ -679,8 +982,11 @@ const Value &Object::getMemberValue(std::string_view name) const {
 
 const std::uint64_t &Value::getUnsigned() const {
   if (mValueType == ValueType::NUMBER) {
-    if (mInternalValue.mNumber.mNumberType == Number::NumberType::UNSIGNED)
-      return mInternalValue.mNumber.mInternalNumber.mUnsigned;
+    const auto &number = mInternalValue.mNumber;
+    if (number.mNumberType == Number::NumberType::UNSIGNED) {
+      number.materialize();
+      return number.mInternalNumber.mUnsigned;
+    }
     throw std::runtime_error(
         "Atempted to get unsigned from number that is not unsigned");
   }
@@ -690,8 +996,11 @@ const std::uint64_t &Value::getUnsigned() const {
 
 const std::int64_t &Value::getSigned() const {
   if (mValueType == ValueType::NUMBER) {
-    if (mInternalValue.mNumber.mNumberType == Number::NumberType::SIGNED)
-      return mInternalValue.mNumber.mInternalNumber.mSigned;
+    const auto &number = mInternalValue.mNumber;
+    if (number.mNumberType == Number::NumberType::SIGNED) {
+      number.materialize();
+      return number.mInternalNumber.mSigned;
+    }
     throw std::runtime_error(
         "Atempted to get signed from number that is not signed");
   }
@@ -701,9 +1010,11 @@ const std::int64_t &Value::getSigned() const {
 
 const double &Value::getFloatingPoint() const {
   if (mValueType == ValueType::NUMBER) {
-    if (mInternalValue.mNumber.mNumberType ==
-        Number::NumberType::FLOATING_POINT)
-      return mInternalValue.mNumber.mInternalNumber.mFloat;
+    const auto &number = mInternalValue.mNumber;
+    if (number.mNumberType == Number::NumberType::FLOATING_POINT) {
+      number.materialize();
+      return number.mInternalNumber.mFloat;
+    }
     throw std::runtime_error("Atempted to get floating point from number that "
                              "is not floating point");
   }
@@ -711,6 +1022,49 @@ const double &Value::getFloatingPoint() const {
       "Atempted to get number from value that is not a number");
 }
 
+const float &Value::getFloat32() const {
+  if (mValueType == ValueType::NUMBER) {
+    const auto &number = mInternalValue.mNumber;
+    if (number.mNumberType == Number::NumberType::FLOATING_POINT_32) {
+      number.materialize();
+      return number.mInternalNumber.mFloat32;
+    }
+    throw std::runtime_error("Atempted to get single precision floating point "
+                             "from number that is not single precision");
+  }
+  throw std::runtime_error(
+      "Atempted to get number from value that is not a number");
+}
+
+double Value::getAsFloatingPoint() const {
+  if (mValueType == ValueType::NUMBER) {
+    const auto &number = mInternalValue.mNumber;
+    number.materialize();
+    switch (number.mNumberType) {
+    case Number::NumberType::FLOATING_POINT:
+      return number.mInternalNumber.mFloat;
+    case Number::NumberType::FLOATING_POINT_32:
+      return number.mInternalNumber.mFloat32;
+    case Number::NumberType::SIGNED:
+      return double(number.mInternalNumber.mSigned);
+    case Number::NumberType::UNSIGNED:
+      return double(number.mInternalNumber.mUnsigned);
+    case Number::NumberType::UNINITIALIZED:
+      break;
+    }
+  }
+  throw std::runtime_error(
+      "Atempted to get number from value that is not a number");
+}
+
+float Value::getAsFloat32() const {
+  if (mValueType == ValueType::NUMBER &&
+      mInternalValue.mNumber.mNumberType ==
+          Number::NumberType::FLOATING_POINT_32)
+    return getFloat32();
+  return float(getAsFloatingPoint());
+}
+
 const std::vector<std::unique_ptr<Value>> &Value::getArray() const {
   if (mValueType == ValueType::ARRAY)
     return mInternalValue.mArray.mElements;
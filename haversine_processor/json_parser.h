@@ -1,27 +1,41 @@
 #pragma once
 
+#include "cpu_dispatch.h"
+
 #include <memory>
 #include <string_view>
 #include <vector>
 
 namespace json_parser {
+// Containers open at once; deeper documents are rejected instead of growing
+// the parser's stack and the recursion of Value's destructor without bound.
+constexpr std::uint32_t DEFAULT_MAX_DEPTH = 1024;
+
 struct Context {
   std::string_view mInput;
+  // Errors derive their line and column from this offset.
   std::uint64_t mCurrentPos = 0;
-  std::uint64_t mCurrentLine = 0;
-  std::uint64_t mCurrentColumn = 0;
   bool mAbort = false;
   std::string mErrorMessage;
+  bool mSinglePrecision = false;
+  bool mLazyNumbers = false;
+  std::uint32_t mMaxDepth = DEFAULT_MAX_DEPTH;
+  const Haversine::CpuDispatch::KernelTable *mKernels =
+      &Haversine::CpuDispatch::kernels();
 };
 
-struct PrintContext {
-  std::uint32_t mIndentationSpaces = 2;
-  std::uint32_t mCurrentIndentation = 0;
+struct ParseOptions {
+  // Store fractional numbers as float instead of double.
+  bool mSinglePrecision = false;
+  // Keep each number's text and convert it on first read, or in one pass
+  // with materializeAll. The input must outlive the tree, and numbers out of
+  // range only fail when they are read.
+  bool mLazyNumbers = false;
+  std::uint32_t mMaxDepth = DEFAULT_MAX_DEPTH;
 };
 
 struct String {
   static void parse(Context &ctx, String &out);
-  void print(std::string &out, PrintContext &ctx) const;
   std::string mValue;
 };
 
@@ -34,20 +48,21 @@ struct Member {
 
 struct Object {
   static void parse(Context &ctx, Object &out);
-  void print(std::string &out, PrintContext &ctx) const;
   const Value &getMemberValue(std::string_view name) const;
   std::vector<Member> mMembers;
 };
 
 struct Array {
   static void parse(Context &ctx, Array &out);
-  void print(std::string &out, PrintContext &ctx) const;
   std::vector<std::unique_ptr<Value>> mElements;
 };
 
 struct Number {
   static void parse(Context &ctx, Number &out);
-  void print(std::string &out, PrintContext &ctx) const;
+  // Converts mText if that is still pending. Throws std::runtime_error when
+  // it does not fit the type. Not safe to call for the same number from two
+  // threads; see materializeAll.
+  void materialize() const;
 
   ~Number();
 
@@ -55,41 +70,46 @@ struct Number {
     UNINITIALIZED,
     UNSIGNED,
     SIGNED,
-    FLOATING_POINT
+    FLOATING_POINT,
+    FLOATING_POINT_32
   };
   union InternalNumber {
     InternalNumber();
     ~InternalNumber();
     double mFloat;
+    float mFloat32;
     std::uint64_t mUnsigned;
     std::int64_t mSigned;
   };
   NumberType mNumberType{UNINITIALIZED};
-  InternalNumber mInternalNumber{};
+  mutable bool mPending{false};
+  mutable InternalNumber mInternalNumber{};
+  // Source text of a lazily parsed number, printed back verbatim.
+  std::string_view mText;
 };
 
 struct True {
   static void parse(Context &ctx, True &out);
-  void print(std::string &out, PrintContext &ctx) const;
 };
 
 struct False {
   static void parse(Context &ctx, False &out);
-  void print(std::string &out, PrintContext &ctx) const;
 };
 
 struct Null {
   static void parse(Context &ctx, Null &out);
-  void print(std::string &out, PrintContext &ctx) const;
 };
 
 struct Value {
   static void parse(Context &ctx, Value &out);
-  void print(std::string &out, PrintContext &ctx) const;
   const Value &getMemberValue(std::string_view name) const;
   const std::uint64_t &getUnsigned() const;
   const std::int64_t &getSigned() const;
   const double &getFloatingPoint() const;
+  const float &getFloat32() const;
+  // Any number; integers are converted, so "12" reads like "12.0".
+  double getAsFloatingPoint() const;
+  float getAsFloat32() const;
   const std::vector<std::unique_ptr<Value>> &getArray() const;
 
   Value() {}
@@ -121,6 +141,24 @@ struct Value {
   InternalValue mInternalValue{};
 };
 
-void parse(std::string_view input, Value &json);
+struct ValidationResult {
+  bool mValid = true;
+  std::string_view mErrorMessage;
+  std::uint64_t mOffset = 0;
+  std::uint64_t mLine = 0;
+  std::uint64_t mColumn = 0;
+};
+
+void skipWhiteSpace(Context &ctx);
+// Checks UTF-8 encoding, bracket balance and grammar without building any
+// nodes. Stricter than parse: only whitespace may follow the top level value.
+// Nesting is limited to DEFAULT_MAX_DEPTH, as in parse.
+ValidationResult validate(std::string_view input);
+void parse(std::string_view input, Value &json,
+           const ParseOptions &options = {});
+// Converts every pending number of a lazily parsed tree in one flat pass, so
+// the tree can then be read from several threads at once.
+void materializeAll(const Value &json);
+// Pretty prints into `out`; see Serializer for streaming into other sinks.
 void print(std::string &out, Value &json);
 } // namespace json_parser
@@ -0,0 +1,272 @@
+#pragma once
+
+#include "json_parser.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace json_parser {
+
+enum class Layout : std::uint8_t { MINIFIED, PRETTY };
+
+// Appends to a std::string; any type with printSv(std::string_view), such as
+// CliUtils::IoBufferedWriter, can be used as a sink instead.
+struct StringSink {
+  void printSv(std::string_view text) { mOut->append(text); }
+  std::string *mOut;
+};
+
+// Streams JSON into a sink without building the text in memory. Memory use
+// depends only on the nesting depth. The pretty layout is the one print has
+// always produced, byte for byte.
+//
+// Values from the parser keep their escaped source text, so the DOM is
+// written verbatim, and so are numbers parsed with mLazyNumbers; string() and
+// key() escape raw text for callers that emit documents event by event.
+template <typename Sink> class Serializer {
+public:
+  explicit Serializer(Sink &sink, Layout layout = Layout::PRETTY,
+                      std::uint32_t indentationSpaces = 2)
+      : mSink{&sink}, mLayout{layout}, mIndentationSpaces{indentationSpaces} {
+  }
+
+  void value(const Value &json) {
+    switch (json.mValueType) {
+    case Value::OBJECT: {
+      beginObject();
+      for (const auto &member : json.mInternalValue.mObject.mMembers) {
+        rawKey(member.mName.mValue);
+        if (member.mElement)
+          value(*member.mElement);
+        else
+          uninitialized();
+      }
+      endObject();
+    } break;
+    case Value::ARRAY: {
+      beginArray();
+      for (const auto &element : json.mInternalValue.mArray.mElements) {
+        if (element)
+          value(*element);
+        else
+          uninitialized();
+      }
+      endArray();
+    } break;
+    case Value::STRING: {
+      rawString(json.mInternalValue.mString.mValue);
+    } break;
+    case Value::NUMBER: {
+      number(json.mInternalValue.mNumber);
+    } break;
+    case Value::TRUE: {
+      literal("true");
+    } break;
+    case Value::FALSE: {
+      literal("false");
+    } break;
+    case Value::JSON_NULL: {
+      literal("null");
+    } break;
+    case Value::UNINITIALIZED:
+    default: {
+      uninitialized();
+    } break;
+    }
+  }
+
+  void beginObject() { open('{'); }
+  void endObject() { close('}'); }
+  void beginArray() { open('['); }
+  void endArray() { close(']'); }
+
+  // Member name of the next value.
+  void key(std::string_view text) {
+    element();
+    mSink->printSv("\"");
+    escaped(text);
+    keySeparator();
+  }
+  void rawKey(std::string_view escapedText) {
+    element();
+    mSink->printSv("\"");
+    mSink->printSv(escapedText);
+    keySeparator();
+  }
+
+  void string(std::string_view text) {
+    element();
+    mSink->printSv("\"");
+    escaped(text);
+    mSink->printSv("\"");
+  }
+  void rawString(std::string_view escapedText) {
+    element();
+    mSink->printSv("\"");
+    mSink->printSv(escapedText);
+    mSink->printSv("\"");
+  }
+
+  template <typename T, typename... FmtArgs>
+  void number(T value, FmtArgs... fmtArgs) {
+    // Wide enough for any fixed format double with 16 decimals.
+    std::array<char, 352> buffer;
+    auto [ptr, ec] = std::to_chars(
+        buffer.data(), buffer.data() + buffer.size(), value, fmtArgs...);
+    element();
+    mSink->printSv(std::string_view(buffer.data(), ptr));
+  }
+
+  void number(const Number &value) {
+    if (!value.mText.empty()) {
+      literal(value.mText);
+      return;
+    }
+    switch (value.mNumberType) {
+    case Number::UNSIGNED: {
+      number(value.mInternalNumber.mUnsigned);
+    } break;
+    case Number::SIGNED: {
+      number(value.mInternalNumber.mSigned);
+    } break;
+    case Number::FLOATING_POINT: {
+      number(value.mInternalNumber.mFloat, std::chars_format::fixed, 16);
+    } break;
+    case Number::FLOATING_POINT_32: {
+      number(value.mInternalNumber.mFloat32, std::chars_format::fixed, 16);
+    } break;
+    case Number::UNINITIALIZED:
+    default: {
+      element();
+    } break;
+    }
+  }
+
+  void boolean(bool value) { literal(value ? "true" : "false"); }
+  void null() { literal("null"); }
+
+private:
+  static constexpr std::string_view SPACES =
+      "                                                                "
+      "                                                                ";
+
+  struct Level {
+    bool mHasElements;
+    bool mAfterKey;
+  };
+
+  void literal(std::string_view text) {
+    element();
+    mSink->printSv(text);
+  }
+
+  void uninitialized() { literal("uninitialized"); }
+
+  void indent() {
+    for (auto remaining = mIndentation; remaining > 0;) {
+      const auto chunk = std::min<std::size_t>(remaining, SPACES.size());
+      mSink->printSv(SPACES.substr(0, chunk));
+      remaining -= chunk;
+    }
+  }
+
+  // Separator and indentation before a value or a member name.
+  void element() {
+    if (mLevels.empty())
+      return;
+    auto &level = mLevels.back();
+    if (level.mAfterKey) {
+      level.mAfterKey = false;
+      return;
+    }
+    if (level.mHasElements)
+      mSink->printSv(mLayout == Layout::PRETTY ? ",\n" : ",");
+    level.mHasElements = true;
+    if (mLayout == Layout::PRETTY)
+      indent();
+  }
+
+  void keySeparator() {
+    mSink->printSv(mLayout == Layout::PRETTY ? "\": " : "\":");
+    mLevels.back().mAfterKey = true;
+  }
+
+  void open(char bracket) {
+    element();
+    const char text[] = {bracket, '\n'};
+    mSink->printSv(
+        std::string_view(text, mLayout == Layout::PRETTY ? 2 : 1));
+    mLevels.push_back(Level{.mHasElements = false, .mAfterKey = false});
+    mIndentation += mIndentationSpaces;
+  }
+
+  void close(char bracket) {
+    const bool hadElements = mLevels.back().mHasElements;
+    mLevels.pop_back();
+    mIndentation -= mIndentationSpaces;
+    if (mLayout == Layout::PRETTY) {
+      if (hadElements)
+        mSink->printSv("\n");
+      indent();
+    }
+    mSink->printSv(std::string_view(&bracket, 1));
+  }
+
+  // Runs between characters that need escaping are found with the vector
+  // string scanner used by the parser.
+  void escaped(std::string_view text) {
+    constexpr char HEX[] = "0123456789abcdef";
+    while (!text.empty()) {
+      const auto plain =
+          mKernels->mFindStringSpecial(text.data(), text.size());
+      mSink->printSv(text.substr(0, plain));
+      if (plain == text.size())
+        return;
+      const auto c = static_cast<unsigned char>(text[plain]);
+      switch (c) {
+      case '"': {
+        mSink->printSv("\\\"");
+      } break;
+      case '\\': {
+        mSink->printSv("\\\\");
+      } break;
+      case '\b': {
+        mSink->printSv("\\b");
+      } break;
+      case '\f': {
+        mSink->printSv("\\f");
+      } break;
+      case '\n': {
+        mSink->printSv("\\n");
+      } break;
+      case '\r': {
+        mSink->printSv("\\r");
+      } break;
+      case '\t': {
+        mSink->printSv("\\t");
+      } break;
+      default: {
+        const char unicode[] = {'\\', 'u',         '0',
+                                '0',  HEX[c >> 4], HEX[c & 0xF]};
+        mSink->printSv(std::string_view(unicode, sizeof(unicode)));
+      } break;
+      }
+      text.remove_prefix(plain + 1);
+    }
+  }
+
+  Sink *mSink;
+  Layout mLayout;
+  std::uint32_t mIndentationSpaces;
+  std::uint64_t mIndentation{0};
+  std::vector<Level> mLevels;
+  const Haversine::CpuDispatch::KernelTable *mKernels =
+      &Haversine::CpuDispatch::kernels();
+};
+
+} // namespace json_parser
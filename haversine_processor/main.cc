@@ -1,15 +1,144 @@
+#include "aggregates.h"
+#include "alloc_profiler.h"
+#include "api.h"
+#include "checkpoint.h"
+#include "chunk_index.h"
 #include "cli_utils.h"
+#include "cpu_dispatch.h"
+#include "distance_matrix.h"
 #include "json_parser.h"
+#include "json_serializer.h"
+#include "large_buffer.h"
 #include "math_utils.h"
+#include "pair_generator.h"
+#include "perf_counters.h"
+#include "sampling.h"
+#include "spatial_index.h"
+#include "thread_pool.h"
+#include "timing_utils.h"
+#include "trace.h"
+#include <array>
 #include <cstring>
+#include <functional>
+#include <limits>
 
 extern "C" {
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 }
 
 namespace {
 constexpr ssize_t INITIAL_BUFFER_SIZE = ssize_t(4) * ssize_t(1024);
+constexpr std::size_t SYNTHETIC_BLOCK_PAIRS = 4096;
+// One chunk in this many is also run through referenceHaversine to measure
+// the error of --approx.
+constexpr std::uint64_t APPROX_CHECK_STRIDE = 16;
+
+constexpr std::string_view OPTIONS_HELP =
+    "Options:\n"
+    "  --index                             build/reuse the spatial index "
+    "sidecar (<filename>.hvsi)\n"
+    "  --query=minLon,minLat,maxLon,maxLat aggregate pairs with both "
+    "endpoints in the rectangle\n"
+    "  --f32[=tolerance]                   single precision pipeline, "
+    "checked against double (default 1e-6)\n"
+    "  --approx[=maxError]                 equirectangular approximation for "
+    "pairs short enough to\n"
+    "                                      stay within maxError relative "
+    "(default 1e-6)\n"
+    "  --aggregates=kind,...|all           also report count, min, max, "
+    "mean, variance,\n"
+    "                                      histogram, quantiles and/or top\n"
+    "  --buckets=N                         histogram buckets (default 16)\n"
+    "  --quantiles=q,...                   quantiles to report (default "
+    "0.5,0.9,0.99)\n"
+    "  --top=K                             longest pairs to report (default "
+    "10)\n"
+    "  --counters                          report hardware performance "
+    "counters per stage\n"
+    "  --trace=path                        record stages, tasks and chunks "
+    "per thread and write them\n"
+    "                                      as Chrome trace-event JSON at "
+    "exit\n"
+    "  --allocations                       count heap allocations per stage "
+    "and report peak memory\n"
+    "  --chunk-index                       parse chunks in parallel at the "
+    "offsets of the chunk index\n"
+    "                                      sidecar (<filename>.hvci), built "
+    "on first use\n"
+    "  --range=begin..end                  process only pairs [begin, end), "
+    "e.g. 1e8..2e8; either\n"
+    "                                      bound may be left out; implies "
+    "--chunk-index\n"
+    "  --incremental                       parse only pairs appended since "
+    "the checkpoint sidecar\n"
+    "                                      (<filename>.hvck) was written\n"
+    "  --matrix[=path]                     all-pairs distances between pair "
+    "endpoints, written to a raw\n"
+    "                                      row-major matrix file, or reduced "
+    "to row means and\n"
+    "                                      nearest neighbours\n"
+    "  --matrix-type=f64|f32               matrix element type (default "
+    "f64)\n"
+    "  --points=N                          use only the first N endpoints for "
+    "--matrix\n"
+    "  --matrix-rows=path                  write per-point means and nearest "
+    "neighbours\n"
+    "  --ndjson                            one pair object per line, parsed "
+    "in parallel; implied by\n"
+    "                                      a .ndjson filename\n"
+    "  --sample[=N|fraction]               estimate the mean from N pairs "
+    "(default 10000), or a fraction\n"
+    "                                      of them, read at random offsets\n"
+    "  --sample-error=relative             stop sampling once the 95% "
+    "interval is within this\n"
+    "                                      fraction of the mean (default cap "
+    "1000000 pairs)\n"
+    "  --validate-only                     check UTF-8 and JSON grammar "
+    "without parsing\n"
+    "  --huge-pages=off|thp|explicit       back the input buffer with huge "
+    "pages (default thp)\n"
+    "  --no-prefault                       leave the input buffer's page "
+    "faults to the reader\n"
+    "  --emit=path                         parse and write the document back "
+    "out (pretty), numbers as written\n"
+    "  --minify                            write --emit output without "
+    "whitespace\n"
+    "  --threads=N                         worker threads (default: one per "
+    "available CPU)\n"
+    "  --pin=none|cores|numa               pin workers to single CPUs or NUMA "
+    "nodes\n"
+    "  --synthetic=N                       generate N pairs in memory instead "
+    "of reading a file\n"
+    "                                      (filename may be omitted)\n"
+    "  --mode=uniform|cluster              synthetic pair layout (default "
+    "cluster)\n"
+    "  --seed=N                            random seed for --synthetic and "
+    "--sample (default 0)\n";
+
+struct MatrixOptions {
+  // Without a filename the matrix is reduced instead of stored.
+  std::optional<std::string_view> mFilename;
+  std::optional<std::string_view> mRowsFilename;
+  std::uint64_t mMaxPoints{std::numeric_limits<std::uint64_t>::max()};
+  bool mSinglePrecision{false};
+};
+
+// Pair ordinals [mBegin, mEnd) from "begin..end".
+struct PairRange {
+  static PairRange from(std::string_view rawText);
+
+  std::uint64_t mBegin{0};
+  std::uint64_t mEnd{std::numeric_limits<std::uint64_t>::max()};
+};
+
+struct AdaptiveTotals {
+  double mSum{0};
+  std::uint64_t mShortPairs{0};
+  std::uint64_t mCheckedPairs{0};
+  double mWorstRelativeError{0};
+};
 
 std::string getString(std::string_view txt) {
   return std::string(txt.data(), txt.size());
@@ -18,11 +147,746 @@ std::string getString(std::string_view txt) {
 std::string_view toStringView(const std::string &txt) {
   return std::string_view(txt);
 }
+
+struct FileContents {
+  std::string_view view() const {
+    return std::string_view(mBuffer.data(), mSize);
+  }
+
+  Haversine::LargeBuffer::Buffer mBuffer;
+  ssize_t mSize{0};
+  // Minor page faults taken by the reading thread.
+  std::uint64_t mReadFaults{0};
+};
+
+// Plain integers or integral values in floating point notation, like 1e8.
+std::uint64_t pairOrdinalFrom(std::string_view rawText) {
+  constexpr std::string_view ERROR_PREFIX = "Invalid range bound: ";
+  if (rawText.find_first_not_of("0123456789") == std::string_view::npos)
+    return Haversine::CliUtils::u64From(rawText, ERROR_PREFIX);
+  const auto value = Haversine::CliUtils::doubleFrom(rawText, ERROR_PREFIX);
+  if (!(value >= 0. && value < 0x1p64) || std::floor(value) != value)
+    throw std::runtime_error(std::string(ERROR_PREFIX) + std::string(rawText));
+  return std::uint64_t(value);
+}
+
+PairRange PairRange::from(std::string_view rawText) {
+  const auto separator = rawText.find("..");
+  if (separator == std::string_view::npos)
+    throw std::runtime_error("Invalid range: " + std::string(rawText));
+  PairRange result;
+  const auto begin = rawText.substr(0, separator);
+  const auto end = rawText.substr(separator + 2);
+  if (!begin.empty())
+    result.mBegin = pairOrdinalFrom(begin);
+  if (!end.empty())
+    result.mEnd = pairOrdinalFrom(end);
+  if (result.mBegin > result.mEnd)
+    throw std::runtime_error("Invalid range: " + std::string(rawText));
+  return result;
+}
+
+// Sized from fstat, with a byte to spare so that reaching the end of a
+// regular file takes no regrowth; pipes grow it by doubling.
+FileContents readWholeFile(const Haversine::CliUtils::FileHandle &inputFile,
+                           const Haversine::LargeBuffer::Options &options) {
+  using Haversine::LargeBuffer::Buffer;
+  const auto startFaults = Haversine::LargeBuffer::threadMinorFaults();
+  struct stat info {};
+  ssize_t bufferSize = INITIAL_BUFFER_SIZE;
+  if (::fstat(inputFile.mFileDescriptor, &info) == 0)
+    bufferSize = std::max<ssize_t>(bufferSize, ssize_t(info.st_size) + 1);
+  auto buffer = Buffer::allocate(std::size_t(bufferSize), options);
+  bufferSize = ssize_t(buffer.size());
+  ssize_t readIndex = 0;
+  while (true) {
+    auto nextReadSize = bufferSize - readIndex;
+    if (nextReadSize == 0) {
+      auto newBuffer = Buffer::allocate(std::size_t(bufferSize) * 2, options);
+      std::memcpy(newBuffer.data(), buffer.data(), bufferSize);
+      std::swap(buffer, newBuffer);
+      bufferSize = ssize_t(buffer.size());
+      nextReadSize = bufferSize - readIndex;
+    }
+    auto bytesRead = ::read(inputFile.mFileDescriptor,
+                            buffer.data() + readIndex, nextReadSize);
+
+    if (bytesRead < 0)
+      throw std::runtime_error("Unable to read input file");
+
+    if (bytesRead == 0)
+      break;
+
+    readIndex += bytesRead;
+  }
+  const auto readFaults =
+      Haversine::LargeBuffer::threadMinorFaults() - startFaults;
+  return FileContents{.mBuffer = std::move(buffer),
+                      .mSize = readIndex,
+                      .mReadFaults = readFaults};
+}
+
+// Mean distance with short pairs on the equirectangular path. `distances`
+// is either empty or receives every distance.
+AdaptiveTotals
+computeAdaptive(Haversine::ThreadPool::Pool &pool,
+                const Haversine::MathUtils::CoordinatePairs<double> &pairs,
+                double maxSpan, std::span<double> distances) {
+  using namespace Haversine::MathUtils;
+  const auto sumCoeficient = pairs.size() ? (1. / double(pairs.size())) : 0.;
+  return pool.parallelReduce(
+      0, pairs.size(), SUM_CHUNK_PAIRS, AdaptiveTotals{},
+      [&](std::uint64_t chunkBegin, std::uint64_t chunkEnd) {
+        const auto count = chunkEnd - chunkBegin;
+        std::array<double, SUM_CHUNK_PAIRS> buffer;
+        const auto out = distances.empty()
+                             ? std::span<double>(buffer).first(count)
+                             : distances.subspan(chunkBegin, count);
+        auto coordinates = [&](const std::vector<double> &values) {
+          return std::span<const double>(values).subspan(chunkBegin, count);
+        };
+        AdaptiveTotals partial;
+        partial.mShortPairs = haversineAdaptiveBatch(
+            coordinates(pairs.mX0), coordinates(pairs.mY0),
+            coordinates(pairs.mX1), coordinates(pairs.mY1), out, maxSpan);
+        for (auto distance : out)
+          partial.mSum += sumCoeficient * distance;
+        if ((chunkBegin / SUM_CHUNK_PAIRS) % APPROX_CHECK_STRIDE != 0)
+          return partial;
+        partial.mCheckedPairs = count;
+        for (std::uint64_t i = 0; i < count; ++i) {
+          const auto pair = chunkBegin + i;
+          const auto reference =
+              referenceHaversine(pairs.mX0[pair], pairs.mY0[pair],
+                                 pairs.mX1[pair], pairs.mY1[pair]);
+          if (reference > 0.) {
+            partial.mWorstRelativeError =
+                std::max(partial.mWorstRelativeError,
+                         std::abs(out[i] - reference) / reference);
+          }
+        }
+        return partial;
+      },
+      [](AdaptiveTotals total, const AdaptiveTotals &partial) {
+        total.mSum += partial.mSum;
+        total.mShortPairs += partial.mShortPairs;
+        total.mCheckedPairs += partial.mCheckedPairs;
+        total.mWorstRelativeError =
+            std::max(total.mWorstRelativeError, partial.mWorstRelativeError);
+        return total;
+      });
+}
+
+void printKernelSelection(Haversine::CliUtils::IoBufferedWriter &out) {
+  namespace CpuDispatch = Haversine::CpuDispatch;
+  const auto &selection = CpuDispatch::selection();
+  out.printSv("Kernel variant: ");
+  out.printSv(CpuDispatch::isaToStrView(selection.mSelected));
+  out.printSv(" (detected ");
+  out.printSv(CpuDispatch::isaToStrView(selection.mDetected));
+  if (selection.mForcedUnsupported) {
+    out.printSv(", requested ");
+    out.printSv(CpuDispatch::ISA_ENVIRONMENT_VARIABLE);
+    out.printSv(" variant is not supported");
+  } else if (selection.mForced) {
+    out.printSv(", forced by ");
+    out.printSv(CpuDispatch::ISA_ENVIRONMENT_VARIABLE);
+  }
+  out.printSv(")\n");
+}
+
+void printMicroseconds(Haversine::CliUtils::IoBufferedWriter &out,
+                       std::uint64_t osTicks) {
+  out.printNumber(Haversine::TimingUtils::secondsFromOsTicks(osTicks) * 1e6,
+                  std::chars_format::fixed, 3);
+  out.printSv(" us");
+}
+
+// Faults with 4 KiB pages are what the reader would have taken on its own;
+// the prefault time is the part of that moved to the helper thread.
+void printBufferReport(Haversine::CliUtils::IoBufferedWriter &out,
+                       FileContents &contents) {
+  using namespace Haversine::LargeBuffer;
+  const auto &stats = contents.mBuffer.stats();
+  out.printSv("Input buffer: ");
+  out.printNumber(contents.mBuffer.size());
+  out.printSv(" bytes, ");
+  out.printSv(hugePagesToStrView(stats.mHugePages));
+  out.printSv(", ");
+  out.printNumber(contents.mReadFaults);
+  out.printSv(" page faults while reading (");
+  out.printNumber((std::uint64_t(contents.mSize) + SMALL_PAGE_SIZE - 1) /
+                  SMALL_PAGE_SIZE);
+  out.printSv(" with 4 KiB pages)");
+  if (stats.mReused) {
+    out.printSv(", reused");
+  } else if (stats.mPrefaultOsTicks) {
+    out.printSv(", prefaulted on a helper thread in ");
+    printMicroseconds(out, stats.mPrefaultOsTicks);
+    out.printSv(" with ");
+    out.printNumber(stats.mPrefaultFaults);
+    out.printSv(" faults");
+  }
+  out.printSv("\n\n");
+}
+
+// Feeds generated pairs straight into the distance and reduction stages, so
+// the reported throughput excludes storage and parsing.
+int runSynthetic(Haversine::CliUtils::IoBufferedWriter &out,
+                 Haversine::PerfCounters::StageProfiler &profiler,
+                 Haversine::ThreadPool::Pool &pool,
+                 Haversine::CliUtils::Mode mode, std::uint64_t seed,
+                 std::uint64_t pairCount) {
+  using namespace Haversine::MathUtils;
+  using namespace Haversine::TimingUtils;
+  const auto cpuTimerFreq = estimateCpuTimerFreq();
+
+  Haversine::PairGenerator::Generator generator{mode, seed, pairCount};
+  CoordinatePairs<double> block;
+  block.reserve(SYNTHETIC_BLOCK_PAIRS);
+  const auto sumCoeficient = pairCount ? (1. / double(pairCount)) : 0.;
+  double sum = 0;
+  std::uint64_t generateTicks = 0;
+  std::uint64_t computeTicks = 0;
+  std::uint64_t computeCycles = 0;
+  for (std::uint64_t blockStart = 0; blockStart < pairCount;
+       blockStart += SYNTHETIC_BLOCK_PAIRS) {
+    const auto count = std::min<std::uint64_t>(SYNTHETIC_BLOCK_PAIRS,
+                                               pairCount - blockStart);
+    profiler.begin("generate");
+    const auto generateStart = readOsTimer();
+    generator.next(block, count);
+    generateTicks += readOsTimer() - generateStart;
+    profiler.end();
+
+    profiler.begin("compute");
+    const auto computeStart = readOsTimer();
+    const auto computeStartCycles = readCpuTimer();
+    sum = pool.parallelReduce(
+        0, block.size(), SUM_CHUNK_PAIRS, sum,
+        [&](std::uint64_t chunkBegin, std::uint64_t chunkEnd) {
+          double partial = 0;
+          for (auto i = chunkBegin; i < chunkEnd; ++i) {
+            partial += sumCoeficient *
+                       referenceHaversine(block.mX0[i], block.mY0[i],
+                                          block.mX1[i], block.mY1[i]);
+          }
+          return partial;
+        },
+        std::plus<>{});
+    computeCycles += readCpuTimer() - computeStartCycles;
+    computeTicks += readOsTimer() - computeStart;
+    profiler.end();
+  }
+
+  auto printThroughput = [&](std::string_view name, std::uint64_t osTicks,
+                             double cycles) {
+    const auto seconds = secondsFromOsTicks(osTicks);
+    out.printSv(name);
+    out.printNumber(seconds > 0. ? double(pairCount) / seconds : 0.,
+                    std::chars_format::fixed, 0);
+    out.printSv(" pairs/s, ");
+    out.printNumber(pairCount ? cycles / double(pairCount) : 0.,
+                    std::chars_format::fixed, 2);
+    out.printSv(" cycles/pair\n");
+  };
+
+  out.printSv("Pair count: ");
+  out.printNumber(pairCount);
+  out.printSv("\nExpected sum: ");
+  out.printNumber(sum, std::chars_format::fixed, 16);
+  out.printSv("\n\nSynthetic ");
+  out.printSv(Haversine::CliUtils::modeToStrView(mode));
+  out.printSv(" pairs, seed ");
+  out.printNumber(seed);
+  out.printSv(" (cycles from the timestamp counter at ");
+  out.printNumber(double(cpuTimerFreq) / 1e9, std::chars_format::fixed, 3);
+  out.printSv(" GHz)\n");
+  printThroughput("Generate: ", generateTicks,
+                  double(generateTicks) * double(cpuTimerFreq) /
+                      double(getOsTimerFreq()));
+  printThroughput("Compute: ", computeTicks, double(computeCycles));
+  out.printSv("\n");
+  out.flush();
+  profiler.report(out, 0, pairCount);
+  if (profiler.countersEnabled())
+    pool.printStats(out);
+  return 0;
+}
+
+// Parses only what was appended since the last checkpoint when the prefix it
+// was taken on is unchanged, and falls back to the whole file otherwise.
+int runIncremental(Haversine::CliUtils::IoBufferedWriter &out,
+                   Haversine::PerfCounters::StageProfiler &profiler,
+                   Haversine::ThreadPool::Pool &pool,
+                   const std::string &filename,
+                   const Haversine::CliUtils::FileHandle &inputFile) {
+  using namespace Haversine::Checkpoint;
+  using namespace Haversine::MathUtils;
+  const auto fileDescriptor = inputFile.mFileDescriptor;
+  const auto identity =
+      Haversine::SpatialIndex::FileIdentity::of(fileDescriptor);
+  const auto checkpointFilename = filename + ".hvck";
+
+  profiler.begin("read");
+  auto checkpoint = Checkpoint::load(checkpointFilename);
+  std::string_view fullRunReason;
+  if (!checkpoint) {
+    fullRunReason = "no checkpoint";
+  } else if (!checkpoint->matches(fileDescriptor, identity)) {
+    fullRunReason = "prefix changed";
+    checkpoint.reset();
+  }
+  std::uint64_t bodyOffset = 0;
+  const auto text =
+      checkpoint
+          ? checkpoint->appendedDocument(fileDescriptor, identity, bodyOffset)
+          : Checkpoint::readRange(fileDescriptor, 0, identity.mSize);
+  profiler.end();
+
+  profiler.begin("parse");
+  auto json = json_parser::Value{};
+  json_parser::parse(text, json);
+  const auto pairs = Haversine::Api::pairsOf<double>(json);
+  const auto layout = PairsLayout::of(text);
+  profiler.end();
+
+  profiler.begin("compute");
+  std::vector<double> distances(pairs.size());
+  Haversine::Api::meanDistance(Haversine::Api::PairSpans::of(pairs), distances,
+                               {.mPool = &pool});
+  auto next = checkpoint.value_or(Checkpoint{});
+  for (auto distance : distances)
+    next.mSum.add(distance);
+  next.mPairCount += pairs.size();
+  profiler.end();
+
+  profiler.begin("output");
+  if (layout) {
+    if (!checkpoint) {
+      next.mLayout = *layout;
+    } else if (pairs.size() != 0) {
+      next.mLayout.mResumeOffset =
+          layout->mResumeOffset - layout->mArrayOffset + bodyOffset;
+    }
+    next.mSource = identity;
+    next.mPrefixHash =
+        Checkpoint::prefixHash(fileDescriptor, next.mLayout.mResumeOffset);
+    next.save(checkpointFilename);
+  }
+
+  out.printSv("Pair count: ");
+  out.printNumber(next.mPairCount);
+  out.printSv("\nExpected sum: ");
+  out.printNumber(next.mPairCount ? next.mSum.value() / double(next.mPairCount)
+                                  : 0.,
+                  std::chars_format::fixed, 16);
+  out.printSv("\n\nCheckpoint: ");
+  if (checkpoint) {
+    out.printSv("resumed at byte ");
+    out.printNumber(checkpoint->mLayout.mResumeOffset);
+  } else {
+    out.printSv("full run (");
+    out.printSv(fullRunReason);
+    out.printSv(")");
+  }
+  out.printSv(", parsed ");
+  out.printNumber(pairs.size());
+  out.printSv(" pairs from ");
+  out.printNumber(text.size());
+  out.printSv(" bytes\n");
+  if (layout) {
+    out.printSv("Checkpoint saved to ");
+    out.printSv(checkpointFilename);
+  } else {
+    out.printSv("Checkpoint not saved: the pairs array does not end the "
+                "document");
+  }
+  out.printSv("\n\n");
+  out.flush();
+  profiler.end();
+  profiler.report(out, text.size(), pairs.size());
+  return 0;
+}
+
+// A document without a root "pairs" array cannot be split into chunks, so it
+// is parsed whole and the range is taken from its pairs.
+int runUnindexed(Haversine::CliUtils::IoBufferedWriter &out,
+                 Haversine::PerfCounters::StageProfiler &profiler,
+                 Haversine::ThreadPool::Pool &pool, std::string_view contents,
+                 const PairRange &range) {
+  profiler.begin("parse");
+  const auto all = Haversine::Api::pairsFromJson(contents);
+  const auto pairCount = std::uint64_t(all.size());
+  const auto begin = range.mBegin;
+  const auto end = std::min(range.mEnd, pairCount);
+  if (begin > end) {
+    out.printSv("Range starts past the last of ");
+    out.printNumber(pairCount);
+    out.printSv(" pairs\n");
+    return 1;
+  }
+  Haversine::MathUtils::CoordinatePairs<double> pairs;
+  pairs.reserve(end - begin);
+  for (auto i = begin; i < end; ++i)
+    pairs.push(all.mX0[i], all.mY0[i], all.mX1[i], all.mY1[i]);
+  profiler.end();
+
+  profiler.begin("compute");
+  const auto sum = Haversine::Api::meanDistance(
+      Haversine::Api::PairSpans::of(pairs), {}, {.mPool = &pool});
+  profiler.end();
+
+  profiler.begin("output");
+  out.printSv("Pair count: ");
+  out.printNumber(pairs.size());
+  out.printSv("\nExpected sum: ");
+  out.printNumber(sum, std::chars_format::fixed, 16);
+  out.printSv("\n\nChunk index: not built, no \"pairs\" array in the root "
+              "object to split\nRange: pairs ");
+  out.printNumber(begin);
+  out.printSv("..");
+  out.printNumber(end);
+  out.printSv(" of ");
+  out.printNumber(pairCount);
+  out.printSv(", whole document parsed\n\n");
+  out.flush();
+  profiler.end();
+  profiler.report(out, contents.size(), pairs.size());
+  return 0;
+}
+
+// Parses the chunks that hold `range` in parallel, each from the offsets in
+// the chunk index sidecar. Without a valid sidecar the file is read and
+// scanned once to build it, and chunks are taken from memory.
+int runChunked(Haversine::CliUtils::IoBufferedWriter &out,
+               Haversine::PerfCounters::StageProfiler &profiler,
+               Haversine::ThreadPool::Pool &pool, const std::string &filename,
+               const Haversine::CliUtils::FileHandle &inputFile,
+               const PairRange &range) {
+  using namespace Haversine::ChunkIndex;
+  using Haversine::Checkpoint::Checkpoint;
+  const auto fileDescriptor = inputFile.mFileDescriptor;
+  const auto identity = Haversine::CliUtils::FileIdentity::of(fileDescriptor);
+  const auto indexFilename = filename + ".hvci";
+
+  profiler.begin("index");
+  auto index = Index::load(indexFilename, identity);
+  const bool indexLoaded = index.has_value();
+  std::string contents;
+  if (!indexLoaded) {
+    contents = Checkpoint::readRange(fileDescriptor, 0, identity.mSize);
+    index = Index::scan(contents);
+    if (!index) {
+      profiler.end();
+      return runUnindexed(out, profiler, pool, contents, range);
+    }
+    index->save(indexFilename, identity);
+  }
+  profiler.end();
+
+  const auto pairCount = index->pairCount();
+  const auto begin = range.mBegin;
+  const auto end = std::min(range.mEnd, pairCount);
+  if (begin > end) {
+    out.printSv("Range starts past the last of ");
+    out.printNumber(pairCount);
+    out.printSv(" pairs\n");
+    return 1;
+  }
+  const auto [firstChunk, lastChunk] = index->chunksOf(begin, end);
+
+  profiler.begin("parse");
+  Haversine::MathUtils::CoordinatePairs<double> pairs;
+  pairs.resize(end - begin);
+  // Tasks must not throw; the first error of every chunk is kept instead.
+  std::vector<std::string> errors(lastChunk - firstChunk);
+  pool.parallelFor(
+      firstChunk, lastChunk, 1, [&](std::uint64_t chunk, std::uint64_t) {
+        const auto &entry = index->mEntries[chunk];
+        const auto &next = index->mEntries[chunk + 1];
+        try {
+          const auto size = next.mOffset - entry.mOffset;
+          Haversine::Trace::begin("read chunk", chunk);
+          const auto bytes =
+              indexLoaded
+                  ? Checkpoint::readRange(fileDescriptor, entry.mOffset, size)
+                  : std::string();
+          Haversine::Trace::end();
+          Haversine::Trace::Scope parseScope{"parse chunk", chunk};
+          const auto chunkBytes =
+              indexLoaded
+                  ? std::string_view(bytes)
+                  : std::string_view(contents).substr(entry.mOffset, size);
+          const auto document = chunkDocument(chunkBytes);
+          auto json = json_parser::Value{};
+          json_parser::parse(document, json);
+          const auto chunkPairs = Haversine::Api::pairsOf<double>(json);
+          if (chunkPairs.size() != next.mOrdinal - entry.mOrdinal)
+            throw std::runtime_error("Chunk index does not match the input");
+          const auto from = std::max(begin, entry.mOrdinal);
+          const auto to = std::min(end, next.mOrdinal);
+          for (auto i = from; i < to; ++i) {
+            const auto j = i - entry.mOrdinal;
+            pairs.mX0[i - begin] = chunkPairs.mX0[j];
+            pairs.mY0[i - begin] = chunkPairs.mY0[j];
+            pairs.mX1[i - begin] = chunkPairs.mX1[j];
+            pairs.mY1[i - begin] = chunkPairs.mY1[j];
+          }
+        } catch (const std::exception &e) {
+          errors[chunk - firstChunk] = e.what();
+        }
+      });
+  profiler.end();
+  for (std::size_t i = 0; i < errors.size(); ++i) {
+    if (errors[i].empty())
+      continue;
+    out.printSv("Chunk ");
+    out.printNumber(firstChunk + i);
+    out.printSv(": ");
+    out.printSv(errors[i]);
+    out.printSv("\n");
+    return 1;
+  }
+
+  profiler.begin("compute");
+  const auto sum = Haversine::Api::meanDistance(
+      Haversine::Api::PairSpans::of(pairs), {}, {.mPool = &pool});
+  profiler.end();
+
+  profiler.begin("output");
+  const auto bytesRead =
+      indexLoaded ? index->mEntries[lastChunk].mOffset -
+                        index->mEntries[firstChunk].mOffset
+                  : identity.mSize;
+  out.printSv("Pair count: ");
+  out.printNumber(pairs.size());
+  out.printSv("\nExpected sum: ");
+  out.printNumber(sum, std::chars_format::fixed, 16);
+  out.printSv("\n\nChunk index: ");
+  out.printSv(indexLoaded ? "loaded from " : "built into ");
+  out.printSv(indexFilename);
+  out.printSv(", ");
+  out.printNumber(index->chunkCount());
+  out.printSv(" chunks of ");
+  out.printNumber(index->mStride);
+  out.printSv(" pairs\nRange: pairs ");
+  out.printNumber(begin);
+  out.printSv("..");
+  out.printNumber(end);
+  out.printSv(" of ");
+  out.printNumber(pairCount);
+  out.printSv(", chunks ");
+  out.printNumber(firstChunk);
+  out.printSv("..");
+  out.printNumber(lastChunk);
+  out.printSv(", ");
+  out.printNumber(bytesRead);
+  out.printSv(" bytes read\n\n");
+  out.flush();
+  profiler.end();
+  profiler.report(out, bytesRead, pairs.size());
+  if (profiler.countersEnabled())
+    pool.printStats(out);
+  return 0;
+}
+
+// Estimates the mean from pairs read at random offsets; only the bytes
+// around each seek are read.
+int runSampled(Haversine::CliUtils::IoBufferedWriter &out,
+               Haversine::PerfCounters::StageProfiler &profiler,
+               Haversine::ThreadPool::Pool &pool,
+               const Haversine::CliUtils::FileHandle &inputFile,
+               const Haversine::Sampling::Options &sampling) {
+  struct stat info {};
+  if (::fstat(inputFile.mFileDescriptor, &info) != 0 ||
+      !S_ISREG(info.st_mode)) {
+    out.printSv("--sample needs a regular file to seek in\n");
+    return 1;
+  }
+  const auto fileSize = std::uint64_t(info.st_size);
+
+  profiler.begin("sample");
+  const auto estimate = Haversine::Sampling::estimate(
+      inputFile.mFileDescriptor, fileSize, sampling, pool);
+  profiler.end();
+
+  profiler.begin("output");
+  const auto halfWidth = estimate.halfWidth();
+  out.printSv("Sampled pairs: ");
+  out.printNumber(estimate.mSamples);
+  out.printSv(" of about ");
+  out.printNumber(estimate.mEstimatedPairs);
+  out.printSv("\nEstimated mean: ");
+  out.printNumber(estimate.mMean, std::chars_format::fixed, 6);
+  out.printSv(" +/- ");
+  out.printNumber(halfWidth, std::chars_format::fixed, 6);
+  out.printSv(" (95% confidence, ");
+  out.printNumber(estimate.mMean > 0. ? halfWidth / estimate.mMean * 100. : 0.,
+                  std::chars_format::fixed, 3);
+  out.printSv("%)\nSeeks: ");
+  out.printNumber(estimate.mSeeks);
+  out.printSv(", ");
+  out.printNumber(estimate.mMisses);
+  out.printSv(" without a pair, ");
+  out.printNumber(estimate.mBytesRead);
+  out.printSv(" bytes read (");
+  out.printNumber(fileSize ? double(estimate.mBytesRead) / double(fileSize) *
+                                 100.
+                           : 0.,
+                  std::chars_format::fixed, 3);
+  out.printSv("% of ");
+  out.printNumber(fileSize);
+  out.printSv(")\n");
+  if (sampling.mTargetError) {
+    out.printSv("Target error ");
+    out.printNumber(*sampling.mTargetError, std::chars_format::scientific, 1);
+    out.printSv(estimate.mTargetReached ? " reached\n" : " not reached\n");
+  }
+  out.printSv("\n");
+  out.flush();
+  profiler.end();
+  profiler.report(out, estimate.mBytesRead, estimate.mSamples);
+  if (profiler.countersEnabled())
+    pool.printStats(out);
+  return 0;
+}
+
+// Distances between every two endpoints of the input pairs, computed a tile
+// at a time so that both point blocks stay in cache.
+template <typename T>
+int runMatrix(Haversine::CliUtils::IoBufferedWriter &out,
+              Haversine::PerfCounters::StageProfiler &profiler,
+              Haversine::ThreadPool::Pool &pool,
+              const Haversine::MathUtils::CoordinatePairs<double> &pairs,
+              const MatrixOptions &matrix, std::uint64_t inputBytes) {
+  namespace DistanceMatrix = Haversine::DistanceMatrix;
+  using namespace Haversine::TimingUtils;
+
+  profiler.begin("points");
+  const auto count = std::min<std::uint64_t>(2 * pairs.size(),
+                                             matrix.mMaxPoints);
+  std::vector<double> lons(count);
+  std::vector<double> lats(count);
+  for (std::uint64_t i = 0; i < count; ++i) {
+    const auto pair = i / 2;
+    lons[i] = i % 2 ? pairs.mX1[pair] : pairs.mX0[pair];
+    lats[i] = i % 2 ? pairs.mY1[pair] : pairs.mY0[pair];
+  }
+  const auto points = DistanceMatrix::Points<T>::from(lons, lats);
+  profiler.end();
+
+  profiler.begin("matrix");
+  const auto matrixStart = readOsTimer();
+  std::optional<DistanceMatrix::RowReductions> rows;
+  std::uint64_t matrixBytes = 0;
+  if (matrix.mFilename) {
+    DistanceMatrix::MatrixFile file{*matrix.mFilename, count, sizeof(T)};
+    DistanceMatrix::forEachTile(
+        pool, points,
+        [&](const DistanceMatrix::Tile<T> &tile) { file.store(tile); });
+    matrixBytes = file.bytes();
+  } else {
+    rows = DistanceMatrix::reduceRows(pool, points);
+  }
+  const auto matrixTicks = readOsTimer() - matrixStart;
+  profiler.end();
+
+  profiler.begin("output");
+  out.printSv("Point count: ");
+  out.printNumber(count);
+  out.printSv(" (endpoints of ");
+  out.printNumber(pairs.size());
+  out.printSv(" pairs)\n");
+  if (matrix.mFilename) {
+    out.printSv("Wrote ");
+    out.printNumber(count);
+    out.printSv(" x ");
+    out.printNumber(count);
+    out.printSv(std::is_same_v<T, float> ? " f32" : " f64");
+    out.printSv(" matrix to ");
+    out.printSv(*matrix.mFilename);
+    out.printSv(" (");
+    out.printNumber(matrixBytes);
+    out.printSv(" bytes)\n");
+  } else {
+    double meanSum = 0;
+    double nearestSum = 0;
+    std::uint64_t isolated = 0;
+    for (std::uint64_t i = 0; i < count; ++i) {
+      meanSum += rows->mMeans[i];
+      nearestSum += rows->mNearest[i];
+      if (rows->mNearest[i] > rows->mNearest[isolated])
+        isolated = i;
+    }
+    out.printSv("Mean distance: ");
+    out.printNumber(count ? meanSum / double(count) : 0.,
+                    std::chars_format::fixed, 6);
+    if (count > 1) {
+      out.printSv("\nMean nearest-neighbour distance: ");
+      out.printNumber(nearestSum / double(count), std::chars_format::fixed, 6);
+      out.printSv("\nMost isolated point: ");
+      out.printNumber(isolated);
+      out.printSv(" (nearest is point ");
+      out.printNumber(rows->mNearestIndex[isolated]);
+      out.printSv(" at ");
+      out.printNumber(rows->mNearest[isolated], std::chars_format::fixed, 6);
+      out.printSv(")");
+    }
+    out.printSv("\n");
+    if (matrix.mRowsFilename) {
+      auto rowsFile = Haversine::CliUtils::FileHandle::open(
+          *matrix.mRowsFilename, O_WRONLY | O_CREAT | O_TRUNC,
+          S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+      Haversine::CliUtils::IoBufferedWriter rowsWriter(rowsFile);
+      for (std::uint64_t i = 0; i < count; ++i) {
+        rowsWriter.printNumber(i);
+        rowsWriter.printSv(" ");
+        rowsWriter.printNumber(rows->mMeans[i], std::chars_format::fixed, 6);
+        rowsWriter.printSv(" ");
+        rowsWriter.printNumber(rows->mNearestIndex[i]);
+        rowsWriter.printSv(" ");
+        rowsWriter.printNumber(rows->mNearest[i], std::chars_format::fixed, 6);
+        rowsWriter.printSv("\n");
+      }
+      rowsWriter.flush();
+    }
+  }
+
+  // Each unordered pair counts once, as symmetry lets it be computed once.
+  const auto distances = double(count) * double(count ? count - 1 : 0) / 2.;
+  const auto seconds = secondsFromOsTicks(matrixTicks);
+  out.printSv("Matrix: ");
+  out.printNumber(distances, std::chars_format::fixed, 0);
+  out.printSv(" distances in ");
+  printMicroseconds(out, matrixTicks);
+  out.printSv(" (");
+  out.printNumber(seconds > 0. ? distances / seconds / 1e6 : 0.,
+                  std::chars_format::fixed, 3);
+  out.printSv(" M distances/s, ");
+  out.printNumber(seconds > 0. ? distances *
+                                     DistanceMatrix::FLOPS_PER_DISTANCE /
+                                     seconds / 1e9
+                              : 0.,
+                  std::chars_format::fixed, 3);
+  out.printSv(" GFLOP-equivalent/s at ");
+  out.printNumber(DistanceMatrix::FLOPS_PER_DISTANCE,
+                  std::chars_format::fixed, 0);
+  out.printSv(" per distance)\n\n");
+  out.flush();
+  profiler.end();
+  profiler.report(out, inputBytes, pairs.size());
+  if (profiler.countersEnabled())
+    pool.printStats(out);
+  return 0;
+}
 } // namespace
 
 int main(int argc, const char *argv[]) {
   using namespace Haversine::CliUtils;
   using namespace Haversine::MathUtils;
+  using namespace Haversine::TimingUtils;
+  namespace SpatialIndex = Haversine::SpatialIndex;
   CommandLineArgument argFilename{"filename", &getString, &toStringView};
 
   CliHelper cli{"haversine_processor", argFilename};
@@ -32,64 +896,399 @@ int main(int argc, const char *argv[]) {
                                  .mNeedsClosing = false,
                                  .mFileDescriptor = STDOUT_FILENO};
   std::string filename;
+  CommandLineOptions options;
+  std::optional<SpatialIndex::Rect> queryRect;
+  double f32Tolerance = 1e-6;
+  std::optional<double> approxError;
+  std::optional<std::uint64_t> syntheticPairs;
+  Mode syntheticMode = Mode::CLUSTER;
+  std::uint64_t syntheticSeed = 0;
+  Haversine::ThreadPool::PoolOptions poolOptions;
+  Haversine::Aggregates::Config aggregates;
+  Haversine::LargeBuffer::Options bufferOptions;
+  std::optional<MatrixOptions> matrix;
+  std::optional<PairRange> range;
+  std::optional<Haversine::Sampling::Options> sampling;
+  bool ndjson = false;
   IoBufferedWriter stdOutWriter(stdOutHandle);
   try {
-    cli.parse(argc, argv, filename);
+    // Synthetic runs need no input file, so options may come first.
+    const bool optionsOnly =
+        argc > 1 && std::string_view(argv[1]).starts_with("--");
+    if (!optionsOnly)
+      cli.parse(argc, argv, filename);
+    options = CommandLineOptions::from(argc, argv, optionsOnly ? 1 : 2);
+    if (auto rawPairs = options.value("synthetic"))
+      syntheticPairs = coordinatePairsFrom(*rawPairs);
+    else if (optionsOnly)
+      throw std::runtime_error(
+          "Error: Not all required arguments were filled!");
+    if (auto rawMode = options.value("mode"))
+      syntheticMode = modeFrom(*rawMode);
+    if (auto rawSeed = options.value("seed"))
+      syntheticSeed = randomSeedFrom(*rawSeed);
+    poolOptions = Haversine::ThreadPool::PoolOptions::from(options);
+    aggregates = Haversine::Aggregates::Config::from(options);
+    bufferOptions = Haversine::LargeBuffer::Options::from(options);
+    if (auto rawRect = options.value("query"))
+      queryRect = SpatialIndex::Rect::from(*rawRect);
+    if (auto rawTolerance = options.value("f32"))
+      f32Tolerance = doubleFrom(*rawTolerance, "Invalid f32 tolerance: ");
+    if (auto rawRange = options.value("range"))
+      range = PairRange::from(*rawRange);
+    ndjson = options.has("ndjson") || filename.ends_with(".ndjson");
+    for (auto name : {"index", "query", "range", "chunk-index", "incremental",
+                      "validate-only", "emit", "f32"}) {
+      if (ndjson && options.has(name))
+        throw std::runtime_error(
+            std::string("NDJSON input does not support --") + name);
+    }
+    sampling = Haversine::Sampling::Options::from(options);
+    for (auto name : {"index", "query", "range", "chunk-index", "incremental",
+                      "validate-only", "emit", "f32", "matrix", "approx",
+                      "aggregates", "synthetic"}) {
+      if (sampling && options.has(name))
+        throw std::runtime_error(std::string("--sample does not support --") +
+                                 name);
+    }
+    if (options.has("approx")) {
+      approxError = 1e-6;
+      if (auto rawError = options.value("approx"))
+        approxError = doubleFrom(*rawError, "Invalid approx error: ");
+    }
+    if (options.has("matrix")) {
+      matrix = MatrixOptions{.mFilename = options.value("matrix"),
+                             .mRowsFilename = options.value("matrix-rows")};
+      if (matrix->mFilename && matrix->mRowsFilename)
+        throw std::runtime_error(
+            "--matrix-rows needs --matrix without a filename");
+      if (auto rawPoints = options.value("points"))
+        matrix->mMaxPoints = u64From(*rawPoints, "Invalid points: ");
+      if (auto rawType = options.value("matrix-type")) {
+        if (*rawType != "f64" && *rawType != "f32")
+          throw std::runtime_error("Invalid matrix type: " +
+                                   std::string(*rawType));
+        matrix->mSinglePrecision = *rawType == "f32";
+      }
+    }
   } catch (const std::exception &e) {
     stdOutWriter.printSv(e.what());
     stdOutWriter.printSv("\n");
     stdOutWriter.printSv(help);
+    stdOutWriter.printSv(OPTIONS_HELP);
     return 1;
   }
+  const bool useIndex = queryRect.has_value() || options.has("index");
+
+  try {
+    printKernelSelection(stdOutWriter);
+  } catch (const std::exception &e) {
+    stdOutWriter.printSv(e.what());
+    stdOutWriter.printSv("\n");
+    return 1;
+  }
+
+  if (options.has("allocations"))
+    Haversine::AllocProfiler::enable();
+  if (auto traceFilename = options.value("trace"))
+    Haversine::Trace::enable(*traceFilename);
+  Haversine::PerfCounters::StageProfiler profiler{options.has("counters"),
+                                                  options.has("allocations")};
+  Haversine::ThreadPool::Pool pool{poolOptions};
+  if (syntheticPairs) {
+    return runSynthetic(stdOutWriter, profiler, pool, syntheticMode,
+                        syntheticSeed, *syntheticPairs);
+  }
 
   auto inputFile = FileHandle::open(filename, O_RDONLY);
-  ssize_t bufferSize = INITIAL_BUFFER_SIZE;
-  std::unique_ptr<char[]> buffer = std::make_unique<char[]>(bufferSize);
-  ssize_t readIndex = 0;
-  while (true) {
-    auto nextReadSize = bufferSize - readIndex;
-    if (nextReadSize == 0) {
-      auto newBufferSize = bufferSize * 2;
-      std::unique_ptr<char[]> newBuffer =
-          std::make_unique<char[]>(newBufferSize);
-      std::memcpy(newBuffer.get(), buffer.get(), bufferSize);
-      std::swap(buffer, newBuffer);
-      bufferSize = newBufferSize;
-      nextReadSize = bufferSize - readIndex;
+
+  if (sampling)
+    return runSampled(stdOutWriter, profiler, pool, inputFile, *sampling);
+
+  if (options.has("validate-only")) {
+    auto contents = readWholeFile(inputFile, bufferOptions);
+    const auto validateStart = readOsTimer();
+    const auto result = json_parser::validate(contents.view());
+    const auto validateTime = readOsTimer() - validateStart;
+    if (!result.mValid) {
+      stdOutWriter.printSv("Invalid JSON: ");
+      stdOutWriter.printSv(result.mErrorMessage);
+      stdOutWriter.printSv(" at ");
+      stdOutWriter.printNumber(result.mLine);
+      stdOutWriter.printSv(":");
+      stdOutWriter.printNumber(result.mColumn);
+      stdOutWriter.printSv(" (byte offset ");
+      stdOutWriter.printNumber(result.mOffset);
+      stdOutWriter.printSv(")\n");
+      return 1;
     }
-    auto bytesRead = ::read(inputFile.mFileDescriptor, buffer.get() + readIndex,
-                            nextReadSize);
+    const auto seconds = secondsFromOsTicks(validateTime);
+    stdOutWriter.printSv("Valid JSON: ");
+    stdOutWriter.printNumber(contents.mSize);
+    stdOutWriter.printSv(" bytes in ");
+    printMicroseconds(stdOutWriter, validateTime);
+    stdOutWriter.printSv(" (");
+    stdOutWriter.printNumber(
+        seconds > 0. ? double(contents.mSize) / seconds / 1e9 : 0.,
+        std::chars_format::fixed, 3);
+    stdOutWriter.printSv(" GB/s)\n");
+    return 0;
+  }
 
-    if (bytesRead < 0)
-      return int(bytesRead);
+  if (useIndex) {
+    const auto identity =
+        SpatialIndex::FileIdentity::of(inputFile.mFileDescriptor);
+    const auto indexFilename = filename + ".hvsi";
+    const auto indexStart = readOsTimer();
+    auto index = SpatialIndex::Index::load(indexFilename, identity);
+    const bool indexLoaded = index.has_value();
+    std::uint64_t parseTime = 0;
+    if (!indexLoaded) {
+      const auto parseStart = readOsTimer();
+      auto contents = readWholeFile(inputFile, bufferOptions);
+      const auto pairs = Haversine::Api::pairsFromJson(contents.view());
+      parseTime = readOsTimer() - parseStart;
 
-    if (bytesRead == 0)
-      break;
+      std::vector<double> distances(pairs.size());
+      Haversine::Api::meanDistance(Haversine::Api::PairSpans::of(pairs),
+                                   distances, {.mPool = &pool});
+      index = SpatialIndex::Index::build(pairs, distances);
+      index->save(indexFilename, identity);
+    }
+    const auto indexTime = readOsTimer() - indexStart;
 
-    readIndex += bytesRead;
+    const auto total = index->total();
+    stdOutWriter.printSv("Pair count: ");
+    stdOutWriter.printNumber(total.mCount);
+    stdOutWriter.printSv("\nExpected sum: ");
+    stdOutWriter.printNumber(total.mean(), std::chars_format::fixed, 16);
+    stdOutWriter.printSv("\n\nSpatial index: ");
+    stdOutWriter.printSv(indexLoaded ? "loaded from " : "built into ");
+    stdOutWriter.printSv(indexFilename);
+    stdOutWriter.printSv(" in ");
+    printMicroseconds(stdOutWriter, indexTime);
+    if (!indexLoaded) {
+      stdOutWriter.printSv(" (JSON parse ");
+      printMicroseconds(stdOutWriter, parseTime);
+      stdOutWriter.printSv(")");
+    }
+    stdOutWriter.printSv("\n");
+
+    if (queryRect) {
+      const auto queryStart = readOsTimer();
+      const auto result = index->query(*queryRect);
+      const auto queryTime = readOsTimer() - queryStart;
+
+      const auto scanStart = readOsTimer();
+      const auto scanResult = index->fullScan(*queryRect);
+      const auto scanTime = readOsTimer() - scanStart;
+
+      stdOutWriter.printSv("Query pair count: ");
+      stdOutWriter.printNumber(result.mCount);
+      stdOutWriter.printSv("\nQuery average distance: ");
+      stdOutWriter.printNumber(result.mean(), std::chars_format::fixed, 16);
+      stdOutWriter.printSv("\nQuery latency (index): ");
+      printMicroseconds(stdOutWriter, queryTime);
+      stdOutWriter.printSv("\nQuery latency (full scan): ");
+      printMicroseconds(stdOutWriter, scanTime);
+      if (scanResult.mCount != result.mCount) {
+        stdOutWriter.printSv("\nWARNING: full scan found ");
+        stdOutWriter.printNumber(scanResult.mCount);
+        stdOutWriter.printSv(" pairs");
+      }
+      stdOutWriter.printSv("\n");
+    }
+    stdOutWriter.printSv("\n");
+    return 0;
+  }
+
+  if (range || options.has("chunk-index")) {
+    return runChunked(stdOutWriter, profiler, pool, filename, inputFile,
+                      range.value_or(PairRange{}));
   }
-  std::string_view fileString(buffer.get(), readIndex);
-  auto json = json_parser::Value{};
-  json_parser::parse(fileString, json);
 
-  const auto &arrayOfPairs = json.getMemberValue("pairs").getArray();
-  auto sumCoeficient =
-      !arrayOfPairs.empty() ? (1. / double(arrayOfPairs.size())) : 0.;
+  if (options.has("incremental")) {
+    return runIncremental(stdOutWriter, profiler, pool, filename, inputFile);
+  }
+
+  profiler.begin("read");
+  auto contents = readWholeFile(inputFile, bufferOptions);
+  profiler.end();
+
+  if (auto emitFilename = options.value("emit")) {
+    profiler.begin("parse");
+    // Numbers are copied through, so none of them is converted.
+    auto json = json_parser::Value{};
+    json_parser::parse(contents.view(), json,
+                       json_parser::ParseOptions{.mLazyNumbers = true});
+    profiler.end();
+
+    profiler.begin("emit");
+    auto emitFile =
+        FileHandle::open(*emitFilename, O_WRONLY | O_CREAT | O_TRUNC,
+                         S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    IoBufferedWriter emitWriter(emitFile);
+    json_parser::Serializer<IoBufferedWriter> serializer{
+        emitWriter, options.has("minify") ? json_parser::Layout::MINIFIED
+                                          : json_parser::Layout::PRETTY};
+    serializer.value(json);
+    emitWriter.flush();
+    profiler.end();
+
+    stdOutWriter.printSv("Wrote ");
+    stdOutWriter.printNumber(emitWriter.mBytesWritten);
+    stdOutWriter.printSv(" bytes to ");
+    stdOutWriter.printSv(*emitFilename);
+    stdOutWriter.printSv("\n\n");
+    stdOutWriter.flush();
+    profiler.report(stdOutWriter, std::uint64_t(contents.mSize), 0);
+    return 0;
+  }
+
+  if (options.has("f32")) {
+    const auto f32Start = readOsTimer();
+    auto json32 = json_parser::Value{};
+    json_parser::parse(contents.view(), json32,
+                       json_parser::ParseOptions{.mSinglePrecision = true});
+    const auto pairs32 = Haversine::Api::pairsOf<float>(json32);
+    const auto f32ParseEnd = readOsTimer();
+    std::vector<float> distances32(pairs32.size());
+    haversineBatch(pairs32.mX0, pairs32.mY0, pairs32.mX1, pairs32.mY1,
+                   distances32);
+    const auto mean32 =
+        pairs32.size() ? sumOf(distances32) / double(pairs32.size()) : 0.;
+    const auto f32End = readOsTimer();
+
+    const auto f64Start = readOsTimer();
+    auto json64 = json_parser::Value{};
+    json_parser::parse(contents.view(), json64);
+    const auto pairs64 = Haversine::Api::pairsOf<double>(json64);
+    const auto f64ParseEnd = readOsTimer();
+    const auto coeficient64 = pairs64.size() ? 1. / double(pairs64.size()) : 0.;
+    double mean64 = 0;
+    for (std::size_t i = 0; i < pairs64.size(); ++i) {
+      mean64 += coeficient64 *
+                referenceHaversine(pairs64.mX0[i], pairs64.mY0[i],
+                                   pairs64.mX1[i], pairs64.mY1[i]);
+    }
+    const auto f64End = readOsTimer();
+
+    const auto deviation = std::abs(mean32 - mean64);
+    const auto relativeDeviation = mean64 != 0. ? deviation / mean64 : 0.;
+    stdOutWriter.printSv("Pair count: ");
+    stdOutWriter.printNumber(pairs32.size());
+    stdOutWriter.printSv("\nExpected sum: ");
+    stdOutWriter.printNumber(mean32, std::chars_format::fixed, 16);
+    stdOutWriter.printSv("\n\nDouble precision sum: ");
+    stdOutWriter.printNumber(mean64, std::chars_format::fixed, 16);
+    stdOutWriter.printSv("\nAbsolute deviation: ");
+    stdOutWriter.printNumber(deviation, std::chars_format::scientific, 6);
+    stdOutWriter.printSv("\nRelative deviation: ");
+    stdOutWriter.printNumber(relativeDeviation, std::chars_format::scientific,
+                             6);
+    stdOutWriter.printSv(relativeDeviation <= f32Tolerance
+                             ? " (within tolerance "
+                             : " (EXCEEDS tolerance ");
+    stdOutWriter.printNumber(f32Tolerance, std::chars_format::scientific, 1);
+    stdOutWriter.printSv(")\nSingle precision parse/compute: ");
+    printMicroseconds(stdOutWriter, f32ParseEnd - f32Start);
+    stdOutWriter.printSv(" / ");
+    printMicroseconds(stdOutWriter, f32End - f32ParseEnd);
+    stdOutWriter.printSv("\nDouble precision parse/compute: ");
+    printMicroseconds(stdOutWriter, f64ParseEnd - f64Start);
+    stdOutWriter.printSv(" / ");
+    printMicroseconds(stdOutWriter, f64End - f64ParseEnd);
+    stdOutWriter.printSv("\n\n");
+    return 0;
+  }
+
+  profiler.begin("parse");
+  std::optional<Haversine::Api::NdjsonPairs> lines;
+  if (ndjson)
+    lines = Haversine::Api::pairsFromNdjson(contents.view(), {.mPool = &pool});
+  const auto pairs = lines ? std::move(lines->mPairs)
+                           : Haversine::Api::pairsFromJson(contents.view());
+  profiler.end();
+
+  if (matrix) {
+    const auto inputBytes = std::uint64_t(contents.mSize);
+    return matrix->mSinglePrecision
+               ? runMatrix<float>(stdOutWriter, profiler, pool, pairs,
+                                  *matrix, inputBytes)
+               : runMatrix<double>(stdOutWriter, profiler, pool, pairs,
+                                   *matrix, inputBytes);
+  }
+
+  profiler.begin("compute");
+  // Distances are only kept when the aggregation stage needs them.
+  std::vector<double> distances(aggregates.mKinds ? pairs.size() : 0);
+  std::optional<AdaptiveTotals> adaptive;
   double sum = 0;
-  for (const auto &elem : arrayOfPairs) {
-    auto x0 = elem->getMemberValue("x0").getFloatingPoint();
-    auto y0 = elem->getMemberValue("y0").getFloatingPoint();
-    auto x1 = elem->getMemberValue("x1").getFloatingPoint();
-    auto y1 = elem->getMemberValue("y1").getFloatingPoint();
+  if (approxError) {
+    adaptive = computeAdaptive(pool, pairs,
+                               equirectangularMaxSpan(*approxError), distances);
+    sum = adaptive->mSum;
+  } else {
+    sum = Haversine::Api::meanDistance(Haversine::Api::PairSpans::of(pairs),
+                                       distances, {.mPool = &pool});
+  }
+  profiler.end();
 
-    auto haversineDistance = referenceHaversine(x0, y0, x1, y1);
-    sum += sumCoeficient * haversineDistance;
+  std::optional<Haversine::Aggregates::Summary> aggregateSummary;
+  if (aggregates.mKinds) {
+    profiler.begin("aggregate");
+    aggregateSummary =
+        Haversine::Api::aggregate(distances, aggregates, {.mPool = &pool});
+    profiler.end();
   }
 
+  profiler.begin("output");
   stdOutWriter.printSv("Pair count: ");
-  stdOutWriter.printNumber(arrayOfPairs.size());
+  stdOutWriter.printNumber(pairs.size());
   stdOutWriter.printSv("\nExpected sum: ");
   stdOutWriter.printNumber(sum, std::chars_format::fixed, 16);
   stdOutWriter.printSv("\n\n");
+  printBufferReport(stdOutWriter, contents);
+  if (lines) {
+    stdOutWriter.printSv("NDJSON: ");
+    stdOutWriter.printNumber(lines->mLines);
+    stdOutWriter.printSv(" lines, ");
+    stdOutWriter.printNumber(lines->mBlankLines);
+    stdOutWriter.printSv(" blank");
+    if (lines->mSkippedPartialLine)
+      stdOutWriter.printSv(", partial last line skipped");
+    stdOutWriter.printSv("\n\n");
+  }
+  if (adaptive) {
+    const auto count = double(pairs.size());
+    const auto shortPairs = adaptive->mShortPairs;
+    stdOutWriter.printSv("Equirectangular path: ");
+    stdOutWriter.printNumber(shortPairs);
+    stdOutWriter.printSv(" pairs (");
+    stdOutWriter.printNumber(count ? double(shortPairs) / count * 100. : 0.,
+                             std::chars_format::fixed, 2);
+    stdOutWriter.printSv("%), haversine: ");
+    stdOutWriter.printNumber(pairs.size() - shortPairs);
+    stdOutWriter.printSv(" pairs\nMaximum span ");
+    stdOutWriter.printNumber(equirectangularMaxSpan(*approxError),
+                             std::chars_format::scientific, 3);
+    stdOutWriter.printSv(" rad, error bound ");
+    stdOutWriter.printNumber(*approxError, std::chars_format::scientific, 1);
+    stdOutWriter.printSv("\nWorst relative error: ");
+    stdOutWriter.printNumber(adaptive->mWorstRelativeError,
+                             std::chars_format::scientific, 3);
+    stdOutWriter.printSv(" over ");
+    stdOutWriter.printNumber(adaptive->mCheckedPairs);
+    stdOutWriter.printSv(" pairs checked against referenceHaversine\n\n");
+  }
+  if (aggregateSummary) {
+    aggregateSummary->print(stdOutWriter);
+    stdOutWriter.printSv("\n");
+  }
+  stdOutWriter.flush();
+  profiler.end();
+  profiler.report(stdOutWriter, std::uint64_t(contents.mSize), pairs.size());
+  if (profiler.countersEnabled())
+    pool.printStats(stdOutWriter);
   return 0;
 }
@@ -0,0 +1,241 @@
+#include "sampling.h"
+#include "checkpoint.h"
+#include "json_parser.h"
+#include "math_utils.h"
+#include "random_utils.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Haversine::Sampling {
+
+namespace {
+// Bytes read per seek, enough for two generated pairs in most layouts; the
+// window doubles while a candidate runs past it.
+constexpr std::uint64_t READ_WINDOW_BYTES = 256;
+// A pair must end within this many bytes of the seek, which also rules out
+// the document object.
+constexpr std::uint64_t SCAN_LIMIT_BYTES = 64 * 1024;
+// With a fraction, the first batch only measures the bytes per element.
+constexpr std::uint64_t PILOT_SAMPLES = 64;
+constexpr std::uint64_t SEEK_GRAIN = 64;
+
+struct Sample {
+  bool mFound{false};
+  double mDistance{0};
+  // From the pair's '{' to the next element's, or to its own end when no
+  // other follows in the window.
+  std::uint64_t mStride{0};
+  std::uint64_t mBytesRead{0};
+  // Tasks must not throw; a failed read is reported after the batch.
+  std::string mError;
+};
+
+// One past the '}' closing the object opened at `open`, or npos when the
+// text ends first.
+std::size_t objectEnd(std::string_view text, std::size_t open) {
+  std::uint64_t depth = 0;
+  bool inString = false;
+  for (auto i = open; i < text.size(); ++i) {
+    const char c = text[i];
+    if (inString) {
+      if (c == '\\')
+        ++i;
+      else if (c == '"')
+        inString = false;
+    } else if (c == '"') {
+      inString = true;
+    } else if (c == '{' || c == '[') {
+      ++depth;
+    } else if ((c == '}' || c == ']') && --depth == 0) {
+      return i + 1;
+    }
+  }
+  return std::string_view::npos;
+}
+
+// Objects that do not parse on their own, or lack a coordinate, are
+// something other than a pair: a nested object, or text cut mid-string.
+bool pairDistance(std::string_view text, double &distance) {
+  try {
+    json_parser::Value json;
+    json_parser::parse(text, json);
+    distance = MathUtils::referenceHaversine(
+        json.getMemberValue("x0").getAsFloatingPoint(),
+        json.getMemberValue("y0").getAsFloatingPoint(),
+        json.getMemberValue("x1").getAsFloatingPoint(),
+        json.getMemberValue("y1").getAsFloatingPoint());
+    return true;
+  } catch (const std::exception &) {
+    return false;
+  }
+}
+
+Sample sampleAt(int fileDescriptor, std::uint64_t fileSize,
+                std::uint64_t offset) {
+  using Checkpoint::Checkpoint;
+  Sample sample;
+  auto window = Checkpoint::readRange(fileDescriptor, offset,
+                                      std::min(READ_WINDOW_BYTES, fileSize));
+  sample.mBytesRead = window.size();
+  auto extend = [&] {
+    if (window.size() >= SCAN_LIMIT_BYTES ||
+        offset + window.size() >= fileSize)
+      return false;
+    const auto more = Checkpoint::readRange(
+        fileDescriptor, offset + window.size(),
+        std::min<std::uint64_t>(window.size(),
+                                SCAN_LIMIT_BYTES - window.size()));
+    sample.mBytesRead += more.size();
+    window += more;
+    return !more.empty();
+  };
+
+  std::size_t from = 0;
+  while (true) {
+    const auto open = window.find('{', from);
+    if (open == std::string::npos) {
+      from = window.size();
+      if (!extend())
+        return sample;
+      continue;
+    }
+    const auto end = objectEnd(window, open);
+    if (end == std::string_view::npos) {
+      if (!extend())
+        from = open + 1;
+      continue;
+    }
+    if (!pairDistance(std::string_view(window).substr(open, end - open),
+                      sample.mDistance)) {
+      from = open + 1;
+      continue;
+    }
+    auto next = end;
+    while (next < window.size() &&
+           (window[next] == ',' || window[next] == ' ' ||
+            window[next] == '\t' || window[next] == '\n' ||
+            window[next] == '\r'))
+      ++next;
+    const bool followed = next < window.size() && window[next] == '{';
+    sample.mFound = true;
+    sample.mStride = (followed ? next : end) - open;
+    return sample;
+  }
+}
+} // namespace
+
+std::optional<Options>
+Options::from(const CliUtils::CommandLineOptions &options) {
+  if (!options.has("sample") && !options.has("sample-error"))
+    return std::nullopt;
+  Options result;
+  if (auto rawSeed = options.value("seed"))
+    result.mSeed = CliUtils::randomSeedFrom(*rawSeed);
+  if (auto rawError = options.value("sample-error")) {
+    constexpr std::string_view ERROR_PREFIX = "Invalid sample error: ";
+    const auto error = CliUtils::doubleFrom(*rawError, ERROR_PREFIX);
+    if (!(error > 0.))
+      throw std::runtime_error(std::string(ERROR_PREFIX) +
+                               std::string(*rawError));
+    result.mTargetError = error;
+    result.mCount = DEFAULT_ADAPTIVE_SAMPLES;
+  }
+  if (auto rawSample = options.value("sample")) {
+    constexpr std::string_view ERROR_PREFIX = "Invalid sample size: ";
+    const auto value = CliUtils::doubleFrom(*rawSample, ERROR_PREFIX);
+    if (value > 0. && value < 1.)
+      result.mFraction = value;
+    else if (value >= 1. && value < 0x1p64 && std::floor(value) == value)
+      result.mCount = std::uint64_t(value);
+    else
+      throw std::runtime_error(std::string(ERROR_PREFIX) +
+                               std::string(*rawSample));
+  }
+  return result;
+}
+
+double Estimate::halfWidth() const {
+  if (mSamples < 2)
+    return std::numeric_limits<double>::infinity();
+  const auto variance = mM2 / double(mSamples - 1);
+  return CONFIDENCE_Z * std::sqrt(variance / double(mSamples));
+}
+
+Estimate estimate(int fileDescriptor, std::uint64_t fileSize,
+                  const Options &options, ThreadPool::Pool &pool) {
+  Estimate result;
+  if (fileSize == 0)
+    return result;
+  RandomUtils::Xoshiro256Plus random{options.mSeed};
+  auto limit = options.mFraction ? PILOT_SAMPLES : options.mCount;
+  double strideSum = 0;
+  std::vector<std::uint64_t> offsets;
+  std::vector<Sample> samples;
+  for (std::uint64_t batchIndex = 0; result.mSamples < limit; ++batchIndex) {
+    // Offsets are drawn up front so that the samples do not depend on
+    // which worker takes which seek.
+    const auto batch = std::min(BATCH_SAMPLES, limit - result.mSamples);
+    offsets.resize(batch);
+    for (auto &offset : offsets)
+      offset = std::min(fileSize - 1,
+                        std::uint64_t(random.unit() * double(fileSize)));
+    samples.assign(batch, Sample{});
+    pool.parallelFor(
+        0, batch, SEEK_GRAIN, [&](std::uint64_t begin, std::uint64_t end) {
+          Haversine::Trace::Scope scope{"sample seeks", batchIndex};
+          for (auto i = begin; i < end; ++i) {
+            try {
+              samples[i] = sampleAt(fileDescriptor, fileSize, offsets[i]);
+            } catch (const std::exception &e) {
+              samples[i].mError = e.what();
+            }
+          }
+        });
+
+    std::uint64_t found = 0;
+    for (const auto &sample : samples) {
+      if (!sample.mError.empty())
+        throw std::runtime_error(sample.mError);
+      ++result.mSeeks;
+      result.mBytesRead += sample.mBytesRead;
+      if (!sample.mFound) {
+        ++result.mMisses;
+        continue;
+      }
+      ++found;
+      ++result.mSamples;
+      const auto delta = sample.mDistance - result.mMean;
+      result.mMean += delta / double(result.mSamples);
+      result.mM2 += delta * (sample.mDistance - result.mMean);
+      strideSum += double(sample.mStride);
+    }
+    // A whole batch without a pair: the file holds none worth seeking for.
+    if (found == 0)
+      break;
+    result.mEstimatedPairs = std::uint64_t(
+        std::round(double(fileSize) * double(result.mSamples) / strideSum));
+    if (options.mFraction) {
+      limit = std::max<std::uint64_t>(
+          1, std::uint64_t(std::ceil(*options.mFraction *
+                                     double(result.mEstimatedPairs))));
+    }
+    // Past that, reading the whole file costs less.
+    limit = std::min(limit, std::max<std::uint64_t>(
+                                result.mEstimatedPairs, result.mSamples));
+    if (options.mTargetError && result.mSamples > 1 &&
+        result.halfWidth() <= *options.mTargetError * result.mMean) {
+      result.mTargetReached = true;
+      break;
+    }
+  }
+  return result;
+}
+
+} // namespace Haversine::Sampling
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "cli_utils.h"
+#include "thread_pool.h"
+
+#include <cstdint>
+#include <optional>
+
+namespace Haversine::Sampling {
+
+constexpr std::uint64_t DEFAULT_SAMPLES = 10000;
+// Upper bound when only a target error is given.
+constexpr std::uint64_t DEFAULT_ADAPTIVE_SAMPLES = 1000000;
+// Offsets are drawn, read and parsed this many at a time; a target error is
+// checked between batches.
+constexpr std::uint64_t BATCH_SAMPLES = 1024;
+// Two-sided 95% quantile of the normal distribution.
+constexpr double CONFIDENCE_Z = 1.959963984540054;
+
+struct Options {
+  // From --sample[=count|fraction], --sample-error=relative and --seed;
+  // nullopt unless one of the first two is present.
+  static std::optional<Options>
+  from(const CliUtils::CommandLineOptions &options);
+
+  // Capped at the estimated pair count.
+  std::uint64_t mCount{DEFAULT_SAMPLES};
+  // Of the estimated pair count; replaces mCount.
+  std::optional<double> mFraction;
+  // Stop once the confidence interval's half-width is at most this fraction
+  // of the mean.
+  std::optional<double> mTargetError;
+  std::uint64_t mSeed{0};
+};
+
+struct Estimate {
+  double halfWidth() const;
+
+  std::uint64_t mSamples{0};
+  double mMean{0};
+  // Sum of squared deviations from mMean (Welford).
+  double mM2{0};
+  // From the file size and the mean bytes per sampled element.
+  std::uint64_t mEstimatedPairs{0};
+  std::uint64_t mSeeks{0};
+  // Seeks past the last pair, or into text without one.
+  std::uint64_t mMisses{0};
+  std::uint64_t mBytesRead{0};
+  bool mTargetReached{false};
+};
+
+// Reads pairs at uniformly random byte offsets: each seek resynchronizes to
+// the first '{' after it that opens a complete {"x0":..,"y0":..,"x1":..,
+// "y1":..} object, so it works for any corpus variant and for NDJSON. A pair
+// is picked with probability proportional to the length of the text before
+// it, which is near uniform for generated inputs. Samples are drawn with
+// replacement; the result for a seed does not depend on the thread count.
+// The cost depends on the sample count, not on the file size.
+Estimate estimate(int fileDescriptor, std::uint64_t fileSize,
+                  const Options &options, ThreadPool::Pool &pool);
+
+} // namespace Haversine::Sampling
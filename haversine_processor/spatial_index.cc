@@ -0,0 +1,335 @@
+#include "spatial_index.h"
+#include "cli_utils.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+extern "C" {
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+namespace Haversine::SpatialIndex {
+
+namespace {
+constexpr std::array<char, 8> INDEX_MAGIC{'H', 'V', 'S', 'I',
+                                          'D', 'X', '0', '1'};
+constexpr std::uint64_t UNBOUNDED_KEY = ~0ULL;
+constexpr double CELL_EPSILON = 1e-9;
+constexpr std::uint32_t GRID_SIZE = 1U << Index::DEPTH;
+
+struct IndexHeader {
+  std::array<char, 8> mMagic;
+  std::uint32_t mDepth;
+  std::uint32_t mReserved;
+  FileIdentity mSource;
+  std::uint64_t mPairCount;
+};
+
+std::uint32_t spreadBits(std::uint32_t value) {
+  value &= 0x0000FFFF;
+  value = (value | (value << 8)) & 0x00FF00FF;
+  value = (value | (value << 4)) & 0x0F0F0F0F;
+  value = (value | (value << 2)) & 0x33333333;
+  value = (value | (value << 1)) & 0x55555555;
+  return value;
+}
+
+std::uint32_t mortonCode(std::uint32_t x, std::uint32_t y) {
+  return spreadBits(x) | (spreadBits(y) << 1);
+}
+
+bool quantize(double value, double minValue, double extent,
+              std::uint32_t &out) {
+  if (!(value >= minValue && value <= minValue + extent))
+    return false;
+  auto cell = std::uint64_t((value - minValue) / extent * double(GRID_SIZE));
+  out = std::uint32_t(std::min<std::uint64_t>(cell, GRID_SIZE - 1));
+  return true;
+}
+
+std::uint64_t keyFor(double x0, double y0, double x1, double y1) {
+  std::uint32_t qx0{}, qy0{}, qx1{}, qy1{};
+  if (!quantize(x0, -180., 360., qx0) || !quantize(y0, -90., 180., qy0) ||
+      !quantize(x1, -180., 360., qx1) || !quantize(y1, -90., 180., qy1))
+    return UNBOUNDED_KEY;
+  const auto m0 = mortonCode(qx0, qy0);
+  const auto m1 = mortonCode(qx1, qy1);
+  std::uint32_t level = Index::DEPTH;
+  if (const auto diff = m0 ^ m1; diff != 0) {
+    const auto highestBit = 31U - std::uint32_t(__builtin_clz(diff));
+    level = Index::DEPTH - (highestBit / 2 + 1);
+  }
+  const auto shift = 2 * (Index::DEPTH - level);
+  const auto cellCode = shift == 32 ? 0U : (m0 >> shift) << shift;
+  return (std::uint64_t(cellCode) << 8) | level;
+}
+
+// Cell bounds widened by CELL_EPSILON so that rounding in quantize() can never
+// place a point outside the bounds of its cell. The outer edges of the grid
+// stay exact because quantize() rejects anything beyond them.
+struct CellBounds {
+  bool disjointFrom(const Rect &rect) const {
+    return rect.mMaxX < mMinX || rect.mMinX > mMaxX || rect.mMaxY < mMinY ||
+           rect.mMinY > mMaxY;
+  }
+  bool insideOf(const Rect &rect) const {
+    return rect.mMinX <= mMinX && rect.mMaxX >= mMaxX && rect.mMinY <= mMinY &&
+           rect.mMaxY >= mMaxY;
+  }
+
+  double mMinX, mMinY, mMaxX, mMaxY;
+};
+
+CellBounds cellBounds(std::uint32_t level, std::uint32_t x, std::uint32_t y) {
+  const auto cells = 1U << level;
+  const double width = 360. / double(cells);
+  const double height = 180. / double(cells);
+  return CellBounds{
+      .mMinX = x == 0 ? -180. : -180. + width * x - CELL_EPSILON,
+      .mMinY = y == 0 ? -90. : -90. + height * y - CELL_EPSILON,
+      .mMaxX = x + 1 == cells ? 180. : -180. + width * (x + 1) + CELL_EPSILON,
+      .mMaxY = y + 1 == cells ? 90. : -90. + height * (y + 1) + CELL_EPSILON};
+}
+
+void writeAll(int fileDescriptor, const void *data, std::size_t size) {
+  const auto *bytes = static_cast<const char *>(data);
+  while (size > 0) {
+    auto r = ::write(fileDescriptor, bytes, size);
+    if (r < 0)
+      throw std::runtime_error("Unable to write spatial index");
+    bytes += r;
+    size -= std::size_t(r);
+  }
+}
+
+bool readAll(int fileDescriptor, void *data, std::size_t size) {
+  auto *bytes = static_cast<char *>(data);
+  while (size > 0) {
+    auto r = ::read(fileDescriptor, bytes, size);
+    if (r <= 0)
+      return false;
+    bytes += r;
+    size -= std::size_t(r);
+  }
+  return true;
+}
+
+template <typename T>
+void writeVector(int fileDescriptor, const std::vector<T> &values) {
+  writeAll(fileDescriptor, values.data(), values.size() * sizeof(T));
+}
+
+template <typename T>
+bool readVector(int fileDescriptor, std::vector<T> &values,
+                std::size_t count) {
+  values.resize(count);
+  return readAll(fileDescriptor, values.data(), count * sizeof(T));
+}
+} // namespace
+
+Rect Rect::from(std::string_view rawText) {
+  std::array<double, 4> bounds{};
+  std::size_t count = 0;
+  while (count < bounds.size()) {
+    auto end = rawText.find(',');
+    bounds[count++] = CliUtils::doubleFrom(rawText.substr(0, end),
+                                           "Invalid rectangle bound: ");
+    if (end == std::string_view::npos)
+      break;
+    rawText.remove_prefix(end + 1);
+  }
+  if (count != bounds.size() || bounds[0] > bounds[2] ||
+      bounds[1] > bounds[3]) {
+    throw std::runtime_error(
+        "Rectangle must be given as minLon,minLat,maxLon,maxLat");
+  }
+  return Rect{.mMinX = bounds[0],
+              .mMinY = bounds[1],
+              .mMaxX = bounds[2],
+              .mMaxY = bounds[3]};
+}
+
+Index Index::build(const MathUtils::CoordinatePairs<double> &pairs,
+                   std::span<const double> distances) {
+  const auto count = pairs.size();
+  std::vector<std::uint64_t> keys(count);
+  std::vector<std::uint32_t> order(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    keys[i] = keyFor(pairs.mX0[i], pairs.mY0[i], pairs.mX1[i], pairs.mY1[i]);
+    order[i] = std::uint32_t(i);
+  }
+  std::sort(order.begin(), order.end(), [&](auto lhs, auto rhs) {
+    return keys[lhs] < keys[rhs];
+  });
+
+  Index result;
+  result.mKeys.reserve(count);
+  result.mPairs.reserve(count);
+  result.mDistances.reserve(count);
+  for (auto i : order) {
+    result.mKeys.push_back(keys[i]);
+    result.mPairs.push(pairs.mX0[i], pairs.mY0[i], pairs.mX1[i],
+                       pairs.mY1[i]);
+    result.mDistances.push_back(distances[i]);
+  }
+  result.computePrefixSums();
+  return result;
+}
+
+std::optional<Index> Index::load(std::string_view filename,
+                                 const FileIdentity &source) {
+  std::string path{filename};
+  auto fd = ::open(path.c_str(), O_RDONLY);
+  if (fd == -1)
+    return std::nullopt;
+  CliUtils::FileHandle handle{
+      .mIsOpen = true, .mNeedsClosing = true, .mFileDescriptor = fd};
+
+  IndexHeader header{};
+  if (!readAll(fd, &header, sizeof(header)) || header.mMagic != INDEX_MAGIC ||
+      header.mDepth != DEPTH || !(header.mSource == source))
+    return std::nullopt;
+
+  // Each pair is a key, four coordinates and a distance. The count must
+  // account for the rest of the file exactly, so a corrupt one cannot
+  // allocate more than the file holds.
+  constexpr std::uint64_t PAIR_BYTES =
+      sizeof(std::uint64_t) + 5 * sizeof(double);
+  struct stat info {};
+  if (::fstat(fd, &info) != 0 ||
+      std::uint64_t(info.st_size) < sizeof(header) ||
+      (std::uint64_t(info.st_size) - sizeof(header)) % PAIR_BYTES != 0 ||
+      header.mPairCount !=
+          (std::uint64_t(info.st_size) - sizeof(header)) / PAIR_BYTES)
+    return std::nullopt;
+
+  Index result;
+  const auto count = header.mPairCount;
+  if (!readVector(fd, result.mKeys, count) ||
+      !readVector(fd, result.mPairs.mX0, count) ||
+      !readVector(fd, result.mPairs.mY0, count) ||
+      !readVector(fd, result.mPairs.mX1, count) ||
+      !readVector(fd, result.mPairs.mY1, count) ||
+      !readVector(fd, result.mDistances, count))
+    return std::nullopt;
+  result.computePrefixSums();
+  return result;
+}
+
+void Index::save(std::string_view filename, const FileIdentity &source) const {
+  auto file = CliUtils::FileHandle::open(filename, O_WRONLY | O_CREAT | O_TRUNC,
+                                         S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  IndexHeader header{.mMagic = INDEX_MAGIC,
+                     .mDepth = DEPTH,
+                     .mReserved = 0,
+                     .mSource = source,
+                     .mPairCount = mKeys.size()};
+  writeAll(file.mFileDescriptor, &header, sizeof(header));
+  writeVector(file.mFileDescriptor, mKeys);
+  writeVector(file.mFileDescriptor, mPairs.mX0);
+  writeVector(file.mFileDescriptor, mPairs.mY0);
+  writeVector(file.mFileDescriptor, mPairs.mX1);
+  writeVector(file.mFileDescriptor, mPairs.mY1);
+  writeVector(file.mFileDescriptor, mDistances);
+}
+
+void Index::computePrefixSums() {
+  mPrefixSums.resize(mDistances.size() + 1);
+  mPrefixSums[0] = 0.;
+  for (std::size_t i = 0; i < mDistances.size(); ++i)
+    mPrefixSums[i + 1] = mPrefixSums[i] + mDistances[i];
+}
+
+Aggregate Index::total() const {
+  return Aggregate{.mCount = mKeys.size(), .mSum = mPrefixSums.back()};
+}
+
+Aggregate Index::query(const Rect &rect) const {
+  Aggregate result;
+  queryNode(Node{.mLevel = 0, .mX = 0, .mY = 0}, rect, result);
+  auto unbounded = std::lower_bound(mKeys.begin(), mKeys.end(), UNBOUNDED_KEY);
+  scanRange(std::size_t(unbounded - mKeys.begin()), mKeys.size(), rect,
+            result);
+  return result;
+}
+
+Aggregate Index::fullScan(const Rect &rect) const {
+  Aggregate result;
+  scanRange(0, mKeys.size(), rect, result);
+  return result;
+}
+
+void Index::scanRange(std::size_t begin, std::size_t end, const Rect &rect,
+                      Aggregate &out) const {
+  for (auto i = begin; i < end; ++i) {
+    if (rect.contains(mPairs.mX0[i], mPairs.mY0[i]) &&
+        rect.contains(mPairs.mX1[i], mPairs.mY1[i])) {
+      out.mCount++;
+      out.mSum += mDistances[i];
+    }
+  }
+}
+
+void Index::queryNode(const Node &node, const Rect &rect,
+                      Aggregate &out) const {
+  const auto shift = DEPTH - node.mLevel;
+  const auto cellCode = std::uint64_t(
+      mortonCode(node.mX << shift, node.mY << shift));
+  const auto cellSpan = 1ULL << (2 * shift);
+  const auto ownKey = (cellCode << 8) | node.mLevel;
+  // Ancestors whose cell starts at the same code sort before ownKey.
+  const auto subtreeBegin = std::size_t(
+      std::lower_bound(mKeys.begin(), mKeys.end(), ownKey) - mKeys.begin());
+  const auto subtreeEnd = std::size_t(
+      std::lower_bound(mKeys.begin() + subtreeBegin, mKeys.end(),
+                       (cellCode + cellSpan) << 8) -
+      mKeys.begin());
+  if (subtreeBegin == subtreeEnd)
+    return;
+
+  const auto bounds = cellBounds(node.mLevel, node.mX, node.mY);
+  if (bounds.disjointFrom(rect))
+    return;
+
+  if (bounds.insideOf(rect)) {
+    out.mCount += subtreeEnd - subtreeBegin;
+    out.mSum += mPrefixSums[subtreeEnd] - mPrefixSums[subtreeBegin];
+    return;
+  }
+
+  if (node.mLevel == DEPTH) {
+    scanRange(subtreeBegin, subtreeEnd, rect, out);
+    return;
+  }
+
+  std::array<Node, 4> children{};
+  std::uint32_t intersectingChildren = 0;
+  for (std::uint32_t i = 0; i < 4; ++i) {
+    children[i] = Node{.mLevel = node.mLevel + 1,
+                       .mX = 2 * node.mX + (i & 1),
+                       .mY = 2 * node.mY + (i >> 1)};
+    if (!cellBounds(children[i].mLevel, children[i].mX, children[i].mY)
+             .disjointFrom(rect))
+      intersectingChildren++;
+  }
+
+  // Pairs stored at this cell straddle two of its children, so they can only
+  // be inside the rectangle when it reaches into more than one child.
+  if (intersectingChildren > 1) {
+    const auto ownEnd = std::size_t(
+        std::upper_bound(mKeys.begin() + subtreeBegin,
+                         mKeys.begin() + subtreeEnd, ownKey) -
+        mKeys.begin());
+    scanRange(subtreeBegin, ownEnd, rect, out);
+  }
+
+  for (const auto &child : children)
+    queryNode(child, rect, out);
+}
+
+} // namespace Haversine::SpatialIndex
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "cli_utils.h"
+#include "math_utils.h"
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace Haversine::SpatialIndex {
+
+// Longitude/latitude rectangle in degrees, bounds inclusive.
+struct Rect {
+  static Rect from(std::string_view rawText);
+  bool contains(double x, double y) const {
+    return x >= mMinX && x <= mMaxX && y >= mMinY && y <= mMaxY;
+  }
+
+  double mMinX{-180.};
+  double mMinY{-90.};
+  double mMaxX{180.};
+  double mMaxY{90.};
+};
+
+struct Aggregate {
+  double mean() const { return mCount ? mSum / double(mCount) : 0.; }
+
+  std::uint64_t mCount{0};
+  double mSum{0};
+};
+
+using CliUtils::FileIdentity;
+
+// Quadtree over a Morton-ordered grid. Every pair lives in the smallest cell
+// that holds both of its endpoints, and pairs are sorted by the Morton code of
+// that cell, so any cell's subtree is a contiguous run whose count and sum
+// come straight from prefix sums. A rectangle query only has to look at the
+// pairs stored in cells that straddle the rectangle boundary.
+class Index {
+public:
+  static constexpr std::uint32_t DEPTH = 16;
+
+  static Index build(const MathUtils::CoordinatePairs<double> &pairs,
+                     std::span<const double> distances);
+  static std::optional<Index> load(std::string_view filename,
+                                   const FileIdentity &source);
+  void save(std::string_view filename, const FileIdentity &source) const;
+
+  Aggregate query(const Rect &rect) const;
+  Aggregate fullScan(const Rect &rect) const;
+  Aggregate total() const;
+  std::size_t size() const { return mKeys.size(); }
+
+private:
+  struct Node {
+    std::uint32_t mLevel;
+    std::uint32_t mX;
+    std::uint32_t mY;
+  };
+
+  void queryNode(const Node &node, const Rect &rect, Aggregate &out) const;
+  void scanRange(std::size_t begin, std::size_t end, const Rect &rect,
+                 Aggregate &out) const;
+  void computePrefixSums();
+
+  std::vector<std::uint64_t> mKeys;
+  MathUtils::CoordinatePairs<double> mPairs;
+  std::vector<double> mDistances;
+  std::vector<double> mPrefixSums;
+};
+
+} // namespace Haversine::SpatialIndex
@@ -0,0 +1,309 @@
+#include "alloc_profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <string_view>
+
+extern "C" {
+#include <fcntl.h>
+#include <malloc.h>
+#include <unistd.h>
+}
+
+namespace Haversine::AllocProfiler {
+
+namespace {
+// Constant-initialized, so allocations made by static constructors in other
+// translation units are safe.
+constinit std::atomic<bool> gEnabled{false};
+constinit std::atomic<std::uint64_t> gAllocations{0};
+constinit std::atomic<std::uint64_t> gFrees{0};
+constinit std::atomic<std::uint64_t> gBytesAllocated{0};
+constinit std::atomic<std::uint64_t> gBytesFreed{0};
+constinit std::atomic<std::int64_t> gLiveBytes{0};
+constinit std::atomic<std::int64_t> gPeakLiveBytes{0};
+constinit std::atomic<std::int64_t> gStagePeakBytes{0};
+constinit std::array<std::atomic<std::uint64_t>, SIZE_CLASSES> gSizeClasses{};
+
+void raisePeak(std::atomic<std::int64_t> &peak, std::int64_t live) {
+  auto current = peak.load(std::memory_order_relaxed);
+  while (live > current &&
+         !peak.compare_exchange_weak(current, live, std::memory_order_relaxed))
+    ;
+}
+
+void recordAllocation(void *ptr, std::size_t requested) {
+  if (!gEnabled.load(std::memory_order_relaxed))
+    return;
+  const auto usable = ::malloc_usable_size(ptr);
+  gAllocations.fetch_add(1, std::memory_order_relaxed);
+  gBytesAllocated.fetch_add(usable, std::memory_order_relaxed);
+  gSizeClasses[std::bit_width(requested)].fetch_add(1,
+                                                    std::memory_order_relaxed);
+  const auto live =
+      gLiveBytes.fetch_add(std::int64_t(usable), std::memory_order_relaxed) +
+      std::int64_t(usable);
+  raisePeak(gPeakLiveBytes, live);
+  raisePeak(gStagePeakBytes, live);
+}
+
+void recordFree(void *ptr) {
+  if (!ptr || !gEnabled.load(std::memory_order_relaxed))
+    return;
+  const auto usable = ::malloc_usable_size(ptr);
+  gFrees.fetch_add(1, std::memory_order_relaxed);
+  gBytesFreed.fetch_add(usable, std::memory_order_relaxed);
+  gLiveBytes.fetch_sub(std::int64_t(usable), std::memory_order_relaxed);
+}
+
+void *allocate(std::size_t requested, std::size_t alignment, bool nothrow) {
+  const auto size = std::max<std::size_t>(requested, 1);
+  while (true) {
+    void *ptr = nullptr;
+    if (alignment <= alignof(std::max_align_t))
+      ptr = std::malloc(size);
+    else if (::posix_memalign(&ptr, alignment, size) != 0)
+      ptr = nullptr;
+    if (ptr) {
+      recordAllocation(ptr, requested);
+      return ptr;
+    }
+    auto handler = std::get_new_handler();
+    if (!handler) {
+      if (nothrow)
+        return nullptr;
+      throw std::bad_alloc();
+    }
+    if (!nothrow) {
+      handler();
+      continue;
+    }
+    try {
+      handler();
+    } catch (const std::bad_alloc &) {
+      return nullptr;
+    }
+  }
+}
+
+void deallocate(void *ptr) {
+  recordFree(ptr);
+  std::free(ptr);
+}
+
+// "Vm" fields of /proc/self/status are in kB.
+std::uint64_t statusField(std::string_view status, std::string_view name) {
+  const auto position = status.find(name);
+  if (position == std::string_view::npos)
+    return 0;
+  std::uint64_t kiloBytes = 0;
+  for (auto i = position + name.size(); i < status.size(); ++i) {
+    const char c = status[i];
+    if (c == '\n')
+      break;
+    if (c >= '0' && c <= '9')
+      kiloBytes = kiloBytes * 10 + std::uint64_t(c - '0');
+  }
+  return kiloBytes * 1024;
+}
+
+void printMebibytes(CliUtils::IoBufferedWriter &out, double bytes) {
+  out.printNumber(bytes / (1024. * 1024.), std::chars_format::fixed, 2);
+  out.printSv(" MiB");
+}
+} // namespace
+
+void enable() {
+  gLiveBytes.store(0, std::memory_order_relaxed);
+  gPeakLiveBytes.store(0, std::memory_order_relaxed);
+  gStagePeakBytes.store(0, std::memory_order_relaxed);
+  gEnabled.store(true, std::memory_order_relaxed);
+}
+
+bool enabled() { return gEnabled.load(std::memory_order_relaxed); }
+
+Totals Totals::operator-(const Totals &rhs) const {
+  return Totals{.mAllocations = mAllocations - rhs.mAllocations,
+                .mFrees = mFrees - rhs.mFrees,
+                .mBytesAllocated = mBytesAllocated - rhs.mBytesAllocated,
+                .mBytesFreed = mBytesFreed - rhs.mBytesFreed};
+}
+
+Totals totals() {
+  return Totals{
+      .mAllocations = gAllocations.load(std::memory_order_relaxed),
+      .mFrees = gFrees.load(std::memory_order_relaxed),
+      .mBytesAllocated = gBytesAllocated.load(std::memory_order_relaxed),
+      .mBytesFreed = gBytesFreed.load(std::memory_order_relaxed)};
+}
+
+std::array<std::uint64_t, SIZE_CLASSES> sizeHistogram() {
+  std::array<std::uint64_t, SIZE_CLASSES> result;
+  for (std::size_t i = 0; i < SIZE_CLASSES; ++i)
+    result[i] = gSizeClasses[i].load(std::memory_order_relaxed);
+  return result;
+}
+
+std::int64_t liveBytes() { return gLiveBytes.load(std::memory_order_relaxed); }
+
+std::int64_t peakLiveBytes() {
+  return gPeakLiveBytes.load(std::memory_order_relaxed);
+}
+
+std::int64_t takeStagePeak() {
+  return gStagePeakBytes.exchange(liveBytes(), std::memory_order_relaxed);
+}
+
+MemoryStatus readMemoryStatus() {
+  // Read with plain syscalls into a stack buffer so that the report does not
+  // allocate.
+  MemoryStatus result;
+  const int fd = ::open("/proc/self/status", O_RDONLY);
+  if (fd == -1)
+    return result;
+  std::array<char, 4096> buffer;
+  std::size_t size = 0;
+  while (size < buffer.size()) {
+    const auto bytesRead =
+        ::read(fd, buffer.data() + size, buffer.size() - size);
+    if (bytesRead <= 0)
+      break;
+    size += std::size_t(bytesRead);
+  }
+  ::close(fd);
+  const std::string_view status(buffer.data(), size);
+  result.mRss = statusField(status, "VmRSS:");
+  result.mPeakRss = statusField(status, "VmHWM:");
+  result.mValid = result.mPeakRss != 0;
+  return result;
+}
+
+void report(CliUtils::IoBufferedWriter &out, std::uint64_t inputBytes) {
+  const auto all = totals();
+  const auto peak = peakLiveBytes();
+  out.printSv("Allocations: ");
+  out.printNumber(all.mAllocations);
+  out.printSv(" (");
+  printMebibytes(out, double(all.mBytesAllocated));
+  out.printSv("), frees: ");
+  out.printNumber(all.mFrees);
+  out.printSv(", live: ");
+  printMebibytes(out, double(liveBytes()));
+  out.printSv(", live high-water mark: ");
+  printMebibytes(out, double(peak));
+  out.printSv("\n");
+
+  const auto memory = readMemoryStatus();
+  if (memory.mValid) {
+    out.printSv("Peak RSS: ");
+    printMebibytes(out, double(memory.mPeakRss));
+    out.printSv(" (current ");
+    printMebibytes(out, double(memory.mRss));
+    out.printSv(")\n");
+  }
+  if (inputBytes != 0) {
+    out.printSv("RAM per input byte: heap ");
+    out.printNumber(double(peak) / double(inputBytes), std::chars_format::fixed,
+                    3);
+    if (memory.mValid) {
+      out.printSv(", RSS ");
+      out.printNumber(double(memory.mPeakRss) / double(inputBytes),
+                      std::chars_format::fixed, 3);
+    }
+    out.printSv("\n");
+  }
+
+  out.printSv("Allocation sizes:\n");
+  const auto histogram = sizeHistogram();
+  for (std::size_t i = 0; i < SIZE_CLASSES; ++i) {
+    if (histogram[i] == 0)
+      continue;
+    out.printSv("  ");
+    if (i == 0) {
+      out.printSv("0");
+    } else {
+      out.printNumber(std::uint64_t(1) << (i - 1));
+      out.printSv("-");
+      out.printNumber((std::uint64_t(2) << (i - 1)) - 1);
+    }
+    out.printSv(" bytes: ");
+    out.printNumber(histogram[i]);
+    out.printSv("\n");
+  }
+}
+
+} // namespace Haversine::AllocProfiler
+
+void *operator new(std::size_t size) {
+  return Haversine::AllocProfiler::allocate(size, 0, false);
+}
+void *operator new[](std::size_t size) {
+  return Haversine::AllocProfiler::allocate(size, 0, false);
+}
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return Haversine::AllocProfiler::allocate(size, 0, true);
+}
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return Haversine::AllocProfiler::allocate(size, 0, true);
+}
+void *operator new(std::size_t size, std::align_val_t alignment) {
+  return Haversine::AllocProfiler::allocate(size, std::size_t(alignment),
+                                            false);
+}
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+  return Haversine::AllocProfiler::allocate(size, std::size_t(alignment),
+                                            false);
+}
+void *operator new(std::size_t size, std::align_val_t alignment,
+                   const std::nothrow_t &) noexcept {
+  return Haversine::AllocProfiler::allocate(size, std::size_t(alignment),
+                                            true);
+}
+void *operator new[](std::size_t size, std::align_val_t alignment,
+                     const std::nothrow_t &) noexcept {
+  return Haversine::AllocProfiler::allocate(size, std::size_t(alignment),
+                                            true);
+}
+
+void operator delete(void *ptr) noexcept {
+  Haversine::AllocProfiler::deallocate(ptr);
+}
+void operator delete[](void *ptr) noexcept {
+  Haversine::AllocProfiler::deallocate(ptr);
+}
+void operator delete(void *ptr, std::size_t) noexcept {
+  Haversine::AllocProfiler::deallocate(ptr);
+}
+void operator delete[](void *ptr, std::size_t) noexcept {
+  Haversine::AllocProfiler::deallocate(ptr);
+}
+void operator delete(void *ptr, std::align_val_t) noexcept {
+  Haversine::AllocProfiler::deallocate(ptr);
+}
+void operator delete[](void *ptr, std::align_val_t) noexcept {
+  Haversine::AllocProfiler::deallocate(ptr);
+}
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept {
+  Haversine::AllocProfiler::deallocate(ptr);
+}
+void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept {
+  Haversine::AllocProfiler::deallocate(ptr);
+}
+void operator delete(void *ptr, const std::nothrow_t &) noexcept {
+  Haversine::AllocProfiler::deallocate(ptr);
+}
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept {
+  Haversine::AllocProfiler::deallocate(ptr);
+}
+void operator delete(void *ptr, std::align_val_t,
+                     const std::nothrow_t &) noexcept {
+  Haversine::AllocProfiler::deallocate(ptr);
+}
+void operator delete[](void *ptr, std::align_val_t,
+                       const std::nothrow_t &) noexcept {
+  Haversine::AllocProfiler::deallocate(ptr);
+}
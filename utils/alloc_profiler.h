@@ -0,0 +1,52 @@
+#pragma once
+
+#include "cli_utils.h"
+
+#include <array>
+#include <cstdint>
+
+namespace Haversine::AllocProfiler {
+
+// Linking alloc_profiler.cc replaces the global operator new and delete. They
+// only forward to malloc and free until enable() is called; from then on every
+// allocation and free is counted. Sizes are the usable sizes malloc reports,
+// so a free is matched exactly without a header in front of the block.
+void enable();
+bool enabled();
+
+// Bucket i counts requests of [2^(i-1), 2^i) bytes; bucket 0 is empty ones.
+constexpr std::size_t SIZE_CLASSES = 65;
+
+struct Totals {
+  Totals operator-(const Totals &rhs) const;
+
+  std::uint64_t mAllocations{0};
+  std::uint64_t mFrees{0};
+  std::uint64_t mBytesAllocated{0};
+  std::uint64_t mBytesFreed{0};
+};
+
+Totals totals();
+std::array<std::uint64_t, SIZE_CLASSES> sizeHistogram();
+
+// Live heap bytes since enable(); frees of older blocks can make it negative.
+std::int64_t liveBytes();
+// High-water mark of liveBytes() since enable().
+std::int64_t peakLiveBytes();
+// High-water mark since the last call, which restarts it at liveBytes().
+std::int64_t takeStagePeak();
+
+// VmRSS and VmHWM from /proc/self/status, in bytes.
+struct MemoryStatus {
+  bool mValid{false};
+  std::uint64_t mRss{0};
+  std::uint64_t mPeakRss{0};
+};
+
+MemoryStatus readMemoryStatus();
+
+// Totals, peaks, size histogram and, for a non-zero input size, RAM per input
+// byte.
+void report(CliUtils::IoBufferedWriter &out, std::uint64_t inputBytes);
+
+} // namespace Haversine::AllocProfiler
@@ -0,0 +1,250 @@
+#include "chunk_index.h"
+#include "cpu_dispatch.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+extern "C" {
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+namespace Haversine::ChunkIndex {
+
+namespace {
+constexpr std::array<char, 8> CHUNK_INDEX_MAGIC{'H', 'V', 'C', 'I',
+                                                'D', 'X', '0', '1'};
+
+struct ChunkIndexHeader {
+  std::array<char, 8> mMagic;
+  CliUtils::FileIdentity mSource;
+  std::uint64_t mStride;
+  std::uint64_t mEntryCount;
+};
+
+bool isWhitespace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+void writeAll(int fileDescriptor, const void *data, std::size_t size) {
+  const auto *bytes = static_cast<const char *>(data);
+  while (size > 0) {
+    auto r = ::write(fileDescriptor, bytes, size);
+    if (r < 0)
+      throw std::runtime_error("Unable to write chunk index");
+    bytes += r;
+    size -= std::size_t(r);
+  }
+}
+
+bool readAll(int fileDescriptor, void *data, std::size_t size) {
+  auto *bytes = static_cast<char *>(data);
+  while (size > 0) {
+    auto r = ::read(fileDescriptor, bytes, size);
+    if (r <= 0)
+      return false;
+    bytes += r;
+    size -= std::size_t(r);
+  }
+  return true;
+}
+
+// Offset of the quote closing the string opened at `open`, or text.size().
+std::uint64_t stringEnd(std::string_view text, std::uint64_t open) {
+  const auto findStringSpecial = CpuDispatch::kernels().mFindStringSpecial;
+  auto position = open + 1;
+  while (position < text.size()) {
+    position +=
+        findStringSpecial(text.data() + position, text.size() - position);
+    if (position < text.size() && text[position] == '"')
+      return position;
+    position += position < text.size() && text[position] == '\\' ? 2 : 1;
+  }
+  return text.size();
+}
+
+// Entries must be the ones scan() would produce for a file of `size` bytes.
+bool isConsistent(const Index &index, std::uint64_t size) {
+  const auto &entries = index.mEntries;
+  if (index.mStride == 0 || entries.empty())
+    return false;
+  for (std::size_t i = 0; i + 1 < entries.size(); ++i) {
+    if (entries[i].mOrdinal != i * index.mStride ||
+        entries[i].mOffset > entries[i + 1].mOffset)
+      return false;
+  }
+  const auto &last = entries.back();
+  return last.mOffset <= size &&
+         entries.size() - 1 ==
+             (last.mOrdinal + index.mStride - 1) / index.mStride;
+}
+} // namespace
+
+std::optional<std::uint64_t> findPairsArray(std::string_view text) {
+  constexpr std::string_view KEY = "\"pairs\"";
+  std::uint64_t position = 0;
+  auto skipWhitespace = [&] {
+    while (position < text.size() && isWhitespace(text[position]))
+      ++position;
+  };
+  skipWhitespace();
+  if (position == text.size() || text[position] != '{')
+    return std::nullopt;
+  ++position;
+  std::uint64_t depth = 1;
+  // Inside the root object, the next string is a member name.
+  bool expectName = true;
+  while (position < text.size()) {
+    const char c = text[position];
+    if (c == '"') {
+      const auto open = position;
+      position = stringEnd(text, open);
+      if (position == text.size())
+        return std::nullopt;
+      ++position;
+      if (depth != 1 || !expectName)
+        continue;
+      const bool isPairs = text.substr(open, position - open) == KEY;
+      skipWhitespace();
+      if (position == text.size() || text[position] != ':')
+        return std::nullopt;
+      ++position;
+      expectName = false;
+      if (!isPairs)
+        continue;
+      // The first "pairs" member is the one the parser returns.
+      skipWhitespace();
+      if (position == text.size() || text[position] != '[')
+        return std::nullopt;
+      return position + 1;
+    }
+    if (c == '{' || c == '[') {
+      ++depth;
+    } else if (c == '}' || c == ']') {
+      if (--depth == 0)
+        return std::nullopt;
+    } else if (c == ',' && depth == 1) {
+      expectName = true;
+    }
+    ++position;
+  }
+  return std::nullopt;
+}
+
+std::optional<Index> Index::scan(std::string_view text, std::uint64_t stride) {
+  const auto arrayOffset = findPairsArray(text);
+  if (!arrayOffset)
+    return std::nullopt;
+  auto position = *arrayOffset;
+
+  Index result{.mStride = std::max<std::uint64_t>(stride, 1)};
+  std::uint64_t elementEnd = position;
+  std::uint64_t ordinal = 0;
+  std::uint64_t depth = 0;
+  bool inElement = false;
+  for (; position < text.size(); ++position) {
+    const char c = text[position];
+    if (isWhitespace(c))
+      continue;
+    if (depth == 0) {
+      if (c == ',') {
+        inElement = false;
+        continue;
+      }
+      if (c == ']') {
+        result.mEntries.push_back({elementEnd, ordinal});
+        return result;
+      }
+      if (!inElement) {
+        if (ordinal % result.mStride == 0)
+          result.mEntries.push_back({elementEnd, ordinal});
+        ++ordinal;
+        inElement = true;
+      }
+    }
+    if (c == '"') {
+      // Strings may hold brackets and commas; skip to the closing quote.
+      position = stringEnd(text, position);
+      if (position >= text.size())
+        break;
+    } else if (c == '{' || c == '[') {
+      ++depth;
+    } else if (c == '}' || c == ']') {
+      if (depth == 0)
+        break;
+      --depth;
+    }
+    elementEnd = position + 1;
+  }
+  return std::nullopt;
+}
+
+std::optional<Index> Index::load(std::string_view filename,
+                                 const CliUtils::FileIdentity &source) {
+  std::string path{filename};
+  auto fd = ::open(path.c_str(), O_RDONLY);
+  if (fd == -1)
+    return std::nullopt;
+  CliUtils::FileHandle handle{
+      .mIsOpen = true, .mNeedsClosing = true, .mFileDescriptor = fd};
+
+  ChunkIndexHeader header{};
+  if (!readAll(fd, &header, sizeof(header)) ||
+      header.mMagic != CHUNK_INDEX_MAGIC || !(header.mSource == source))
+    return std::nullopt;
+  Index result{.mStride = header.mStride};
+  // Bounded by the size of the sidecar, so a corrupt count cannot allocate
+  // more than the file holds.
+  struct stat info {};
+  if (::fstat(fd, &info) != 0 ||
+      header.mEntryCount != (std::uint64_t(info.st_size) - sizeof(header)) /
+                                sizeof(Entry))
+    return std::nullopt;
+  result.mEntries.resize(header.mEntryCount);
+  if (!readAll(fd, result.mEntries.data(),
+               result.mEntries.size() * sizeof(Entry)) ||
+      !isConsistent(result, source.mSize))
+    return std::nullopt;
+  return result;
+}
+
+void Index::save(std::string_view filename,
+                 const CliUtils::FileIdentity &source) const {
+  auto file = CliUtils::FileHandle::open(filename, O_WRONLY | O_CREAT | O_TRUNC,
+                                         S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  const ChunkIndexHeader header{.mMagic = CHUNK_INDEX_MAGIC,
+                                .mSource = source,
+                                .mStride = mStride,
+                                .mEntryCount = mEntries.size()};
+  writeAll(file.mFileDescriptor, &header, sizeof(header));
+  writeAll(file.mFileDescriptor, mEntries.data(),
+           mEntries.size() * sizeof(Entry));
+}
+
+std::pair<std::uint64_t, std::uint64_t>
+Index::chunksOf(std::uint64_t begin, std::uint64_t end) const {
+  if (begin >= end)
+    return {0, 0};
+  return {begin / mStride,
+          std::min((end + mStride - 1) / mStride, chunkCount())};
+}
+
+std::string chunkDocument(std::string_view chunkBytes) {
+  std::size_t skip = 0;
+  while (skip < chunkBytes.size() && isWhitespace(chunkBytes[skip]))
+    ++skip;
+  if (skip < chunkBytes.size() && chunkBytes[skip] == ',')
+    ++skip;
+  constexpr std::string_view HEADER = "{\"pairs\":[";
+  constexpr std::string_view FOOTER = "]}";
+  std::string document;
+  document.reserve(HEADER.size() + chunkBytes.size() - skip + FOOTER.size());
+  document.append(HEADER);
+  document.append(chunkBytes.substr(skip));
+  document.append(FOOTER);
+  return document;
+}
+
+} // namespace Haversine::ChunkIndex
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "cli_utils.h"
+#include "math_utils.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace Haversine::ChunkIndex {
+
+// Pairs per indexed chunk; whole SUM_CHUNK_PAIRS chunks, so a chunk boundary
+// never splits a partial sum.
+constexpr std::uint64_t STRIDE_PAIRS = 16384;
+static_assert(STRIDE_PAIRS % MathUtils::SUM_CHUNK_PAIRS == 0);
+
+// Chunk i holds pairs [mOrdinal, next mOrdinal) of the "pairs" array, written
+// from mOffset up to the next entry's. mOffset is the end of the element
+// before the chunk, or the first byte after the '[', so a chunk's bytes are
+// its elements with their leading separators.
+struct Entry {
+  std::uint64_t mOffset;
+  std::uint64_t mOrdinal;
+};
+
+// Sidecar (<filename>.hvci) that lets a document be split into exact pair
+// ranges without a boundary search: one entry every mStride pairs, followed
+// by one for the end of the last pair whose ordinal is the pair count.
+struct Index {
+  // One pass over the document tracking nesting and strings; nullopt when
+  // the root object has no well-formed "pairs" array.
+  static std::optional<Index> scan(std::string_view text,
+                                   std::uint64_t stride = STRIDE_PAIRS);
+  static std::optional<Index> load(std::string_view filename,
+                                   const CliUtils::FileIdentity &source);
+  void save(std::string_view filename,
+            const CliUtils::FileIdentity &source) const;
+
+  std::uint64_t pairCount() const { return mEntries.back().mOrdinal; }
+  std::uint64_t chunkCount() const { return mEntries.size() - 1; }
+  // [first, last) chunks holding pairs [begin, end); end <= pairCount().
+  std::pair<std::uint64_t, std::uint64_t> chunksOf(std::uint64_t begin,
+                                                   std::uint64_t end) const;
+
+  std::uint64_t mStride{STRIDE_PAIRS};
+  std::vector<Entry> mEntries;
+};
+
+// First byte after the '[' of the root object's "pairs" member, or nullopt
+// when the root is not an object or that member is missing or not an array.
+// A "pairs" in a string or a nested object is never taken for it. Only
+// reads up to the '[', so a prefix of the document is enough.
+std::optional<std::uint64_t> findPairsArray(std::string_view text);
+
+// A chunk's bytes, from its entry's offset to the next one's, as a
+// {"pairs":[...]} document of their own.
+std::string chunkDocument(std::string_view chunkBytes);
+
+} // namespace Haversine::ChunkIndex
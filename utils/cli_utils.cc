@@ -1,4 +1,5 @@
 #include "cli_utils.h"
+#include "trace.h"
 
 #include <iterator>
 
@@ -59,6 +60,18 @@ std::uint64_t coordinatePairsFrom(std::string_view rawText) {
   return u64From(rawText, "Invalid number of coordinate pairs: ");
 }
 
+double doubleFrom(std::string_view rawText, std::string_view errMsgPrefix) {
+  double value{0};
+  auto [ptr, ec] =
+      std::from_chars(rawText.data(), rawText.data() + rawText.size(), value);
+  if (ec != std::errc() || ptr != rawText.data() + rawText.size()) {
+    std::string errorMessage{errMsgPrefix};
+    errorMessage.append(rawText);
+    throw std::runtime_error(errorMessage);
+  }
+  return value;
+}
+
 void print(std::string_view text, int fileDescriptor) {
   auto r = write(fileDescriptor, text.data(), text.size());
   if (r != text.size()) {
@@ -66,6 +79,58 @@ void print(std::string_view text, int fileDescriptor) {
   }
 }
 
+CommandLineOptions CommandLineOptions::from(int argc, const char *argv[],
+                                            int firstIndex) {
+  CommandLineOptions result;
+  for (int i = firstIndex; i < argc; ++i) {
+    std::string_view arg{argv[i]};
+    if (!arg.starts_with("--")) {
+      std::string errorMessage{"Unexpected argument: "};
+      errorMessage.append(arg);
+      throw std::runtime_error(errorMessage);
+    }
+    result.mArgs.push_back(arg.substr(2));
+  }
+  return result;
+}
+
+bool CommandLineOptions::has(std::string_view name) const {
+  for (auto arg : mArgs) {
+    if (arg == name ||
+        (arg.starts_with(name) && arg.size() > name.size() &&
+         arg[name.size()] == '='))
+      return true;
+  }
+  return false;
+}
+
+std::optional<std::string_view>
+CommandLineOptions::value(std::string_view name) const {
+  for (auto arg : mArgs) {
+    if (arg.starts_with(name) && arg.size() > name.size() &&
+        arg[name.size()] == '=')
+      return arg.substr(name.size() + 1);
+  }
+  return std::nullopt;
+}
+
+std::vector<std::string_view>
+CommandLineOptions::list(std::string_view name, char separator) const {
+  std::vector<std::string_view> result;
+  auto raw = value(name);
+  if (!raw)
+    return result;
+  auto text = *raw;
+  while (!text.empty()) {
+    auto end = text.find(separator);
+    result.push_back(text.substr(0, end));
+    if (end == std::string_view::npos)
+      break;
+    text.remove_prefix(end + 1);
+  }
+  return result;
+}
+
 FileHandle::~FileHandle() {
   if (mIsOpen && mNeedsClosing) {
     ::close(mFileDescriptor);
@@ -73,6 +138,16 @@ FileHandle::~FileHandle() {
   }
 }
 
+FileIdentity FileIdentity::of(int fileDescriptor) {
+  struct stat info {};
+  if (::fstat(fileDescriptor, &info) != 0)
+    throw std::runtime_error("Unable to stat input file");
+  return FileIdentity{.mSize = std::uint64_t(info.st_size),
+                      .mModifiedNs = std::int64_t(info.st_mtim.tv_sec) *
+                                         1000000000LL +
+                                     info.st_mtim.tv_nsec};
+}
+
 IoBufferedWriter::IoBufferedWriter(FileHandle &fileHandle)
     : mFileHandle(&fileHandle) {}
 
@@ -84,6 +159,7 @@ IoBufferedWriter::~IoBufferedWriter() {
 }
 
 void IoBufferedWriter::printSv(std::string_view text) {
+  mBytesWritten += text.size();
   auto copySize = std::min(BUFFER_CAPACITY - mSize, text.size());
   while (copySize > 0) {
     std::memcpy(mBuffer.data() + mSize, text.data(), copySize);
@@ -100,6 +176,7 @@ void IoBufferedWriter::printStr(const std::string &text) {
 }
 
 void IoBufferedWriter::printBin(std::span<std::byte> data) {
+  mBytesWritten += data.size();
   auto copySize = std::min(BUFFER_CAPACITY - mSize, data.size());
   while (copySize > 0) {
     std::memcpy(mBuffer.data() + mSize, data.data(), copySize);
@@ -112,6 +189,9 @@ void IoBufferedWriter::printBin(std::span<std::byte> data) {
 }
 
 void IoBufferedWriter::flush() {
+  if (mSize == 0)
+    return;
+  Trace::Scope scope{"flush", mSize};
   ssize_t alreadyWritten = 0;
   for (;;) {
     if (mSize == 0)
@@ -1,15 +1,18 @@
 #pragma once
 
+#include <array>
 #include <charconv>
 #include <concepts>
 #include <cstring>
 #include <functional>
+#include <optional>
 #include <random>
 #include <span>
 #include <stdexcept>
 #include <string>
 #include <string_view>
 #include <tuple>
+#include <vector>
 
 extern "C" {
 #include <fcntl.h>
@@ -143,8 +146,24 @@ std::string u64ToStr(std::uint64_t val);
 std::uint64_t randomSeedFrom(std::string_view rawText);
 std::uint64_t coordinatePairsFrom(std::string_view rawText);
 
+double doubleFrom(std::string_view rawText, std::string_view errMsgPrefix);
+
 void print(std::string_view text, int fileDescriptor = STDOUT_FILENO);
 
+// Optional "--name" / "--name=value" arguments that follow the positional
+// arguments handled by CliHelper.
+struct CommandLineOptions {
+  static CommandLineOptions from(int argc, const char *argv[],
+                                 int firstIndex);
+
+  bool has(std::string_view name) const;
+  std::optional<std::string_view> value(std::string_view name) const;
+  std::vector<std::string_view> list(std::string_view name,
+                                     char separator = ',') const;
+
+  std::vector<std::string_view> mArgs;
+};
+
 struct FileHandle {
 
   template <typename... Args>
@@ -156,6 +175,16 @@ struct FileHandle {
   int mFileDescriptor{0};
 };
 
+// Size and modification time; sidecars written for one version of a file
+// are ignored once it changes.
+struct FileIdentity {
+  static FileIdentity of(int fileDescriptor);
+  bool operator==(const FileIdentity &) const = default;
+
+  std::uint64_t mSize{0};
+  std::int64_t mModifiedNs{0};
+};
+
 struct IoBufferedWriter {
   static constexpr std::size_t BUFFER_CAPACITY = 4096;
 
@@ -174,6 +203,7 @@ struct IoBufferedWriter {
   void flush();
 
   FileHandle *mFileHandle{nullptr};
+  std::uint64_t mBytesWritten{0};
   std::uint16_t mSize{0};
   std::array<std::byte, BUFFER_CAPACITY> mBuffer;
 };
@@ -0,0 +1,286 @@
+#include "corpus_format.h"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <stdexcept>
+
+namespace Haversine::CorpusFormat {
+
+namespace {
+constexpr std::uint32_t NUMBER_FEATURES = PRECISION | EXPONENT | INTEGER;
+constexpr std::uint32_t LAYOUT_FEATURES = PRETTY | MINIFIED;
+
+enum Member : std::uint8_t { X0, Y0, X1, Y1, ID, LABEL, META };
+constexpr std::array<std::string_view, 4> COORDINATE_KEYS{"x0", "y0", "x1",
+                                                          "y1"};
+
+// splitmix64, seeded per pair.
+struct PairRandom {
+  std::uint64_t next() {
+    mState += 0x9E3779B97F4A7C15ULL;
+    auto z = mState;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+
+  std::uint64_t mState;
+};
+
+Feature featureFrom(std::string_view rawText) {
+  for (std::size_t i = 0; i < FEATURE_NAMES.size(); ++i) {
+    if (FEATURE_NAMES[i] == rawText)
+      return Feature(1U << i);
+  }
+  std::string errorMessage = "Unrecognized corpus feature: ";
+  errorMessage.append(rawText);
+  throw std::runtime_error(errorMessage);
+}
+
+class PairWriter {
+public:
+  PairWriter(std::string &out, std::uint32_t features, PairRandom random)
+      : mOut{out}, mFeatures{features}, mRandom{random} {}
+
+  // Only the pretty layout breaks lines inside a pair.
+  void lineBreak(int depth) {
+    if (!(mFeatures & PRETTY))
+      return;
+    mOut.append(mFeatures & CRLF ? "\r\n" : "\n");
+    mOut.append(std::size_t(2 * depth), ' ');
+  }
+
+  void key(std::string_view name) {
+    mOut += '"';
+    mOut.append(name);
+    mOut.append(mFeatures & PRETTY ? "\": " : "\":");
+  }
+
+  void unsignedNumber(std::uint64_t value) {
+    std::array<char, 24> buffer;
+    auto [ptr, ec] =
+        std::to_chars(buffer.data(), buffer.data() + buffer.size(), value);
+    mOut.append(buffer.data(), ptr);
+  }
+
+  // Returns the value as parsed back from the text.
+  double coordinate(double value) {
+    std::array<char, 32> buffer;
+    const auto first = buffer.data();
+    const auto last = buffer.data() + buffer.size();
+    if (mFeatures & INTEGER) {
+      const auto rounded = std::int64_t(std::round(value));
+      auto [ptr, ec] = std::to_chars(first, last, rounded);
+      mOut.append(first, ptr);
+      return double(rounded);
+    }
+    if (mFeatures & EXPONENT) {
+      // 17 significant digits read back exactly.
+      auto [ptr, ec] =
+          std::to_chars(first, last, value, std::chars_format::scientific, 16);
+      if (mRandom.next() & 1)
+        std::replace(first, ptr, 'e', 'E');
+      mOut.append(first, ptr);
+      return value;
+    }
+    const int precision =
+        mFeatures & PRECISION ? 1 + int(mRandom.next() % 16) : 16;
+    auto [ptr, ec] =
+        std::to_chars(first, last, value, std::chars_format::fixed, precision);
+    mOut.append(first, ptr);
+    if (!(mFeatures & PRECISION))
+      return value;
+    double parsed = 0;
+    std::from_chars(first, ptr, parsed);
+    return parsed;
+  }
+
+  void label(std::uint64_t index) {
+    if (!(mFeatures & ESCAPED)) {
+      mOut.append("\"pair ");
+      unsignedNumber(index);
+      mOut += '"';
+      return;
+    }
+    mOut.append(R"("pair \")");
+    unsignedNumber(index);
+    mOut.append(R"(\"\tcaf\u00e9 na)"
+                "\xC3\xAF"
+                R"(ve \ud83c\udf0d C:\\data\/x\r\n")");
+  }
+
+  void meta(std::uint64_t index) {
+    mOut += '{';
+    lineBreak(4);
+    key("source");
+    mOut.append("\"haversine_input_generator\",");
+    lineBreak(4);
+    key("cluster");
+    unsignedNumber(index % 64);
+    mOut += ',';
+    lineBreak(4);
+    key("tags");
+    mOut += '[';
+    lineBreak(5);
+    mOut.append("\"synthetic\",");
+    lineBreak(5);
+    mOut.append("\"pair\"");
+    lineBreak(4);
+    mOut.append("],");
+    lineBreak(4);
+    key("quality");
+    std::array<char, 16> buffer;
+    auto [ptr, ec] = std::to_chars(
+        buffer.data(), buffer.data() + buffer.size(),
+        double(mRandom.next() % 1000) / 1000., std::chars_format::fixed, 3);
+    mOut.append(buffer.data(), ptr);
+    mOut += ',';
+    lineBreak(4);
+    key("verified");
+    mOut.append(mRandom.next() & 1 ? "true," : "false,");
+    lineBreak(4);
+    key("note");
+    mOut.append("null");
+    lineBreak(3);
+    mOut += '}';
+  }
+
+  PairRandom &random() { return mRandom; }
+
+private:
+  std::string &mOut;
+  std::uint32_t mFeatures;
+  PairRandom mRandom;
+};
+} // namespace
+
+Format Format::from(const CliUtils::CommandLineOptions &options,
+                    std::uint64_t seed) {
+  std::uint32_t features = 0;
+  for (auto name : options.list("corpus"))
+    features |= featureFrom(name);
+  return of(features, seed);
+}
+
+Format Format::of(std::uint32_t features, std::uint64_t seed) {
+  if (std::popcount(features & NUMBER_FEATURES) > 1)
+    throw std::runtime_error(
+        "Conflicting corpus features: pick one of precision, exponent and "
+        "integer");
+  if (std::popcount(features & LAYOUT_FEATURES) > 1)
+    throw std::runtime_error(
+        "Conflicting corpus features: pick one of pretty and minified");
+  if ((features & NDJSON) && (features & PRETTY))
+    throw std::runtime_error(
+        "Conflicting corpus features: ndjson needs every pair on one line");
+  return Format{.mFeatures = features, .mSeed = seed};
+}
+
+std::string Format::name() const {
+  if (mFeatures == 0)
+    return "flex";
+  std::string result;
+  for (std::size_t i = 0; i < FEATURE_NAMES.size(); ++i) {
+    if (!(mFeatures & (1U << i)))
+      continue;
+    if (!result.empty())
+      result += '-';
+    result.append(FEATURE_NAMES[i]);
+  }
+  return result;
+}
+
+std::string_view Format::extension() const {
+  return mFeatures & NDJSON ? ".ndjson" : ".json";
+}
+
+void Format::appendHeader(std::string &out) const {
+  if (mFeatures & NDJSON)
+    return;
+  if (mFeatures & PRETTY) {
+    out.append(mFeatures & CRLF ? "{\r\n  \"pairs\": ["
+                                : "{\n  \"pairs\": [");
+    return;
+  }
+  out.append("{\"pairs\":[");
+}
+
+void Format::appendFooter(std::string &out) const {
+  const std::string_view eol = mFeatures & CRLF ? "\r\n" : "\n";
+  if (mFeatures & NDJSON)
+    return;
+  if (mFeatures & MINIFIED) {
+    out.append("]}");
+    return;
+  }
+  out.append(eol);
+  out.append(mFeatures & PRETTY ? "  ]" : "]");
+  if (mFeatures & PRETTY)
+    out.append(eol);
+  out += '}';
+  out.append(eol);
+}
+
+void Format::appendPair(std::string &out, std::uint64_t index,
+                        std::array<double, 4> &coordinates) const {
+  const PairRandom random{.mState = mSeed ^ (index * 0xD1B54A32D192ED03ULL)};
+  PairWriter writer{out, mFeatures, random};
+  // NDJSON pairs end their own line instead of starting one.
+  if (!(mFeatures & NDJSON) && index != 0)
+    out += ',';
+  if (mFeatures & PRETTY) {
+    out.append(mFeatures & CRLF ? "\r\n    " : "\n    ");
+  } else if (!(mFeatures & (MINIFIED | NDJSON))) {
+    out.append(mFeatures & CRLF ? "\r\n" : "\n");
+  }
+  out += '{';
+
+  std::array<Member, 7> members{X0, Y0, X1, Y1};
+  std::size_t memberCount = 4;
+  if (mFeatures & EXTRA)
+    members[memberCount++] = ID;
+  if (mFeatures & (EXTRA | ESCAPED))
+    members[memberCount++] = LABEL;
+  if (mFeatures & NESTED)
+    members[memberCount++] = META;
+  if (mFeatures & SHUFFLED) {
+    for (auto i = memberCount - 1; i > 0; --i)
+      std::swap(members[i], members[writer.random().next() % (i + 1)]);
+  }
+
+  for (std::size_t i = 0; i < memberCount; ++i) {
+    if (i != 0)
+      out += ',';
+    writer.lineBreak(3);
+    const auto member = members[i];
+    switch (member) {
+    case X0:
+    case Y0:
+    case X1:
+    case Y1:
+      writer.key(COORDINATE_KEYS[member]);
+      coordinates[member] = writer.coordinate(coordinates[member]);
+      break;
+    case ID:
+      writer.key("id");
+      writer.unsignedNumber(index);
+      break;
+    case LABEL:
+      writer.key("label");
+      writer.label(index);
+      break;
+    case META:
+      writer.key("meta");
+      writer.meta(index);
+      break;
+    }
+  }
+  writer.lineBreak(2);
+  out += '}';
+  if (mFeatures & NDJSON)
+    out.append(mFeatures & CRLF ? "\r\n" : "\n");
+}
+
+} // namespace Haversine::CorpusFormat
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "cli_utils.h"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace Haversine::CorpusFormat {
+
+// Each feature changes one aspect of how the same pairs are written; any
+// combination may be selected, except more than one number format or
+// layout.
+enum Feature : std::uint32_t {
+  // Key order shuffled per pair.
+  SHUFFLED = 1 << 0,
+  // "id" and "label" members the processor ignores.
+  EXTRA = 1 << 1,
+  // A "meta" object holding a string, numbers, an array, a bool and null.
+  NESTED = 1 << 2,
+  // Escape sequences and raw UTF-8 in "label"; implies the member.
+  ESCAPED = 1 << 3,
+  // Between 1 and 16 decimals per value.
+  PRECISION = 1 << 4,
+  // 17 significant digits in exponent notation, with 'e' or 'E'.
+  EXPONENT = 1 << 5,
+  // Coordinates rounded to whole degrees.
+  INTEGER = 1 << 6,
+  // Indented, one member per line.
+  PRETTY = 1 << 7,
+  // No whitespace at all.
+  MINIFIED = 1 << 8,
+  // "\r\n" line endings.
+  CRLF = 1 << 9,
+  // Newline-delimited: one pair object per line and no enclosing document.
+  NDJSON = 1 << 10
+};
+
+constexpr std::array<std::string_view, 11> FEATURE_NAMES{
+    "shuffled", "extra",  "nested",   "escaped", "precision", "exponent",
+    "integer",  "pretty", "minified", "crlf",    "ndjson"};
+
+struct Format {
+  // From --corpus=feature,...; without it, the "flex" layout of one pair per
+  // line with fixed keys and 16 decimals.
+  static Format from(const CliUtils::CommandLineOptions &options,
+                     std::uint64_t seed);
+  // Throws for conflicting features.
+  static Format of(std::uint32_t features, std::uint64_t seed);
+
+  // "flex", or the selected feature names joined by '-'.
+  std::string name() const;
+  // ".ndjson" or ".json".
+  std::string_view extension() const;
+
+  void appendHeader(std::string &out) const;
+  void appendFooter(std::string &out) const;
+  // Appends pair `index` of the array. Coordinates are rounded to the values
+  // a parser reads back from the text, so answers match the corpus.
+  void appendPair(std::string &out, std::uint64_t index,
+                  std::array<double, 4> &coordinates) const;
+
+  std::uint32_t mFeatures{0};
+  // Choices made per pair (key order, precision, exponent letter) derive
+  // from the seed and the pair index only.
+  std::uint64_t mSeed{0};
+};
+
+// FNV-1a over everything written, so benchmark inputs can be identified.
+struct Checksum {
+  void add(std::string_view bytes) {
+    for (unsigned char c : bytes) {
+      mHash ^= c;
+      mHash *= 0x100000001B3ULL;
+    }
+  }
+
+  std::uint64_t mHash{0xCBF29CE484222325ULL};
+};
+
+} // namespace Haversine::CorpusFormat
@@ -0,0 +1,113 @@
+#include "cpu_dispatch.h"
+
+#include <cpuid.h>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+namespace Haversine::CpuDispatch {
+
+namespace {
+std::uint64_t readXcr0() {
+  std::uint32_t eax = 0;
+  std::uint32_t edx = 0;
+  __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return (std::uint64_t(edx) << 32) | eax;
+}
+
+Selection makeSelection() {
+  Selection result{};
+  result.mDetected = detectIsa();
+  result.mSelected = result.mDetected;
+  if (const char *forced = std::getenv(ISA_ENVIRONMENT_VARIABLE.data())) {
+    const auto requested = isaFrom(forced);
+    result.mForced = true;
+    if (requested <= result.mDetected)
+      result.mSelected = requested;
+    else
+      result.mForcedUnsupported = true;
+  }
+  return result;
+}
+} // namespace
+
+Isa isaFrom(std::string_view rawText) {
+  if (rawText == "sse2")
+    return Isa::SSE2;
+  if (rawText == "avx2")
+    return Isa::AVX2;
+  if (rawText == "avx512")
+    return Isa::AVX512;
+
+  std::string errorMessage = "Unrecognized instruction set: ";
+  errorMessage.append(rawText);
+  throw std::runtime_error(errorMessage);
+}
+
+std::string_view isaToStrView(Isa isa) {
+  switch (isa) {
+  case Isa::SSE2: {
+    return "sse2";
+  } break;
+  case Isa::AVX2: {
+    return "avx2";
+  } break;
+  case Isa::AVX512: {
+    return "avx512";
+  } break;
+  default:
+    break;
+  }
+  std::string errorMessage = "Invalid value for instruction set: ";
+  errorMessage.append(std::to_string(int(isa)));
+  throw std::runtime_error(errorMessage);
+}
+
+Isa detectIsa() {
+  std::uint32_t eax = 0, ebx = 0, ecx = 0, edx = 0;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return Isa::SSE2;
+  const bool osxsave = ecx & bit_OSXSAVE;
+  const bool avx = ecx & bit_AVX;
+  const bool fma = ecx & bit_FMA;
+  if (!osxsave || !avx)
+    return Isa::SSE2;
+
+  const auto xcr0 = readXcr0();
+  const bool ymmState = (xcr0 & 0x6) == 0x6;
+  const bool zmmState = (xcr0 & 0xE6) == 0xE6;
+
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+    return Isa::SSE2;
+  const bool avx2 = ebx & bit_AVX2;
+  const bool avx512 =
+      (ebx & bit_AVX512F) && (ebx & bit_AVX512BW) && (ebx & bit_AVX512VL);
+
+  if (avx512 && avx2 && fma && zmmState)
+    return Isa::AVX512;
+  if (avx2 && fma && ymmState)
+    return Isa::AVX2;
+  return Isa::SSE2;
+}
+
+const Selection &selection() {
+  static const Selection result = makeSelection();
+  return result;
+}
+
+const KernelTable &kernels() {
+  static const KernelTable &result = []() -> const KernelTable & {
+    switch (selection().mSelected) {
+    case Isa::AVX512:
+      return AVX512_KERNELS;
+    case Isa::AVX2:
+      return AVX2_KERNELS;
+    case Isa::SSE2:
+    default:
+      return SSE2_KERNELS;
+    }
+  }();
+  return result;
+}
+
+} // namespace Haversine::CpuDispatch
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace Haversine::CpuDispatch {
+
+enum class Isa : std::uint8_t { SSE2, AVX2, AVX512 };
+
+constexpr std::string_view ISA_ENVIRONMENT_VARIABLE = "HAVERSINE_ISA";
+
+Isa isaFrom(std::string_view rawText);
+std::string_view isaToStrView(Isa isa);
+
+// Best variant the CPU and OS support (cpuid + xgetbv).
+Isa detectIsa();
+
+// State of RANDOM_LANES interleaved xoshiro256+ generators, one column per
+// lane. Every variant advances all lanes, so the sequence does not depend on
+// the selected instruction set.
+constexpr std::size_t RANDOM_LANES = 8;
+struct RandomLanes {
+  alignas(64) std::uint64_t mState[4][RANDOM_LANES];
+};
+
+// Sum, extremes and sum of squared deviations from the block mean.
+struct BlockMoments {
+  double mSum;
+  double mMin;
+  double mMax;
+  double mM2;
+};
+
+struct KernelTable {
+  Isa mIsa;
+  void (*mHaversineF64)(const double *x0, const double *y0, const double *x1,
+                        const double *y1, double *out, std::size_t count,
+                        double earthRadius);
+  void (*mHaversineF32)(const float *x0, const float *y0, const float *x1,
+                        const float *y1, float *out, std::size_t count,
+                        float earthRadius);
+  // mHaversineF64, except that pairs whose latitude and longitude differ by
+  // at most maxSpan radians use the equirectangular approximation. Returns
+  // how many did.
+  std::size_t (*mHaversineAdaptiveF64)(const double *x0, const double *y0,
+                                       const double *x1, const double *y1,
+                                       double *out, std::size_t count,
+                                       double earthRadius, double maxSpan);
+  // Distances from one point to `count` others. Coordinates are in radians,
+  // with cos(latitude) precomputed for every point.
+  void (*mHaversineRowF64)(double lat, double lon, double cosLat,
+                           const double *lats, const double *lons,
+                           const double *cosLats, double *out,
+                           std::size_t count, double earthRadius);
+  void (*mHaversineRowF32)(float lat, float lon, float cosLat,
+                           const float *lats, const float *lons,
+                           const float *cosLats, float *out, std::size_t count,
+                           float earthRadius);
+  // Number of leading ' ', '\t', '\n' and '\r' bytes.
+  std::size_t (*mSkipWhitespace)(const char *text, std::size_t size);
+  // Offset of the first '"', '\\' or control character, or size.
+  std::size_t (*mFindStringSpecial)(const char *text, std::size_t size);
+  // Offset of the first '\n', or size.
+  std::size_t (*mFindNewline)(const char *text, std::size_t size);
+  // Offset of the first byte of the first malformed UTF-8 sequence
+  // (overlong, surrogate, above U+10FFFF or truncated), or size.
+  std::size_t (*mValidateUtf8)(const char *text, std::size_t size);
+  // Uniform doubles in [low, low + width), RANDOM_LANES at a time; values of
+  // a partial last round are dropped.
+  void (*mRandomUniform)(RandomLanes &lanes, double *out, std::size_t count,
+                         double low, double width);
+  // Two passes over a block that should fit in L1; count must not be 0.
+  BlockMoments (*mBlockMoments)(const double *values, std::size_t count);
+};
+
+extern const KernelTable SSE2_KERNELS;
+extern const KernelTable AVX2_KERNELS;
+extern const KernelTable AVX512_KERNELS;
+
+struct Selection {
+  Isa mDetected;
+  Isa mSelected;
+  bool mForced;
+  // The override named a variant this CPU cannot run.
+  bool mForcedUnsupported;
+};
+
+// Chosen once, on first use, from detectIsa() and the HAVERSINE_ISA override.
+const Selection &selection();
+const KernelTable &kernels();
+
+} // namespace Haversine::CpuDispatch
@@ -0,0 +1,43 @@
+#include "distance_matrix.h"
+
+#include <stdexcept>
+#include <string>
+
+extern "C" {
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+namespace Haversine::DistanceMatrix {
+
+MatrixFile::MatrixFile(std::string_view filename, std::size_t count,
+                       std::size_t elementSize)
+    : mCount{count}, mBytes{std::uint64_t(count) * count * elementSize} {
+  std::string path{filename};
+  mFileDescriptor = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC,
+                           S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (mFileDescriptor == -1)
+    throw std::runtime_error("Unable to open matrix file: " + path);
+  if (::ftruncate(mFileDescriptor, off_t(mBytes)) != 0) {
+    ::close(mFileDescriptor);
+    throw std::runtime_error("Unable to size matrix file: " + path);
+  }
+  if (mBytes == 0)
+    return;
+  mData = ::mmap(nullptr, mBytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+                 mFileDescriptor, 0);
+  if (mData == MAP_FAILED) {
+    ::close(mFileDescriptor);
+    throw std::runtime_error("Unable to map matrix file: " + path);
+  }
+}
+
+MatrixFile::~MatrixFile() {
+  if (mData != nullptr)
+    ::munmap(mData, mBytes);
+  ::close(mFileDescriptor);
+}
+
+} // namespace Haversine::DistanceMatrix
@@ -0,0 +1,209 @@
+#pragma once
+
+#include "cpu_dispatch.h"
+#include "math_utils.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Haversine::DistanceMatrix {
+
+// Points per tile edge. The column block of a tile (three arrays) stays in L1
+// while its rows are swept, and the tile itself in L2.
+constexpr std::size_t TILE_POINTS = 128;
+// Vector operations per distance in the row kernel, counting every arithmetic
+// operation, compare, select and square root as one; the basis of the
+// GFLOP-equivalent figures.
+constexpr double FLOPS_PER_DISTANCE = 125;
+
+// Radians and cos(latitude), so that the kernel only evaluates the terms that
+// depend on both points.
+template <typename T> struct Points {
+  static Points from(std::span<const double> lonDegrees,
+                     std::span<const double> latDegrees) {
+    Points result;
+    for (std::size_t i = 0; i < lonDegrees.size(); ++i) {
+      const auto lat = MathUtils::radiansFromDegrees(latDegrees[i]);
+      result.mLat.push_back(T(lat));
+      result.mLon.push_back(T(MathUtils::radiansFromDegrees(lonDegrees[i])));
+      result.mCosLat.push_back(T(std::cos(lat)));
+    }
+    return result;
+  }
+
+  std::size_t size() const { return mLat.size(); }
+
+  std::vector<T> mLat;
+  std::vector<T> mLon;
+  std::vector<T> mCosLat;
+};
+
+// Distances between the points of a row block and of a column block; row r
+// starts at mValues + r * TILE_POINTS.
+template <typename T> struct Tile {
+  bool diagonal() const { return mRowBegin == mColumnBegin; }
+
+  std::size_t mRowBegin;
+  std::size_t mRowEnd;
+  std::size_t mColumnBegin;
+  std::size_t mColumnEnd;
+  const T *mValues;
+};
+
+// Computes each tile on or above the diagonal once, on the pool, and calls
+// visit(tile) on the worker that computed it; the tiles below the diagonal
+// are their transposes. Diagonal tiles are computed whole.
+template <typename T, typename Visit>
+void forEachTile(ThreadPool::Pool &pool, const Points<T> &points,
+                 Visit &&visit) {
+  const auto &kernels = CpuDispatch::kernels();
+  const auto row = [&] {
+    if constexpr (std::is_same_v<T, float>)
+      return kernels.mHaversineRowF32;
+    else
+      return kernels.mHaversineRowF64;
+  }();
+  const auto count = points.size();
+  const auto blocks = (count + TILE_POINTS - 1) / TILE_POINTS;
+  std::vector<std::pair<std::uint32_t, std::uint32_t>> tiles;
+  tiles.reserve(blocks * (blocks + 1) / 2);
+  for (std::uint32_t i = 0; i < blocks; ++i) {
+    for (std::uint32_t j = i; j < blocks; ++j)
+      tiles.emplace_back(i, j);
+  }
+
+  std::vector<std::vector<T>> buffers(
+      pool.size(), std::vector<T>(TILE_POINTS * TILE_POINTS));
+  pool.parallelFor(
+      0, tiles.size(), 1, [&](std::uint64_t first, std::uint64_t last) {
+        auto &buffer = buffers[ThreadPool::Pool::currentWorker()];
+        for (auto k = first; k < last; ++k) {
+          Tile<T> tile{.mRowBegin = tiles[k].first * TILE_POINTS,
+                       .mRowEnd = 0,
+                       .mColumnBegin = tiles[k].second * TILE_POINTS,
+                       .mColumnEnd = 0,
+                       .mValues = buffer.data()};
+          tile.mRowEnd = std::min(tile.mRowBegin + TILE_POINTS, count);
+          tile.mColumnEnd = std::min(tile.mColumnBegin + TILE_POINTS, count);
+          const auto columns = tile.mColumnEnd - tile.mColumnBegin;
+          for (auto r = tile.mRowBegin; r < tile.mRowEnd; ++r) {
+            row(points.mLat[r], points.mLon[r], points.mCosLat[r],
+                points.mLat.data() + tile.mColumnBegin,
+                points.mLon.data() + tile.mColumnBegin,
+                points.mCosLat.data() + tile.mColumnBegin,
+                buffer.data() + (r - tile.mRowBegin) * TILE_POINTS, columns,
+                T(MathUtils::EARTH_RADIUS));
+          }
+          visit(static_cast<const Tile<T> &>(tile));
+        }
+      });
+}
+
+// Row-major count x count matrix of elementSize values in a file, written
+// through a shared mapping.
+class MatrixFile {
+public:
+  MatrixFile(std::string_view filename, std::size_t count,
+             std::size_t elementSize);
+  ~MatrixFile();
+  MatrixFile(const MatrixFile &) = delete;
+  MatrixFile &operator=(const MatrixFile &) = delete;
+
+  std::uint64_t bytes() const { return mBytes; }
+
+  // Writes the tile and, off the diagonal, its transpose.
+  template <typename T> void store(const Tile<T> &tile) {
+    auto *matrix = static_cast<T *>(mData);
+    const auto columns = tile.mColumnEnd - tile.mColumnBegin;
+    for (auto r = tile.mRowBegin; r < tile.mRowEnd; ++r) {
+      const auto *values = tile.mValues + (r - tile.mRowBegin) * TILE_POINTS;
+      std::copy(values, values + columns,
+                matrix + r * mCount + tile.mColumnBegin);
+    }
+    if (tile.diagonal())
+      return;
+    for (auto c = tile.mColumnBegin; c < tile.mColumnEnd; ++c) {
+      auto *out = matrix + c * mCount + tile.mRowBegin;
+      for (auto r = tile.mRowBegin; r < tile.mRowEnd; ++r)
+        out[r - tile.mRowBegin] =
+            tile.mValues[(r - tile.mRowBegin) * TILE_POINTS +
+                         (c - tile.mColumnBegin)];
+    }
+  }
+
+private:
+  int mFileDescriptor{-1};
+  void *mData{nullptr};
+  std::size_t mCount;
+  std::uint64_t mBytes;
+};
+
+struct RowReductions {
+  // Mean distance from each point to all others.
+  std::vector<double> mMeans;
+  std::vector<double> mNearest;
+  std::vector<std::uint64_t> mNearestIndex;
+};
+
+// Row means and nearest neighbours without storing the matrix. Every worker
+// accumulates into its own rows, merged at the end; means may differ in the
+// last bits between multi-threaded runs.
+template <typename T>
+RowReductions reduceRows(ThreadPool::Pool &pool, const Points<T> &points) {
+  constexpr auto NONE = std::numeric_limits<std::uint64_t>::max();
+  const auto count = points.size();
+  std::vector<RowReductions> workers(pool.size());
+  for (auto &worker : workers) {
+    worker.mMeans.assign(count, 0.);
+    worker.mNearest.assign(count, std::numeric_limits<double>::infinity());
+    worker.mNearestIndex.assign(count, NONE);
+  }
+  auto closer = [](RowReductions &rows, std::size_t i, double distance,
+                   std::uint64_t j) {
+    if (distance < rows.mNearest[i] ||
+        (distance == rows.mNearest[i] && j < rows.mNearestIndex[i])) {
+      rows.mNearest[i] = distance;
+      rows.mNearestIndex[i] = j;
+    }
+  };
+
+  forEachTile(pool, points, [&](const Tile<T> &tile) {
+    auto &rows = workers[ThreadPool::Pool::currentWorker()];
+    for (auto r = tile.mRowBegin; r < tile.mRowEnd; ++r) {
+      const auto *values = tile.mValues + (r - tile.mRowBegin) * TILE_POINTS;
+      double sum = 0;
+      for (auto c = tile.mColumnBegin; c < tile.mColumnEnd; ++c) {
+        const auto distance = double(values[c - tile.mColumnBegin]);
+        sum += distance;
+        if (c != r)
+          closer(rows, r, distance, c);
+        if (!tile.diagonal()) {
+          rows.mMeans[c] += distance;
+          closer(rows, c, distance, r);
+        }
+      }
+      rows.mMeans[r] += sum;
+    }
+  });
+
+  auto &result = workers[0];
+  for (std::size_t w = 1; w < workers.size(); ++w) {
+    for (std::size_t i = 0; i < count; ++i) {
+      result.mMeans[i] += workers[w].mMeans[i];
+      closer(result, i, workers[w].mNearest[i], workers[w].mNearestIndex[i]);
+    }
+  }
+  for (auto &mean : result.mMeans)
+    mean = count > 1 ? mean / double(count - 1) : 0.;
+  return std::move(result);
+}
+
+} // namespace Haversine::DistanceMatrix
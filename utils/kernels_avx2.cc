@@ -0,0 +1,25 @@
+#include "simd_kernels.h"
+
+#include <immintrin.h>
+
+namespace Haversine::CpuDispatch {
+namespace {
+struct Avx2Policy {
+  static constexpr Isa ISA = Isa::AVX2;
+  static constexpr std::size_t BYTES = 32;
+  static constexpr std::uint64_t FULL_MASK = 0xFFFFFFFF;
+
+  static Vector<double, BYTES> sqrt(Vector<double, BYTES> value) {
+    return _mm256_sqrt_pd(value);
+  }
+  static Vector<float, BYTES> sqrt(Vector<float, BYTES> value) {
+    return _mm256_sqrt_ps(value);
+  }
+  static std::uint64_t byteMask(Vector<unsigned char, BYTES> mask) {
+    return std::uint32_t(_mm256_movemask_epi8(__m256i(mask)));
+  }
+};
+} // namespace
+
+const KernelTable AVX2_KERNELS = makeKernelTable<Avx2Policy>();
+} // namespace Haversine::CpuDispatch
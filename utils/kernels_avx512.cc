@@ -0,0 +1,25 @@
+#include "simd_kernels.h"
+
+#include <immintrin.h>
+
+namespace Haversine::CpuDispatch {
+namespace {
+struct Avx512Policy {
+  static constexpr Isa ISA = Isa::AVX512;
+  static constexpr std::size_t BYTES = 64;
+  static constexpr std::uint64_t FULL_MASK = ~0ULL;
+
+  static Vector<double, BYTES> sqrt(Vector<double, BYTES> value) {
+    return _mm512_sqrt_pd(value);
+  }
+  static Vector<float, BYTES> sqrt(Vector<float, BYTES> value) {
+    return _mm512_sqrt_ps(value);
+  }
+  static std::uint64_t byteMask(Vector<unsigned char, BYTES> mask) {
+    return _mm512_movepi8_mask(__m512i(mask));
+  }
+};
+} // namespace
+
+const KernelTable AVX512_KERNELS = makeKernelTable<Avx512Policy>();
+} // namespace Haversine::CpuDispatch
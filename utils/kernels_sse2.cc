@@ -0,0 +1,25 @@
+#include "simd_kernels.h"
+
+#include <emmintrin.h>
+
+namespace Haversine::CpuDispatch {
+namespace {
+struct Sse2Policy {
+  static constexpr Isa ISA = Isa::SSE2;
+  static constexpr std::size_t BYTES = 16;
+  static constexpr std::uint64_t FULL_MASK = 0xFFFF;
+
+  static Vector<double, BYTES> sqrt(Vector<double, BYTES> value) {
+    return _mm_sqrt_pd(value);
+  }
+  static Vector<float, BYTES> sqrt(Vector<float, BYTES> value) {
+    return _mm_sqrt_ps(value);
+  }
+  static std::uint64_t byteMask(Vector<unsigned char, BYTES> mask) {
+    return std::uint32_t(_mm_movemask_epi8(__m128i(mask)));
+  }
+};
+} // namespace
+
+const KernelTable SSE2_KERNELS = makeKernelTable<Sse2Policy>();
+} // namespace Haversine::CpuDispatch
@@ -0,0 +1,202 @@
+#include "large_buffer.h"
+#include "timing_utils.h"
+
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <sys/mman.h>
+#include <sys/resource.h>
+}
+
+namespace Haversine::LargeBuffer {
+
+struct Mapping {
+  ~Mapping() {
+    if (mPrefaulter.joinable())
+      mPrefaulter.join();
+    if (mData != nullptr)
+      ::munmap(mData, mSize);
+  }
+
+  char *mData{nullptr};
+  std::size_t mSize{0};
+  HugePages mRequested{HugePages::OFF};
+  Stats mStats;
+  std::thread mPrefaulter;
+};
+
+namespace {
+constexpr std::size_t MAX_CACHED_MAPPINGS = 4;
+
+struct Cache {
+  std::mutex mMutex;
+  std::vector<std::unique_ptr<Mapping>> mMappings;
+};
+
+Cache &cache() {
+  static Cache instance;
+  return instance;
+}
+
+std::unique_ptr<Mapping> takeCached(std::size_t size, HugePages requested) {
+  auto &instance = cache();
+  std::lock_guard lock{instance.mMutex};
+  auto &mappings = instance.mMappings;
+  auto best = mappings.end();
+  for (auto it = mappings.begin(); it != mappings.end(); ++it) {
+    if ((*it)->mRequested == requested && (*it)->mSize >= size &&
+        (best == mappings.end() || (*it)->mSize < (*best)->mSize))
+      best = it;
+  }
+  if (best == mappings.end())
+    return nullptr;
+  auto mapping = std::move(*best);
+  mappings.erase(best);
+  return mapping;
+}
+
+char *map(std::size_t size, HugePages requested, HugePages &obtained) {
+  constexpr int PROTECTION = PROT_READ | PROT_WRITE;
+  constexpr int FLAGS = MAP_PRIVATE | MAP_ANONYMOUS;
+  if (requested == HugePages::EXPLICIT) {
+    auto *data = ::mmap(nullptr, size, PROTECTION, FLAGS | MAP_HUGETLB, -1, 0);
+    if (data != MAP_FAILED) {
+      obtained = HugePages::EXPLICIT;
+      return static_cast<char *>(data);
+    }
+  }
+  auto *data = ::mmap(nullptr, size, PROTECTION, FLAGS, -1, 0);
+  if (data == MAP_FAILED)
+    throw std::runtime_error("Unable to map a buffer of " +
+                             std::to_string(size) + " bytes");
+  obtained = HugePages::OFF;
+  if (requested != HugePages::OFF &&
+      ::madvise(data, size, MADV_HUGEPAGE) == 0)
+    obtained = HugePages::TRANSPARENT;
+  return static_cast<char *>(data);
+}
+
+// MADV_POPULATE_WRITE faults pages in without writing to them, so the owner
+// may already be filling the same pages. Kernels before 5.14 reject it and
+// leave the faults to the owner.
+void prefault(Mapping &mapping) {
+  const auto start = TimingUtils::readOsTimer();
+  const auto faults = threadMinorFaults();
+  for (std::size_t offset = 0; offset < mapping.mSize;
+       offset += HUGE_PAGE_SIZE) {
+    if (::madvise(mapping.mData + offset, HUGE_PAGE_SIZE,
+                  MADV_POPULATE_WRITE) != 0)
+      break;
+  }
+  mapping.mStats.mPrefaultFaults = threadMinorFaults() - faults;
+  mapping.mStats.mPrefaultOsTicks = TimingUtils::readOsTimer() - start;
+}
+} // namespace
+
+HugePages hugePagesFrom(std::string_view rawText) {
+  if (rawText == "off")
+    return HugePages::OFF;
+  if (rawText == "thp")
+    return HugePages::TRANSPARENT;
+  if (rawText == "explicit")
+    return HugePages::EXPLICIT;
+
+  std::string errorMessage = "Unrecognized huge pages: ";
+  errorMessage.append(rawText);
+  throw std::runtime_error(errorMessage);
+}
+
+std::string_view hugePagesToStrView(HugePages hugePages) {
+  switch (hugePages) {
+  case HugePages::OFF:
+    return "4 KiB pages";
+  case HugePages::TRANSPARENT:
+    return "transparent huge pages";
+  case HugePages::EXPLICIT:
+    return "explicit huge pages";
+  }
+  return "unknown";
+}
+
+Options Options::from(const CliUtils::CommandLineOptions &options) {
+  Options result;
+  if (auto rawHugePages = options.value("huge-pages"))
+    result.mHugePages = hugePagesFrom(*rawHugePages);
+  result.mPrefault = !options.has("no-prefault");
+  return result;
+}
+
+Buffer Buffer::allocate(std::size_t size, const Options &options) {
+  const auto mappedSize =
+      std::max<std::size_t>(1, (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE) *
+      HUGE_PAGE_SIZE;
+  if (auto mapping = takeCached(mappedSize, options.mHugePages)) {
+    mapping->mStats = Stats{.mHugePages = mapping->mStats.mHugePages,
+                            .mReused = true};
+    return Buffer{std::move(mapping)};
+  }
+  auto mapping = std::make_unique<Mapping>();
+  mapping->mRequested = options.mHugePages;
+  mapping->mData = map(mappedSize, options.mHugePages,
+                       mapping->mStats.mHugePages);
+  mapping->mSize = mappedSize;
+  // Explicit huge pages are reserved and faulted in whole already.
+  if (options.mPrefault && mapping->mStats.mHugePages != HugePages::EXPLICIT)
+    mapping->mPrefaulter = std::thread(prefault, std::ref(*mapping));
+  return Buffer{std::move(mapping)};
+}
+
+Buffer::Buffer() = default;
+
+Buffer::Buffer(std::unique_ptr<Mapping> mapping)
+    : mMapping{std::move(mapping)} {}
+
+Buffer::Buffer(Buffer &&other) noexcept = default;
+
+Buffer &Buffer::operator=(Buffer &&other) noexcept {
+  if (this != &other) {
+    Buffer released{std::move(*this)};
+    mMapping = std::move(other.mMapping);
+  }
+  return *this;
+}
+
+Buffer::~Buffer() {
+  if (!mMapping)
+    return;
+  if (mMapping->mPrefaulter.joinable())
+    mMapping->mPrefaulter.join();
+  auto &instance = cache();
+  std::lock_guard lock{instance.mMutex};
+  if (instance.mMappings.size() < MAX_CACHED_MAPPINGS)
+    instance.mMappings.push_back(std::move(mMapping));
+}
+
+char *Buffer::data() const { return mMapping ? mMapping->mData : nullptr; }
+
+std::size_t Buffer::size() const { return mMapping ? mMapping->mSize : 0; }
+
+const Stats &Buffer::stats() {
+  if (mMapping->mPrefaulter.joinable())
+    mMapping->mPrefaulter.join();
+  return mMapping->mStats;
+}
+
+void releaseCached() {
+  auto &instance = cache();
+  std::lock_guard lock{instance.mMutex};
+  instance.mMappings.clear();
+}
+
+std::uint64_t threadMinorFaults() {
+  rusage usage{};
+  ::getrusage(RUSAGE_THREAD, &usage);
+  return std::uint64_t(usage.ru_minflt);
+}
+
+} // namespace Haversine::LargeBuffer
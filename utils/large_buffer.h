@@ -0,0 +1,80 @@
+#pragma once
+
+#include "cli_utils.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+namespace Haversine::LargeBuffer {
+
+// Buffers are mapped in whole huge pages, so any of them can be backed by
+// huge pages from end to end.
+constexpr std::size_t HUGE_PAGE_SIZE = std::size_t(2) << 20;
+constexpr std::size_t SMALL_PAGE_SIZE = 4096;
+
+enum class HugePages : std::uint8_t {
+  OFF,
+  // madvise(MADV_HUGEPAGE); the kernel decides per 2 MiB range.
+  TRANSPARENT,
+  // MAP_HUGETLB from the reserved pool, or TRANSPARENT when it is empty.
+  EXPLICIT
+};
+
+HugePages hugePagesFrom(std::string_view rawText);
+std::string_view hugePagesToStrView(HugePages hugePages);
+
+struct Options {
+  // From --huge-pages=off|thp|explicit and --no-prefault.
+  static Options from(const CliUtils::CommandLineOptions &options);
+
+  HugePages mHugePages = HugePages::TRANSPARENT;
+  // Fault the pages in on a helper thread, front to back, while the caller
+  // fills the buffer behind it.
+  bool mPrefault = true;
+};
+
+struct Stats {
+  // What the mapping got, which may be less than requested; TRANSPARENT only
+  // means the advice was accepted.
+  HugePages mHugePages = HugePages::OFF;
+  // Taken from the buffers released earlier, with its pages faulted in.
+  bool mReused = false;
+  std::uint64_t mPrefaultOsTicks = 0;
+  std::uint64_t mPrefaultFaults = 0;
+};
+
+struct Mapping;
+
+// An anonymous mapping of whole huge pages. Released buffers are kept for
+// reuse, so a process that reads one input after another faults in the
+// pages once.
+class Buffer {
+public:
+  static Buffer allocate(std::size_t size, const Options &options = {});
+
+  Buffer();
+  ~Buffer();
+  Buffer(Buffer &&other) noexcept;
+  Buffer &operator=(Buffer &&other) noexcept;
+
+  char *data() const;
+  // At least the size asked for.
+  std::size_t size() const;
+  // Waits for the helper thread to finish.
+  const Stats &stats();
+
+private:
+  explicit Buffer(std::unique_ptr<Mapping> mapping);
+
+  std::unique_ptr<Mapping> mMapping;
+};
+
+// Unmaps the buffers kept for reuse.
+void releaseCached();
+
+// Minor page faults taken by the calling thread so far.
+std::uint64_t threadMinorFaults();
+
+} // namespace Haversine::LargeBuffer
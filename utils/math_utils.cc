@@ -1,4 +1,5 @@
 #include "math_utils.h"
+#include "cpu_dispatch.h"
 
 namespace Haversine::MathUtils {
 double square(double A) {
@@ -31,4 +32,42 @@ double referenceHaversine(double x0, double y0, double x1, double y1,
 
   return result;
 }
+
+void haversineBatch(std::span<const double> x0, std::span<const double> y0,
+                    std::span<const double> x1, std::span<const double> y1,
+                    std::span<double> out, double earthRadius) {
+  CpuDispatch::kernels().mHaversineF64(x0.data(), y0.data(), x1.data(),
+                                       y1.data(), out.data(), out.size(),
+                                       earthRadius);
+}
+
+void haversineBatch(std::span<const float> x0, std::span<const float> y0,
+                    std::span<const float> x1, std::span<const float> y1,
+                    std::span<float> out, float earthRadius) {
+  CpuDispatch::kernels().mHaversineF32(x0.data(), y0.data(), x1.data(),
+                                       y1.data(), out.data(), out.size(),
+                                       earthRadius);
+}
+
+double equirectangularMaxSpan(double maxRelativeError) {
+  return std::min(std::sqrt(3. * std::max(maxRelativeError, 0.)), 0.2);
+}
+
+std::size_t haversineAdaptiveBatch(std::span<const double> x0,
+                                   std::span<const double> y0,
+                                   std::span<const double> x1,
+                                   std::span<const double> y1,
+                                   std::span<double> out, double maxSpan,
+                                   double earthRadius) {
+  return CpuDispatch::kernels().mHaversineAdaptiveF64(
+      x0.data(), y0.data(), x1.data(), y1.data(), out.data(), out.size(),
+      earthRadius, maxSpan);
+}
+
+double sumOf(std::span<const float> values) {
+  double result = 0;
+  for (auto value : values)
+    result += double(value);
+  return result;
+}
 } // namespace Haversine::MathUtils
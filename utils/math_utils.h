@@ -1,16 +1,113 @@
 #pragma once
 
+#include <algorithm>
 #include <cmath>
+#include <cstddef>
 #include <random>
+#include <span>
+#include <vector>
 
 namespace Haversine::MathUtils {
 constexpr auto EARTH_RADIUS = 6372.8;
+// Pairs per partial sum of the mean distance. The generator and the
+// processor fold the partial sums in the same order, so their means agree
+// bit for bit whatever the number of threads.
+constexpr std::size_t SUM_CHUNK_PAIRS = 1024;
 
 double square(double A);
 double radiansFromDegrees(double Degrees);
 double referenceHaversine(double x0, double y0, double x1, double y1,
                           double earthRadius = EARTH_RADIUS);
 
+// Batch kernels evaluate haversine with polynomial approximations, using the
+// widest instruction set CpuDispatch selected. They expect longitudes in
+// [-180, 180] and latitudes in [-90, 90].
+void haversineBatch(std::span<const double> x0, std::span<const double> y0,
+                    std::span<const double> x1, std::span<const double> y1,
+                    std::span<double> out, double earthRadius = EARTH_RADIUS);
+void haversineBatch(std::span<const float> x0, std::span<const float> y0,
+                    std::span<const float> x1, std::span<const float> y1,
+                    std::span<float> out, float earthRadius = EARTH_RADIUS);
+
+// Equirectangular approximation R * sqrt(dLat^2 + (dLon cos(meanLat))^2) for
+// pairs whose latitude and longitude differ by at most the span S returned
+// here, and haversine for the others. With h = S / 2, the haversine term
+// lies within [A (1 - 4h^2/3), A] of the approximation's A = (dLat/2)^2 +
+// cos^2(meanLat) (dLon/2)^2, and asin(y) / y <= 1 + y^2 / (6 (1 - y^2)) with
+// y^2 <= 2h^2; below S = 0.2 both keep the relative error under S^2 / 3.
+double equirectangularMaxSpan(double maxRelativeError);
+// Returns the number of pairs that took the approximation.
+std::size_t haversineAdaptiveBatch(std::span<const double> x0,
+                                   std::span<const double> y0,
+                                   std::span<const double> x1,
+                                   std::span<const double> y1,
+                                   std::span<double> out, double maxSpan,
+                                   double earthRadius = EARTH_RADIUS);
+
+double sumOf(std::span<const float> values);
+
+// Neumaier summation: the rounding error of every addition is carried in
+// mCompensation, so a running total can be saved and resumed without
+// drifting.
+struct CompensatedSum {
+  void add(double value) {
+    const auto total = mSum + value;
+    if (std::abs(mSum) >= std::abs(value))
+      mCompensation += (mSum - total) + value;
+    else
+      mCompensation += (value - total) + mSum;
+    mSum = total;
+  }
+  double value() const { return mSum + mCompensation; }
+
+  double mSum{0};
+  double mCompensation{0};
+};
+
+template <typename T> struct CoordinatePairs {
+  void reserve(std::size_t count) {
+    mX0.reserve(count);
+    mY0.reserve(count);
+    mX1.reserve(count);
+    mY1.reserve(count);
+  }
+
+  void push(T x0, T y0, T x1, T y1) {
+    mX0.push_back(x0);
+    mY0.push_back(y0);
+    mX1.push_back(x1);
+    mY1.push_back(y1);
+  }
+
+  void resize(std::size_t count) {
+    mX0.resize(count);
+    mY0.resize(count);
+    mX1.resize(count);
+    mY1.resize(count);
+  }
+
+  void append(const CoordinatePairs &other) {
+    mX0.insert(mX0.end(), other.mX0.begin(), other.mX0.end());
+    mY0.insert(mY0.end(), other.mY0.begin(), other.mY0.end());
+    mX1.insert(mX1.end(), other.mX1.begin(), other.mX1.end());
+    mY1.insert(mY1.end(), other.mY1.begin(), other.mY1.end());
+  }
+
+  void clear() {
+    mX0.clear();
+    mY0.clear();
+    mX1.clear();
+    mY1.clear();
+  }
+
+  std::size_t size() const { return mX0.size(); }
+
+  std::vector<T> mX0;
+  std::vector<T> mY0;
+  std::vector<T> mX1;
+  std::vector<T> mY1;
+};
+
 template <typename Rng>
 inline double randomDegree(Rng &randSource, double center, double radius,
                            double maxAllowed) {
@@ -20,4 +117,14 @@ inline double randomDegree(Rng &randSource, double center, double radius,
   std::uniform_real_distribution<double> unif{minVal, maxVal};
   return unif(randSource);
 }
+
+// Batch form of randomDegree for sources with a span `uniform` member, such
+// as RandomUtils::LaneRandom.
+template <typename Rng>
+inline void randomDegrees(Rng &randSource, std::span<double> out,
+                          double center, double radius, double maxAllowed) {
+  auto minVal = std::max(center - radius, -maxAllowed);
+  auto maxVal = std::min(center + radius, maxAllowed);
+  randSource.uniform(out, minVal, maxVal);
+}
 } // namespace Haversine::MathUtils
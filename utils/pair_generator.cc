@@ -0,0 +1,46 @@
+#include "pair_generator.h"
+
+#include <algorithm>
+#include <span>
+
+namespace Haversine::PairGenerator {
+
+Generator::Generator(CliUtils::Mode mode, std::uint64_t seed,
+                     std::uint64_t totalPairs)
+    : mMode{mode}, mRandom{seed}, mClusterCountMax{1 + (totalPairs / 64)} {}
+
+void Generator::nextCluster() {
+  mClusterCountLeft = mClusterCountMax + 1;
+  mXCenter = mRandom.uniform(-180., 180.);
+  mYCenter = mRandom.uniform(-90., 90.);
+  mXRadius = mRandom.uniform(0., 180.);
+  mYRadius = mRandom.uniform(0., 90.);
+}
+
+void Generator::next(MathUtils::CoordinatePairs<double> &pairs,
+                     std::size_t count) {
+  using MathUtils::randomDegrees;
+  pairs.resize(count);
+  // Columns are drawn in runs that share one cluster; clusters may span
+  // calls.
+  for (std::size_t i = 0; i < count;) {
+    auto run = count - i;
+    if (mMode == CliUtils::Mode::CLUSTER) {
+      if (mClusterCountLeft == 0)
+        nextCluster();
+      run = std::min<std::uint64_t>(run, mClusterCountLeft);
+      mClusterCountLeft -= run;
+    }
+    randomDegrees(mRandom, std::span(pairs.mX0).subspan(i, run), mXCenter,
+                  mXRadius, 180.);
+    randomDegrees(mRandom, std::span(pairs.mY0).subspan(i, run), mYCenter,
+                  mYRadius, 90.);
+    randomDegrees(mRandom, std::span(pairs.mX1).subspan(i, run), mXCenter,
+                  mXRadius, 180.);
+    randomDegrees(mRandom, std::span(pairs.mY1).subspan(i, run), mYCenter,
+                  mYRadius, 90.);
+    i += run;
+  }
+}
+
+} // namespace Haversine::PairGenerator
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "cli_utils.h"
+#include "math_utils.h"
+#include "random_utils.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Haversine::PairGenerator {
+
+// Produces the pairs of haversine_input_generator, block by block. Uniform
+// mode spreads pairs over the whole globe; cluster mode draws a new center
+// and radius every 1 + totalPairs / 64 pairs.
+class Generator {
+public:
+  Generator(CliUtils::Mode mode, std::uint64_t seed, std::uint64_t totalPairs);
+
+  // Replaces the contents of `pairs` with the next `count` pairs.
+  void next(MathUtils::CoordinatePairs<double> &pairs, std::size_t count);
+
+private:
+  void nextCluster();
+
+  CliUtils::Mode mMode;
+  RandomUtils::LaneRandom mRandom;
+  std::uint64_t mClusterCountMax;
+  std::uint64_t mClusterCountLeft{0};
+  double mXCenter{0.};
+  double mYCenter{0.};
+  double mXRadius{180.};
+  double mYRadius{90.};
+};
+
+} // namespace Haversine::PairGenerator
@@ -0,0 +1,277 @@
+#include "perf_counters.h"
+#include "timing_utils.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+extern "C" {
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+}
+
+namespace Haversine::PerfCounters {
+
+namespace {
+constexpr std::uint64_t cacheConfig(std::uint64_t cache) {
+  return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+perf_event_attr attributesFor(Counter counter) {
+  perf_event_attr attr{};
+  attr.size = sizeof(attr);
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                     PERF_FORMAT_TOTAL_TIME_RUNNING;
+  switch (counter) {
+  case CYCLES: {
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+  } break;
+  case INSTRUCTIONS: {
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+  } break;
+  case BRANCH_MISSES: {
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+  } break;
+  case L1D_MISSES: {
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = cacheConfig(PERF_COUNT_HW_CACHE_L1D);
+  } break;
+  case LLC_MISSES: {
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = cacheConfig(PERF_COUNT_HW_CACHE_LL);
+  } break;
+  case DTLB_MISSES: {
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = cacheConfig(PERF_COUNT_HW_CACHE_DTLB);
+  } break;
+  case COUNTER_COUNT:
+  default:
+    break;
+  }
+  return attr;
+}
+
+int perfEventOpen(perf_event_attr &attr, int groupFileDescriptor) {
+  return int(::syscall(SYS_perf_event_open, &attr, 0, -1, groupFileDescriptor,
+                       0));
+}
+
+void printRate(CliUtils::IoBufferedWriter &out, double value,
+               std::uint64_t units, std::string_view unitName) {
+  if (units == 0)
+    return;
+  out.printSv("  ");
+  out.printNumber(value / double(units), std::chars_format::fixed, 4);
+  out.printSv(unitName);
+}
+} // namespace
+
+std::string_view counterToStrView(Counter counter) {
+  switch (counter) {
+  case CYCLES:
+    return "cycles";
+  case INSTRUCTIONS:
+    return "instructions";
+  case BRANCH_MISSES:
+    return "branch-misses";
+  case L1D_MISSES:
+    return "L1D-misses";
+  case LLC_MISSES:
+    return "LLC-misses";
+  case DTLB_MISSES:
+    return "dTLB-misses";
+  case COUNTER_COUNT:
+  default:
+    break;
+  }
+  return "unknown";
+}
+
+CounterValues CounterValues::operator-(const CounterValues &rhs) const {
+  CounterValues result;
+  for (std::size_t i = 0; i < COUNTER_COUNT; ++i) {
+    result.mValid[i] = mValid[i] && rhs.mValid[i];
+    result.mValues[i] = mValues[i] - rhs.mValues[i];
+  }
+  return result;
+}
+
+CounterSet::CounterSet() {
+  openGroup(mGroups[0], {CYCLES, INSTRUCTIONS, BRANCH_MISSES});
+  openGroup(mGroups[1], {L1D_MISSES, LLC_MISSES, DTLB_MISSES});
+  mAvailable = mGroups[0].mLeader != -1 || mGroups[1].mLeader != -1;
+  for (const auto &group : mGroups) {
+    if (group.mLeader == -1)
+      continue;
+    ::ioctl(group.mLeader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ::ioctl(group.mLeader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+}
+
+CounterSet::~CounterSet() {
+  for (const auto &group : mGroups) {
+    for (auto fd : group.mFileDescriptors)
+      ::close(fd);
+  }
+}
+
+void CounterSet::openGroup(Group &group,
+                           std::initializer_list<Counter> counters) {
+  for (auto counter : counters) {
+    auto attr = attributesFor(counter);
+    auto fd = perfEventOpen(attr, group.mLeader);
+    if (fd == -1) {
+      if (mUnavailableReason.empty()) {
+        mUnavailableReason = std::string(counterToStrView(counter)) + ": " +
+                             std::strerror(errno);
+      }
+      continue;
+    }
+    if (group.mLeader == -1)
+      group.mLeader = fd;
+    group.mCounters.push_back(counter);
+    group.mFileDescriptors.push_back(fd);
+  }
+}
+
+CounterValues CounterSet::read() const {
+  CounterValues result;
+  for (const auto &group : mGroups) {
+    if (group.mLeader == -1)
+      continue;
+    // nr, time_enabled, time_running, then one value per counter.
+    std::array<std::uint64_t, 3 + COUNTER_COUNT> buffer{};
+    const auto expected = (3 + group.mCounters.size()) * sizeof(std::uint64_t);
+    if (::read(group.mLeader, buffer.data(), expected) != ssize_t(expected))
+      continue;
+    const auto enabled = buffer[1];
+    const auto running = buffer[2];
+    if (running == 0)
+      continue;
+    const double scale = double(enabled) / double(running);
+    for (std::size_t i = 0; i < group.mCounters.size(); ++i) {
+      const auto counter = group.mCounters[i];
+      result.mValues[counter] = std::uint64_t(double(buffer[3 + i]) * scale);
+      result.mValid[counter] = true;
+    }
+  }
+  return result;
+}
+
+StageProfiler::StageProfiler(bool counters, bool allocations)
+    : mEnabled{counters || allocations}, mAllocations{allocations} {
+  if (counters)
+    mCounters = std::make_unique<CounterSet>();
+}
+
+void StageProfiler::begin(std::string_view stage) {
+  Trace::begin(stage);
+  if (!mEnabled)
+    return;
+  mCurrentStage = 0;
+  while (mCurrentStage < mSamples.size() &&
+         mSamples[mCurrentStage].mName != stage)
+    mCurrentStage++;
+  if (mCurrentStage == mSamples.size())
+    mSamples.push_back(StageSample{.mName = stage});
+  if (mAllocations) {
+    AllocProfiler::takeStagePeak();
+    mStageStartAllocations = AllocProfiler::totals();
+  }
+  if (mCounters && mCounters->available())
+    mStageStartValues = mCounters->read();
+  mStageStart = TimingUtils::readOsTimer();
+}
+
+void StageProfiler::end() {
+  Trace::end();
+  if (!mEnabled || mCurrentStage >= mSamples.size())
+    return;
+  auto &sample = mSamples[mCurrentStage];
+  sample.mOsTicks += TimingUtils::readOsTimer() - mStageStart;
+  if (mAllocations) {
+    const auto delta = AllocProfiler::totals() - mStageStartAllocations;
+    sample.mAllocations.mAllocations += delta.mAllocations;
+    sample.mAllocations.mFrees += delta.mFrees;
+    sample.mAllocations.mBytesAllocated += delta.mBytesAllocated;
+    sample.mAllocations.mBytesFreed += delta.mBytesFreed;
+    sample.mPeakLiveBytes =
+        std::max(sample.mPeakLiveBytes, AllocProfiler::takeStagePeak());
+  }
+  if (mCounters && mCounters->available()) {
+    const auto delta = mCounters->read() - mStageStartValues;
+    for (std::size_t i = 0; i < COUNTER_COUNT; ++i) {
+      sample.mCounters.mValues[i] += delta.mValues[i];
+      sample.mCounters.mValid[i] = delta.mValid[i];
+    }
+  }
+  mCurrentStage = mSamples.size();
+}
+
+void StageProfiler::report(CliUtils::IoBufferedWriter &out,
+                           std::uint64_t bytes, std::uint64_t pairs) const {
+  if (!mEnabled)
+    return;
+  if (mCounters && !mCounters->available()) {
+    out.printSv("Hardware counters unavailable (");
+    out.printSv(mCounters->unavailableReason());
+    out.printSv("), reporting wall-clock time only\n");
+  }
+  for (const auto &sample : mSamples) {
+    out.printSv("Stage ");
+    out.printSv(sample.mName);
+    out.printSv(": ");
+    out.printNumber(TimingUtils::secondsFromOsTicks(sample.mOsTicks) * 1e3,
+                    std::chars_format::fixed, 3);
+    out.printSv(" ms");
+    const auto &counters = sample.mCounters;
+    if (counters.mValid[CYCLES] && counters.mValid[INSTRUCTIONS] &&
+        counters.mValues[CYCLES] != 0) {
+      out.printSv(", IPC ");
+      out.printNumber(double(counters.mValues[INSTRUCTIONS]) /
+                          double(counters.mValues[CYCLES]),
+                      std::chars_format::fixed, 2);
+    }
+    out.printSv("\n");
+    if (mAllocations) {
+      const auto &allocations = sample.mAllocations;
+      out.printSv("  allocations: ");
+      out.printNumber(allocations.mAllocations);
+      printRate(out, double(allocations.mAllocations), pairs, "/pair");
+      out.printSv(", bytes: ");
+      out.printNumber(allocations.mBytesAllocated);
+      printRate(out, double(allocations.mBytesAllocated), bytes, "/byte");
+      out.printSv(", frees: ");
+      out.printNumber(allocations.mFrees);
+      out.printSv(", peak live: ");
+      out.printNumber(sample.mPeakLiveBytes);
+      out.printSv("\n");
+    }
+    for (std::size_t i = 0; i < COUNTER_COUNT; ++i) {
+      if (!counters.mValid[i])
+        continue;
+      const auto value = counters.mValues[i];
+      out.printSv("  ");
+      out.printSv(counterToStrView(Counter(i)));
+      out.printSv(": ");
+      out.printNumber(value);
+      printRate(out, double(value), bytes, "/byte");
+      printRate(out, double(value), pairs, "/pair");
+      out.printSv("\n");
+    }
+  }
+  if (mAllocations)
+    AllocProfiler::report(out, bytes);
+}
+
+} // namespace Haversine::PerfCounters
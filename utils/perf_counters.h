@@ -0,0 +1,101 @@
+#pragma once
+
+#include "alloc_profiler.h"
+#include "cli_utils.h"
+
+#include <array>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Haversine::PerfCounters {
+
+enum Counter : std::uint8_t {
+  CYCLES,
+  INSTRUCTIONS,
+  BRANCH_MISSES,
+  L1D_MISSES,
+  LLC_MISSES,
+  DTLB_MISSES,
+  COUNTER_COUNT
+};
+
+std::string_view counterToStrView(Counter counter);
+
+struct CounterValues {
+  CounterValues operator-(const CounterValues &rhs) const;
+
+  std::array<std::uint64_t, COUNTER_COUNT> mValues{};
+  std::array<bool, COUNTER_COUNT> mValid{};
+};
+
+// Counters opened with perf_event_open, split into two groups (core events and
+// memory events) so each group fits in the PMU at once. Values are scaled by
+// time enabled / time running in case the kernel multiplexes them. Counters
+// that cannot be opened (containers, VMs, perf_event_paranoid) are reported as
+// unavailable instead of failing the run.
+class CounterSet {
+public:
+  CounterSet();
+  ~CounterSet();
+  CounterSet(const CounterSet &) = delete;
+  CounterSet &operator=(const CounterSet &) = delete;
+
+  bool available() const { return mAvailable; }
+  std::string_view unavailableReason() const { return mUnavailableReason; }
+  CounterValues read() const;
+
+private:
+  struct Group {
+    int mLeader{-1};
+    std::vector<Counter> mCounters;
+    std::vector<int> mFileDescriptors;
+  };
+
+  void openGroup(Group &group, std::initializer_list<Counter> counters);
+
+  std::array<Group, 2> mGroups;
+  bool mAvailable{false};
+  std::string mUnavailableReason;
+};
+
+struct StageSample {
+  std::string_view mName;
+  std::uint64_t mOsTicks{0};
+  CounterValues mCounters;
+  AllocProfiler::Totals mAllocations;
+  std::int64_t mPeakLiveBytes{0};
+};
+
+// Reads the counters around pipeline stages; does nothing when disabled.
+// Stages are recorded as trace events either way (see Trace::enable).
+// Entering a stage again accumulates into its existing sample, so a loop can
+// alternate between stages block by block. With `allocations` the heap
+// activity of each stage is recorded too (see AllocProfiler::enable).
+class StageProfiler {
+public:
+  explicit StageProfiler(bool counters, bool allocations = false);
+
+  bool countersEnabled() const { return mCounters != nullptr; }
+
+  void begin(std::string_view stage);
+  void end();
+
+  void report(CliUtils::IoBufferedWriter &out, std::uint64_t bytes,
+              std::uint64_t pairs) const;
+
+private:
+  bool mEnabled;
+  bool mAllocations;
+  std::unique_ptr<CounterSet> mCounters;
+  std::vector<StageSample> mSamples;
+  std::size_t mCurrentStage{0};
+  std::uint64_t mStageStart{0};
+  CounterValues mStageStartValues;
+  AllocProfiler::Totals mStageStartAllocations;
+};
+
+} // namespace Haversine::PerfCounters
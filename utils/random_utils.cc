@@ -0,0 +1,76 @@
+#include "random_utils.h"
+
+#include <bit>
+
+namespace Haversine::RandomUtils {
+
+std::uint64_t splitMix64(std::uint64_t &state) {
+  std::uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+Xoshiro256Plus::Xoshiro256Plus(std::uint64_t seed) {
+  for (auto &word : mState)
+    word = splitMix64(seed);
+}
+
+Xoshiro256Plus::result_type Xoshiro256Plus::operator()() {
+  const auto result = mState[0] + mState[3];
+  const auto t = mState[1] << 17;
+  mState[2] ^= mState[0];
+  mState[3] ^= mState[1];
+  mState[1] ^= mState[2];
+  mState[0] ^= mState[3];
+  mState[2] ^= t;
+  mState[3] = std::rotl(mState[3], 45);
+  return result;
+}
+
+double Xoshiro256Plus::unit() {
+  const auto bits = ((*this)() >> 12) | 0x3FF0000000000000ULL;
+  return std::bit_cast<double>(bits) - 1.0;
+}
+
+double Xoshiro256Plus::uniform(double low, double high) {
+  return low + unit() * (high - low);
+}
+
+void Xoshiro256Plus::jump() {
+  constexpr std::uint64_t JUMP[] = {0x180EC6D33CFD0ABAULL,
+                                    0xD5A61266F0C9392CULL,
+                                    0xA9582618E03FC9AAULL,
+                                    0x39ABDC4529B1661CULL};
+  std::array<std::uint64_t, 4> state{};
+  for (const auto word : JUMP) {
+    for (int bit = 0; bit < 64; ++bit) {
+      if (word & (std::uint64_t(1) << bit)) {
+        for (std::size_t i = 0; i < state.size(); ++i)
+          state[i] ^= mState[i];
+      }
+      (*this)();
+    }
+  }
+  mState = state;
+}
+
+LaneRandom::LaneRandom(std::uint64_t seed) : mLanes{}, mScalar{seed} {
+  for (std::size_t lane = 0; lane < CpuDispatch::RANDOM_LANES; ++lane) {
+    mScalar.jump();
+    for (std::size_t i = 0; i < mScalar.mState.size(); ++i)
+      mLanes.mState[i][lane] = mScalar.mState[i];
+  }
+  mScalar.jump();
+}
+
+void LaneRandom::uniform(std::span<double> out, double low, double high) {
+  CpuDispatch::kernels().mRandomUniform(mLanes, out.data(), out.size(), low,
+                                        high - low);
+}
+
+double LaneRandom::uniform(double low, double high) {
+  return mScalar.uniform(low, high);
+}
+
+} // namespace Haversine::RandomUtils
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "cpu_dispatch.h"
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <span>
+
+namespace Haversine::RandomUtils {
+
+std::uint64_t splitMix64(std::uint64_t &state);
+
+// xoshiro256+ (Blackman & Vigna). The low bits are weak, so doubles are
+// built from the top 53 bits only. Satisfies UniformRandomBitGenerator.
+class Xoshiro256Plus {
+public:
+  using result_type = std::uint64_t;
+
+  explicit Xoshiro256Plus(std::uint64_t seed);
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() {
+    return std::numeric_limits<result_type>::max();
+  }
+
+  result_type operator()();
+  // Uniform in [0, 1).
+  double unit();
+  double uniform(double low, double high);
+  // Advances by 2^128 draws, to start a non-overlapping stream.
+  void jump();
+
+  std::array<std::uint64_t, 4> mState;
+};
+
+// CpuDispatch::RANDOM_LANES streams advanced together by the dispatched SIMD
+// kernel, plus a scalar side stream for the occasional single draw. The
+// output for a seed is the same whichever instruction set runs it.
+class LaneRandom {
+public:
+  explicit LaneRandom(std::uint64_t seed);
+
+  // Fills `out` with uniform values in [low, high).
+  void uniform(std::span<double> out, double low, double high);
+  double uniform(double low, double high);
+
+private:
+  CpuDispatch::RandomLanes mLanes;
+  Xoshiro256Plus mScalar;
+};
+
+} // namespace Haversine::RandomUtils
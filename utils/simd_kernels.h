@@ -0,0 +1,581 @@
+#pragma once
+
+// Templated source of the hot kernels. It is only included by the
+// kernels_<isa>.cc translation units, each compiled with its own -m flags and
+// supplying a policy with the vector width and the few operations that need
+// intrinsics. Everything here has internal linkage so the linker can never
+// hand an AVX-512 instantiation to the SSE2 table.
+
+#include "cpu_dispatch.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Haversine::CpuDispatch {
+namespace {
+
+template <typename T, std::size_t N> struct VectorOf {
+  typedef T Type __attribute__((vector_size(N)));
+};
+template <typename T, std::size_t N>
+using Vector = typename VectorOf<T, N>::Type;
+
+template <typename V, typename T> V load(const T *source) {
+  V result;
+  __builtin_memcpy(&result, source, sizeof(V));
+  return result;
+}
+
+template <typename V, typename T> void store(T *destination, V value) {
+  __builtin_memcpy(destination, &value, sizeof(V));
+}
+
+template <typename V, typename T> V splat(T value) { return V{} + value; }
+
+template <typename T> struct KernelConstants;
+
+template <> struct KernelConstants<double> {
+  static constexpr double PI_OVER_2 = 1.57079632679489661923;
+  static constexpr double PI_OVER_4 = 0.78539816339744830962;
+  static constexpr double PI = 3.14159265358979323846;
+  // Same (single precision) constant as radiansFromDegrees, so the batch
+  // kernel stays within a few ulps of referenceHaversine.
+  static constexpr double DEG_TO_RAD = 0.01745329251994329577f;
+
+  template <typename V> static V sinPoly(V x) {
+    const V z = x * x;
+    const V r =
+        8.33333333332248946124e-03 +
+        z * (-1.98412698298579493134e-04 +
+             z * (2.75573137070700676789e-06 +
+                  z * (-2.50507602534068634195e-08 +
+                       z * 1.58969099521155010221e-10)));
+    return x + x * z * (-1.66666666666666324348e-01 + z * r);
+  }
+
+  template <typename V> static V cosPoly(V x) {
+    const V z = x * x;
+    const V r =
+        4.16666666666666019037e-02 +
+        z * (-1.38888888888741095749e-03 +
+             z * (2.48015872894767294178e-05 +
+                  z * (-2.75573143513906633035e-07 +
+                       z * (2.08757232129817482790e-09 +
+                            z * -1.13596475577881948265e-11))));
+    return 1.0 - 0.5 * z + z * z * r;
+  }
+
+  template <typename V> static V asinRational(V z) {
+    const V p =
+        z * (1.66666666666666657415e-01 +
+             z * (-3.25565818622400915405e-01 +
+                  z * (2.01212532134862925881e-01 +
+                       z * (-4.00555345006794114027e-02 +
+                            z * (7.91534994289814532176e-04 +
+                                 z * 3.47933107596021167570e-05)))));
+    const V q =
+        1.0 + z * (-2.40339491173441421878e+00 +
+                   z * (2.02094576023350569471e+00 +
+                        z * (-6.88283971605453293030e-01 +
+                             z * 7.70381505559019352791e-02)));
+    return p / q;
+  }
+};
+
+template <> struct KernelConstants<float> {
+  static constexpr float PI_OVER_2 = 1.57079632679489661923f;
+  static constexpr float PI_OVER_4 = 0.78539816339744830962f;
+  static constexpr float PI = 3.14159265358979323846f;
+  static constexpr float DEG_TO_RAD = 0.01745329251994329577f;
+
+  template <typename V> static V sinPoly(V x) {
+    const V z = x * x;
+    const V r = 8.3333293858894631756e-03f +
+                z * (-1.98393348360966317347e-04f +
+                     z * 2.7183114939898219064e-06f);
+    return x + x * z * (-1.66666666416265235595e-01f + z * r);
+  }
+
+  template <typename V> static V cosPoly(V x) {
+    const V z = x * x;
+    const V r = 4.16666233237390631894e-02f +
+                z * (-1.38867637746099294692e-03f +
+                     z * 2.43904487962774090654e-05f);
+    return 1.0f - 0.5f * z + z * z * r;
+  }
+
+  template <typename V> static V asinRational(V z) {
+    const V p = z * (1.6666586697e-01f +
+                     z * (-4.2743422091e-02f + z * -8.6563630030e-03f));
+    const V q = 1.0f + z * -7.0662963390e-01f;
+    return p / q;
+  }
+};
+
+template <typename V> V absolute(V x) { return x < V{} ? -x : x; }
+
+// |sin(x)| for |x| <= pi/2, selecting between the two polynomials per lane.
+template <typename T, typename V> V absSinHalfTurn(V x) {
+  using K = KernelConstants<T>;
+  const V r = absolute(x);
+  const auto nearQuarter = r > splat<V>(K::PI_OVER_4);
+  const V t = nearQuarter ? K::PI_OVER_2 - r : r;
+  return nearQuarter ? K::cosPoly(t) : K::sinPoly(t);
+}
+
+// cos(x) for |x| <= pi/2.
+template <typename T, typename V> V cosHalfTurn(V x) {
+  using K = KernelConstants<T>;
+  const V r = absolute(x);
+  const auto nearQuarter = r > splat<V>(K::PI_OVER_4);
+  const V t = nearQuarter ? K::PI_OVER_2 - r : r;
+  return nearQuarter ? K::sinPoly(t) : K::cosPoly(t);
+}
+
+// asin(x) for x in [0, 1].
+template <typename Policy, typename T, typename V> V asinUnit(V x) {
+  using K = KernelConstants<T>;
+  const auto small = x < splat<V>(T(0.5));
+  const V z = small ? x * x : (T(1) - x) * T(0.5);
+  const V s = small ? x : Policy::sqrt(z);
+  const V r = s + s * K::asinRational(z);
+  return small ? r : K::PI_OVER_2 - T(2) * r;
+}
+
+template <typename Policy, typename T, typename V>
+V haversineLanes(V x0, V y0, V x1, V y1, T earthRadius) {
+  using K = KernelConstants<T>;
+  const V lat1 = y0 * K::DEG_TO_RAD;
+  const V lat2 = y1 * K::DEG_TO_RAD;
+  const V halfDLat = (y1 - y0) * (K::DEG_TO_RAD * T(0.5));
+  V halfDLon = absolute(x1 - x0) * (K::DEG_TO_RAD * T(0.5));
+  halfDLon =
+      halfDLon > splat<V>(K::PI_OVER_2) ? K::PI - halfDLon : halfDLon;
+
+  const V sinDLat = absSinHalfTurn<T>(halfDLat);
+  const V sinDLon = absSinHalfTurn<T>(halfDLon);
+  V a = sinDLat * sinDLat +
+        cosHalfTurn<T>(lat1) * cosHalfTurn<T>(lat2) * sinDLon * sinDLon;
+  a = a < splat<V>(T(1)) ? a : splat<V>(T(1));
+  return earthRadius * T(2) * asinUnit<Policy, T>(Policy::sqrt(a));
+}
+
+template <typename Policy, typename T>
+void haversineBatch(const T *x0, const T *y0, const T *x1, const T *y1,
+                    T *out, std::size_t count, T earthRadius) {
+  using V = Vector<T, Policy::BYTES>;
+  constexpr std::size_t LANES = Policy::BYTES / sizeof(T);
+  std::size_t i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    store(out + i,
+          haversineLanes<Policy, T>(load<V>(x0 + i), load<V>(y0 + i),
+                                    load<V>(x1 + i), load<V>(y1 + i),
+                                    earthRadius));
+  }
+  if (i == count)
+    return;
+
+  T tail[5][LANES] = {};
+  const auto remaining = count - i;
+  for (std::size_t lane = 0; lane < remaining; ++lane) {
+    tail[0][lane] = x0[i + lane];
+    tail[1][lane] = y0[i + lane];
+    tail[2][lane] = x1[i + lane];
+    tail[3][lane] = y1[i + lane];
+  }
+  store(tail[4], haversineLanes<Policy, T>(
+                     load<V>(tail[0]), load<V>(tail[1]), load<V>(tail[2]),
+                     load<V>(tail[3]), earthRadius));
+  for (std::size_t lane = 0; lane < remaining; ++lane)
+    out[i + lane] = tail[4][lane];
+}
+
+// Lanes where both coordinate differences are at most maxSpan radians take
+// the equirectangular approximation; whole vectors of them skip haversine.
+template <typename Policy>
+std::size_t haversineAdaptiveBatch(const double *x0, const double *y0,
+                                   const double *x1, const double *y1,
+                                   double *out, std::size_t count,
+                                   double earthRadius, double maxSpan) {
+  using K = KernelConstants<double>;
+  using V = Vector<double, Policy::BYTES>;
+  constexpr std::size_t LANES = Policy::BYTES / sizeof(double);
+  std::size_t shortPairs = 0;
+  auto lanes = [&](V lon0, V lat0, V lon1, V lat1, std::size_t active) {
+    const V dLat = (lat1 - lat0) * K::DEG_TO_RAD;
+    const V dLon = (lon1 - lon0) * K::DEG_TO_RAD;
+    const auto isShort = (absolute(dLat) <= splat<V>(maxSpan)) &
+                         (absolute(dLon) <= splat<V>(maxSpan));
+    std::size_t shortLanes = 0;
+    for (std::size_t lane = 0; lane < active; ++lane)
+      shortLanes += isShort[lane] != 0;
+    shortPairs += shortLanes;
+
+    const V meanLat = (lat0 + lat1) * (K::DEG_TO_RAD * 0.5);
+    const V x = dLon * cosHalfTurn<double>(meanLat);
+    const V flat = earthRadius * Policy::sqrt(x * x + dLat * dLat);
+    if (shortLanes == active)
+      return flat;
+    const V full =
+        haversineLanes<Policy, double>(lon0, lat0, lon1, lat1, earthRadius);
+    return isShort ? flat : full;
+  };
+
+  std::size_t i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    store(out + i, lanes(load<V>(x0 + i), load<V>(y0 + i), load<V>(x1 + i),
+                         load<V>(y1 + i), LANES));
+  }
+  if (i == count)
+    return shortPairs;
+
+  double tail[5][LANES] = {};
+  const auto remaining = count - i;
+  for (std::size_t lane = 0; lane < remaining; ++lane) {
+    tail[0][lane] = x0[i + lane];
+    tail[1][lane] = y0[i + lane];
+    tail[2][lane] = x1[i + lane];
+    tail[3][lane] = y1[i + lane];
+  }
+  store(tail[4], lanes(load<V>(tail[0]), load<V>(tail[1]), load<V>(tail[2]),
+                       load<V>(tail[3]), remaining));
+  for (std::size_t lane = 0; lane < remaining; ++lane)
+    out[i + lane] = tail[4][lane];
+  return shortPairs;
+}
+
+template <typename Policy, typename T>
+void haversineRow(T lat, T lon, T cosLat, const T *lats, const T *lons,
+                  const T *cosLats, T *out, std::size_t count,
+                  T earthRadius) {
+  using K = KernelConstants<T>;
+  using V = Vector<T, Policy::BYTES>;
+  constexpr std::size_t LANES = Policy::BYTES / sizeof(T);
+  auto lanes = [&](V lat1, V lon1, V cosLat1) {
+    const V halfDLat = (lat1 - lat) * T(0.5);
+    V halfDLon = absolute(lon1 - lon) * T(0.5);
+    halfDLon =
+        halfDLon > splat<V>(K::PI_OVER_2) ? K::PI - halfDLon : halfDLon;
+    const V sinDLat = absSinHalfTurn<T>(halfDLat);
+    const V sinDLon = absSinHalfTurn<T>(halfDLon);
+    V a = sinDLat * sinDLat + cosLat * cosLat1 * sinDLon * sinDLon;
+    a = a < splat<V>(T(1)) ? a : splat<V>(T(1));
+    return earthRadius * T(2) * asinUnit<Policy, T>(Policy::sqrt(a));
+  };
+
+  std::size_t i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    store(out + i,
+          lanes(load<V>(lats + i), load<V>(lons + i), load<V>(cosLats + i)));
+  }
+  if (i == count)
+    return;
+
+  T tail[4][LANES] = {};
+  const auto remaining = count - i;
+  for (std::size_t lane = 0; lane < remaining; ++lane) {
+    tail[0][lane] = lats[i + lane];
+    tail[1][lane] = lons[i + lane];
+    tail[2][lane] = cosLats[i + lane];
+  }
+  store(tail[3],
+        lanes(load<V>(tail[0]), load<V>(tail[1]), load<V>(tail[2])));
+  for (std::size_t lane = 0; lane < remaining; ++lane)
+    out[i + lane] = tail[3][lane];
+}
+
+// Loads one block of text; past the end it is filled with `padding`.
+template <typename Policy>
+Vector<unsigned char, Policy::BYTES> loadText(const char *text,
+                                              std::size_t size,
+                                              unsigned char padding) {
+  using B = Vector<unsigned char, Policy::BYTES>;
+  if (size >= Policy::BYTES)
+    return load<B>(text);
+  unsigned char block[Policy::BYTES];
+  __builtin_memset(block, padding, Policy::BYTES);
+  __builtin_memcpy(block, text, size);
+  return load<B>(block);
+}
+
+template <typename Policy>
+std::size_t skipWhitespace(const char *text, std::size_t size) {
+  using B = Vector<unsigned char, Policy::BYTES>;
+  for (std::size_t offset = 0; offset < size; offset += Policy::BYTES) {
+    const B block = loadText<Policy>(text + offset, size - offset, 'x');
+    const B whitespace = (block == ' ') | (block == '\n') | (block == '\r') |
+                         (block == '\t');
+    const std::uint64_t other = ~Policy::byteMask(whitespace) &
+                                Policy::FULL_MASK;
+    if (other != 0) {
+      const auto result = offset + std::size_t(__builtin_ctzll(other));
+      return result < size ? result : size;
+    }
+  }
+  return size;
+}
+
+template <typename Policy>
+std::size_t findStringSpecial(const char *text, std::size_t size) {
+  using B = Vector<unsigned char, Policy::BYTES>;
+  for (std::size_t offset = 0; offset < size; offset += Policy::BYTES) {
+    const B block = loadText<Policy>(text + offset, size - offset, '"');
+    const B special =
+        (block == '"') | (block == '\\') | (block < (unsigned char)0x20);
+    const std::uint64_t found = Policy::byteMask(special);
+    if (found != 0) {
+      const auto result = offset + std::size_t(__builtin_ctzll(found));
+      return result < size ? result : size;
+    }
+  }
+  return size;
+}
+
+template <typename Policy>
+std::size_t findNewline(const char *text, std::size_t size) {
+  using B = Vector<unsigned char, Policy::BYTES>;
+  for (std::size_t offset = 0; offset < size; offset += Policy::BYTES) {
+    const B block = loadText<Policy>(text + offset, size - offset, '\n');
+    const std::uint64_t found = Policy::byteMask(block == '\n');
+    if (found != 0) {
+      const auto result = offset + std::size_t(__builtin_ctzll(found));
+      return result < size ? result : size;
+    }
+  }
+  return size;
+}
+
+// Scalar UTF-8 check from a sequence boundary; used to pin down the exact
+// offset once the vector check has found a block with an error.
+std::size_t findUtf8Error(const unsigned char *text, std::size_t offset,
+                          std::size_t size) {
+  while (offset < size) {
+    const auto lead = text[offset];
+    if (lead < 0x80) {
+      ++offset;
+      continue;
+    }
+    std::size_t length = 0;
+    unsigned char low = 0x80;
+    unsigned char high = 0xBF;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+      length = 2;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+      length = 3;
+      low = lead == 0xE0 ? 0xA0 : 0x80;
+      high = lead == 0xED ? 0x9F : 0xBF;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+      length = 4;
+      low = lead == 0xF0 ? 0x90 : 0x80;
+      high = lead == 0xF4 ? 0x8F : 0xBF;
+    } else {
+      return offset;
+    }
+    if (size - offset < length || text[offset + 1] < low ||
+        text[offset + 1] > high)
+      return offset;
+    for (std::size_t i = 2; i < length; ++i) {
+      if ((text[offset + i] & 0xC0) != 0x80)
+        return offset;
+    }
+    offset += length;
+  }
+  return size;
+}
+
+// Classifies every byte of a block into bit masks and checks that
+// continuation bytes appear exactly where the lead bytes require them, and
+// that the bytes after E0, ED, F0 and F4 exclude overlong forms, surrogates
+// and code points above U+10FFFF. Only compares and byteMask are needed, so
+// SSE2 runs the same algorithm. Requirements that cross into the next block
+// are carried in the bits shifted past the block.
+template <typename Policy>
+std::size_t validateUtf8(const char *text, std::size_t size) {
+  using B = Vector<unsigned char, Policy::BYTES>;
+  using Wide = unsigned __int128;
+  struct SecondByteRule {
+    unsigned char mLead, mForbiddenLow, mForbiddenHigh;
+  };
+  constexpr SecondByteRule RULES[] = {
+      {0xE0, 0x80, 0x9F}, {0xED, 0xA0, 0xBF}, {0xF0, 0x80, 0x8F},
+      {0xF4, 0x90, 0xBF}};
+
+  const auto *bytes = reinterpret_cast<const unsigned char *>(text);
+  auto mask = [](auto condition) {
+    return Wide(Policy::byteMask(B(condition)));
+  };
+  auto inRange = [](B block, unsigned char low, unsigned char high) {
+    return (block >= low) & (block <= high);
+  };
+
+  Wide pending = 0;
+  Wide pendingSecond[4] = {};
+  std::size_t offset = 0;
+  for (; offset < size; offset += Policy::BYTES) {
+    const B block = loadText<Policy>(text + offset, size - offset, 0);
+    const Wide nonAscii = mask(block >= (unsigned char)0x80);
+    if (nonAscii == 0 && pending == 0)
+      continue;
+
+    const Wide continuation = mask(block <= (unsigned char)0xBF) & nonAscii;
+    const Wide lead2 = mask(inRange(block, 0xC2, 0xDF));
+    const Wide lead3 = mask(inRange(block, 0xE0, 0xEF));
+    const Wide lead4 = mask(inRange(block, 0xF0, 0xF4));
+    const Wide required = ((lead2 | lead3 | lead4) << 1) |
+                          ((lead3 | lead4) << 2) | (lead4 << 3) | pending;
+    Wide errors = (required ^ continuation) |
+                  mask(block >= (unsigned char)0xF5) |
+                  mask(inRange(block, 0xC0, 0xC1));
+    for (std::size_t rule = 0; rule < 4; ++rule) {
+      const Wide second =
+          (mask(block == RULES[rule].mLead) << 1) | pendingSecond[rule];
+      errors |= second & mask(inRange(block, RULES[rule].mForbiddenLow,
+                                      RULES[rule].mForbiddenHigh));
+      pendingSecond[rule] = second >> Policy::BYTES;
+    }
+    pending = required >> Policy::BYTES;
+    if (errors & Policy::FULL_MASK)
+      break;
+  }
+  if (offset >= size && pending == 0)
+    return size;
+
+  // Everything before the failing block is valid, so rescanning from the
+  // start of the sequence that runs into it finds the exact offset.
+  auto start = offset < size ? offset : size;
+  for (std::size_t back = 1; back <= 3 && back <= start; ++back) {
+    const auto byte = bytes[start - back];
+    if ((byte & 0xC0) == 0x80)
+      continue;
+    if (byte >= 0xC0)
+      start -= back;
+    break;
+  }
+  return findUtf8Error(bytes, start, size);
+}
+
+template <typename V> V rotateLeft(V value, int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+// No contraction into FMA: the scaled values must be bit-identical across
+// the instruction sets.
+template <typename Policy>
+__attribute__((optimize("fp-contract=off"))) void
+randomUniform(RandomLanes &lanes, double *out, std::size_t count, double low,
+              double width) {
+  using U = Vector<std::uint64_t, Policy::BYTES>;
+  using D = Vector<double, Policy::BYTES>;
+  constexpr std::size_t LANES = Policy::BYTES / sizeof(std::uint64_t);
+  constexpr std::size_t GROUPS = RANDOM_LANES / LANES;
+  static_assert(GROUPS * LANES == RANDOM_LANES);
+
+  U s0[GROUPS], s1[GROUPS], s2[GROUPS], s3[GROUPS];
+  for (std::size_t g = 0; g < GROUPS; ++g) {
+    s0[g] = load<U>(&lanes.mState[0][g * LANES]);
+    s1[g] = load<U>(&lanes.mState[1][g * LANES]);
+    s2[g] = load<U>(&lanes.mState[2][g * LANES]);
+    s3[g] = load<U>(&lanes.mState[3][g * LANES]);
+  }
+
+  for (std::size_t offset = 0; offset < count; offset += RANDOM_LANES) {
+    double round[RANDOM_LANES];
+    for (std::size_t g = 0; g < GROUPS; ++g) {
+      // xoshiro256+: the top 53 bits become the mantissa of a double in
+      // [1, 2), which is shifted down to [0, 1) and scaled.
+      const U bits = ((s0[g] + s3[g]) >> 12) | 0x3FF0000000000000ULL;
+      const D unit = D(bits) - 1.0;
+      const U t = s1[g] << 17;
+      s2[g] ^= s0[g];
+      s3[g] ^= s1[g];
+      s1[g] ^= s2[g];
+      s0[g] ^= s3[g];
+      s2[g] ^= t;
+      s3[g] = rotateLeft(s3[g], 45);
+      const D value = low + unit * width;
+      if (offset + RANDOM_LANES <= count)
+        store(out + offset + g * LANES, value);
+      else
+        store(round + g * LANES, value);
+    }
+    if (offset + RANDOM_LANES > count) {
+      for (std::size_t i = 0; offset + i < count; ++i)
+        out[offset + i] = round[i];
+    }
+  }
+
+  for (std::size_t g = 0; g < GROUPS; ++g) {
+    store(&lanes.mState[0][g * LANES], s0[g]);
+    store(&lanes.mState[1][g * LANES], s1[g]);
+    store(&lanes.mState[2][g * LANES], s2[g]);
+    store(&lanes.mState[3][g * LANES], s3[g]);
+  }
+}
+
+template <typename Policy>
+BlockMoments blockMoments(const double *values, std::size_t count) {
+  using D = Vector<double, Policy::BYTES>;
+  constexpr std::size_t LANES = Policy::BYTES / sizeof(double);
+  D sum{};
+  D minimum = splat<D>(values[0]);
+  D maximum = minimum;
+  std::size_t i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    const auto value = load<D>(values + i);
+    sum += value;
+    minimum = value < minimum ? value : minimum;
+    maximum = value > maximum ? value : maximum;
+  }
+  BlockMoments result{.mSum = 0,
+                      .mMin = minimum[0],
+                      .mMax = maximum[0],
+                      .mM2 = 0};
+  // Not std::min and std::max: their instantiations are weak symbols that
+  // another kernel translation unit could end up calling.
+  auto include = [&](double value) {
+    result.mMin = value < result.mMin ? value : result.mMin;
+    result.mMax = value > result.mMax ? value : result.mMax;
+  };
+  for (std::size_t lane = 0; lane < LANES; ++lane) {
+    result.mSum += sum[lane];
+    include(minimum[lane]);
+    include(maximum[lane]);
+  }
+  for (; i < count; ++i) {
+    result.mSum += values[i];
+    include(values[i]);
+  }
+
+  const auto mean = result.mSum / double(count);
+  D m2{};
+  i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    const auto deviation = load<D>(values + i) - mean;
+    m2 += deviation * deviation;
+  }
+  for (std::size_t lane = 0; lane < LANES; ++lane)
+    result.mM2 += m2[lane];
+  for (; i < count; ++i)
+    result.mM2 += (values[i] - mean) * (values[i] - mean);
+  return result;
+}
+
+template <typename Policy> constexpr KernelTable makeKernelTable() {
+  return KernelTable{
+      .mIsa = Policy::ISA,
+      .mHaversineF64 = &haversineBatch<Policy, double>,
+      .mHaversineF32 = &haversineBatch<Policy, float>,
+      .mHaversineAdaptiveF64 = &haversineAdaptiveBatch<Policy>,
+      .mHaversineRowF64 = &haversineRow<Policy, double>,
+      .mHaversineRowF32 = &haversineRow<Policy, float>,
+      .mSkipWhitespace = &skipWhitespace<Policy>,
+      .mFindStringSpecial = &findStringSpecial<Policy>,
+      .mFindNewline = &findNewline<Policy>,
+      .mValidateUtf8 = &validateUtf8<Policy>,
+      .mRandomUniform = &randomUniform<Policy>,
+      .mBlockMoments = &blockMoments<Policy>,
+  };
+}
+
+} // namespace
+} // namespace Haversine::CpuDispatch
@@ -0,0 +1,399 @@
+#include "thread_pool.h"
+#include "timing_utils.h"
+#include "trace.h"
+
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+extern "C" {
+#include <sched.h>
+}
+
+namespace Haversine::ThreadPool {
+
+namespace {
+std::vector<int> allowedCpus() {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  std::vector<int> result;
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &set))
+        result.push_back(cpu);
+    }
+  }
+  if (result.empty())
+    result.push_back(0);
+  return result;
+}
+
+// Parses a sysfs cpulist such as "0-3,8-11".
+std::vector<int> cpusFromList(std::string_view list) {
+  std::vector<int> result;
+  while (!list.empty()) {
+    const auto comma = list.find(',');
+    const auto range = list.substr(0, comma);
+    const auto dash = range.find('-');
+    const auto first =
+        int(CliUtils::u64From(range.substr(0, dash), "Invalid cpulist: "));
+    const auto last =
+        dash == std::string_view::npos
+            ? first
+            : int(CliUtils::u64From(range.substr(dash + 1),
+                                    "Invalid cpulist: "));
+    for (int cpu = first; cpu <= last; ++cpu)
+      result.push_back(cpu);
+    if (comma == std::string_view::npos)
+      break;
+    list.remove_prefix(comma + 1);
+  }
+  return result;
+}
+
+// CPUs of every NUMA node, restricted to the allowed ones; a machine without
+// node information is one node.
+std::vector<std::vector<int>> numaNodes(const std::vector<int> &allowed) {
+  std::vector<std::vector<int>> result;
+  for (int node = 0;; ++node) {
+    std::ifstream file("/sys/devices/system/node/node" +
+                       std::to_string(node) + "/cpulist");
+    std::string list;
+    if (!file || !std::getline(file, list))
+      break;
+    std::vector<int> cpus;
+    for (int cpu : cpusFromList(list)) {
+      if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end())
+        cpus.push_back(cpu);
+    }
+    if (!cpus.empty())
+      result.push_back(std::move(cpus));
+  }
+  if (result.empty())
+    result.push_back(allowed);
+  return result;
+}
+
+void pinCurrentThread(const std::vector<int> &cpus) {
+  if (cpus.empty())
+    return;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus)
+    CPU_SET(cpu, &set);
+  if (sched_setaffinity(0, sizeof(set), &set) != 0)
+    throw std::runtime_error("Unable to pin worker to CPU " +
+                             std::to_string(cpus.front()));
+}
+
+std::vector<std::vector<int>> workerCpus(std::uint32_t threads,
+                                         Pinning pinning,
+                                         const std::vector<int> &allowed) {
+  std::vector<std::vector<int>> result(threads);
+  if (pinning == Pinning::CORES) {
+    for (std::uint32_t i = 0; i < threads; ++i)
+      result[i] = {allowed[i % allowed.size()]};
+  } else if (pinning == Pinning::NUMA) {
+    const auto nodes = numaNodes(allowed);
+    for (std::uint32_t i = 0; i < threads; ++i)
+      result[i] = nodes[i % nodes.size()];
+  }
+  return result;
+}
+
+thread_local std::uint32_t tCurrentWorker = 0;
+
+void relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+} // namespace
+
+Pinning pinningFrom(std::string_view rawText) {
+  if (rawText == "none")
+    return Pinning::NONE;
+  if (rawText == "cores")
+    return Pinning::CORES;
+  if (rawText == "numa")
+    return Pinning::NUMA;
+
+  std::string errorMessage = "Unrecognized pinning: ";
+  errorMessage.append(rawText);
+  throw std::runtime_error(errorMessage);
+}
+
+std::string_view pinningToStrView(Pinning pinning) {
+  switch (pinning) {
+  case Pinning::NONE: {
+    return "none";
+  } break;
+  case Pinning::CORES: {
+    return "cores";
+  } break;
+  case Pinning::NUMA: {
+    return "numa";
+  } break;
+  default:
+    break;
+  }
+  std::string errorMessage = "Invalid value for pinning: ";
+  errorMessage.append(std::to_string(int(pinning)));
+  throw std::runtime_error(errorMessage);
+}
+
+PoolOptions PoolOptions::from(const CliUtils::CommandLineOptions &options) {
+  PoolOptions result;
+  if (auto rawThreads = options.value("threads")) {
+    result.mThreads =
+        std::uint32_t(CliUtils::u64From(*rawThreads, "Invalid threads: "));
+    if (result.mThreads == 0)
+      throw std::runtime_error("Invalid threads: 0");
+  }
+  if (auto rawPinning = options.value("pin"))
+    result.mPinning = pinningFrom(*rawPinning);
+  return result;
+}
+
+bool WorkStealingDeque::push(Task *task) {
+  const auto bottom = mBottom.load(std::memory_order_relaxed);
+  const auto top = mTop.load(std::memory_order_acquire);
+  if (bottom - top >= CAPACITY)
+    return false;
+  mBuffer[bottom & (CAPACITY - 1)].store(task, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  mBottom.store(bottom + 1, std::memory_order_relaxed);
+  return true;
+}
+
+Task *WorkStealingDeque::pop() {
+  const auto bottom = mBottom.load(std::memory_order_relaxed) - 1;
+  mBottom.store(bottom, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  auto top = mTop.load(std::memory_order_relaxed);
+  if (top > bottom) {
+    mBottom.store(bottom + 1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  auto *task = mBuffer[bottom & (CAPACITY - 1)].load(std::memory_order_relaxed);
+  if (top == bottom) {
+    // Last task: race the thieves for it.
+    if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed))
+      task = nullptr;
+    mBottom.store(bottom + 1, std::memory_order_relaxed);
+  }
+  return task;
+}
+
+Task *WorkStealingDeque::steal() {
+  auto top = mTop.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  const auto bottom = mBottom.load(std::memory_order_acquire);
+  if (top >= bottom)
+    return nullptr;
+  auto *task = mBuffer[top & (CAPACITY - 1)].load(std::memory_order_relaxed);
+  if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                    std::memory_order_relaxed))
+    return nullptr;
+  return task;
+}
+
+Pool::Pool(const PoolOptions &options) : mPinning{options.mPinning} {
+  const auto allowed = allowedCpus();
+  const auto threads = options.mThreads != 0
+                           ? options.mThreads
+                           : std::uint32_t(allowed.size());
+  const auto cpus = workerCpus(threads, mPinning, allowed);
+
+  for (std::uint32_t i = 0; i < threads; ++i) {
+    mWorkers.push_back(std::make_unique<Worker>());
+    mWorkers.back()->mRandomState = 0x9E3779B97F4A7C15ULL * (i + 1);
+  }
+  pinCurrentThread(cpus[0]);
+  for (std::uint32_t i = 1; i < threads; ++i) {
+    mWorkers[i]->mThread = std::thread([this, i, workerCpus = cpus[i]] {
+      tCurrentWorker = i;
+      Trace::setThreadName("worker " + std::to_string(i));
+      pinCurrentThread(workerCpus);
+      workerLoop(i);
+    });
+  }
+}
+
+Pool::~Pool() {
+  mStop.store(true, std::memory_order_release);
+  mEpoch.fetch_add(1, std::memory_order_release);
+  mEpoch.notify_all();
+  for (auto &worker : mWorkers) {
+    if (worker->mThread.joinable())
+      worker->mThread.join();
+  }
+}
+
+std::uint32_t Pool::currentWorker() { return tCurrentWorker; }
+
+void Pool::run(std::uint64_t chunkCount, ChunkFunction function,
+               void *context) {
+  mFunction = function;
+  mContext = context;
+  // Halving never creates more than 2 * chunkCount - 1 tasks.
+  if (mTasks.size() < 2 * chunkCount)
+    mTasks.resize(2 * chunkCount);
+  mNextTask.store(0, std::memory_order_relaxed);
+  mRemainingChunks.store(chunkCount, std::memory_order_release);
+
+  auto *root = allocateTask(0, chunkCount);
+  if (mWorkers.size() == 1 || !mWorkers[0]->mDeque.push(root)) {
+    execute(0, root);
+  } else {
+    mEpoch.fetch_add(1, std::memory_order_release);
+    mEpoch.notify_all();
+  }
+  // Halves pushed by the first task are still queued on a single worker.
+  helpUntilDone(0);
+}
+
+void Pool::workerLoop(std::uint32_t index) {
+  auto &worker = *mWorkers[index];
+  // Workers start from the epoch at construction: a thread scheduled late
+  // must still see the calls, or the shutdown, that happened before it ran.
+  std::uint32_t seenEpoch = 0;
+  while (true) {
+    const auto waitStart = TimingUtils::readOsTimer();
+    mEpoch.wait(seenEpoch, std::memory_order_acquire);
+    seenEpoch = mEpoch.load(std::memory_order_acquire);
+    worker.mIdleTicks.fetch_add(TimingUtils::readOsTimer() - waitStart,
+                                std::memory_order_relaxed);
+    if (mStop.load(std::memory_order_acquire))
+      return;
+    helpUntilDone(index);
+  }
+}
+
+void Pool::helpUntilDone(std::uint32_t index) {
+  auto &worker = *mWorkers[index];
+  const auto start = TimingUtils::readOsTimer();
+  const auto busyBefore = worker.mBusyTicks.load(std::memory_order_relaxed);
+  std::uint32_t misses = 0;
+  while (mRemainingChunks.load(std::memory_order_acquire) != 0) {
+    if (tryRunOne(index)) {
+      misses = 0;
+    } else if (++misses < 64) {
+      relax();
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  const auto busy =
+      worker.mBusyTicks.load(std::memory_order_relaxed) - busyBefore;
+  worker.mIdleTicks.fetch_add(TimingUtils::readOsTimer() - start - busy,
+                              std::memory_order_relaxed);
+}
+
+bool Pool::tryRunOne(std::uint32_t index) {
+  auto &worker = *mWorkers[index];
+  if (auto *task = worker.mDeque.pop()) {
+    execute(index, task);
+    return true;
+  }
+  if (mWorkers.size() < 2)
+    return false;
+
+  // xorshift64 picks the victim.
+  auto &state = worker.mRandomState;
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  auto victim = std::uint32_t(state % (mWorkers.size() - 1));
+  if (victim >= index)
+    ++victim;
+  if (auto *task = mWorkers[victim]->mDeque.steal()) {
+    worker.mSteals.fetch_add(1, std::memory_order_relaxed);
+    execute(index, task);
+    return true;
+  }
+  worker.mFailedSteals.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+void Pool::execute(std::uint32_t index, Task *task) {
+  auto &worker = *mWorkers[index];
+  const auto start = TimingUtils::readOsTimer();
+  auto begin = task->mBegin;
+  auto end = task->mEnd;
+  while (end - begin > 1) {
+    const auto middle = begin + (end - begin) / 2;
+    if (!worker.mDeque.push(allocateTask(middle, end)))
+      break;
+    end = middle;
+  }
+  {
+    Trace::Scope scope{"task", begin};
+    mFunction(mContext, begin, end);
+  }
+  worker.mTasks.fetch_add(1, std::memory_order_relaxed);
+  worker.mBusyTicks.fetch_add(TimingUtils::readOsTimer() - start,
+                              std::memory_order_relaxed);
+  mRemainingChunks.fetch_sub(end - begin, std::memory_order_acq_rel);
+}
+
+Task *Pool::allocateTask(std::uint64_t begin, std::uint64_t end) {
+  auto &task = mTasks[mNextTask.fetch_add(1, std::memory_order_relaxed)];
+  task = Task{.mBegin = begin, .mEnd = end};
+  return &task;
+}
+
+std::vector<WorkerStats> Pool::stats() const {
+  std::vector<WorkerStats> result;
+  for (const auto &worker : mWorkers) {
+    result.push_back(WorkerStats{
+        .mTasks = worker->mTasks.load(std::memory_order_relaxed),
+        .mSteals = worker->mSteals.load(std::memory_order_relaxed),
+        .mFailedSteals = worker->mFailedSteals.load(std::memory_order_relaxed),
+        .mBusyTicks = worker->mBusyTicks.load(std::memory_order_relaxed),
+        .mIdleTicks = worker->mIdleTicks.load(std::memory_order_relaxed)});
+  }
+  return result;
+}
+
+void Pool::resetStats() {
+  for (auto &worker : mWorkers) {
+    worker->mTasks.store(0, std::memory_order_relaxed);
+    worker->mSteals.store(0, std::memory_order_relaxed);
+    worker->mFailedSteals.store(0, std::memory_order_relaxed);
+    worker->mBusyTicks.store(0, std::memory_order_relaxed);
+    worker->mIdleTicks.store(0, std::memory_order_relaxed);
+  }
+}
+
+void Pool::printStats(CliUtils::IoBufferedWriter &out) const {
+  auto printMs = [&](std::uint64_t ticks) {
+    out.printNumber(TimingUtils::secondsFromOsTicks(ticks) * 1e3,
+                    std::chars_format::fixed, 3);
+    out.printSv(" ms");
+  };
+  out.printSv("Thread pool: ");
+  out.printNumber(mWorkers.size());
+  out.printSv(" workers, pinning ");
+  out.printSv(pinningToStrView(mPinning));
+  out.printSv("\n");
+  const auto all = stats();
+  for (std::size_t i = 0; i < all.size(); ++i) {
+    out.printSv("Worker ");
+    out.printNumber(i);
+    out.printSv(": tasks ");
+    out.printNumber(all[i].mTasks);
+    out.printSv(", steals ");
+    out.printNumber(all[i].mSteals);
+    out.printSv(" (");
+    out.printNumber(all[i].mFailedSteals);
+    out.printSv(" failed), busy ");
+    printMs(all[i].mBusyTicks);
+    out.printSv(", idle ");
+    printMs(all[i].mIdleTicks);
+    out.printSv("\n");
+  }
+}
+
+} // namespace Haversine::ThreadPool
@@ -0,0 +1,178 @@
+#pragma once
+
+#include "cli_utils.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace Haversine::ThreadPool {
+
+enum class Pinning : std::uint8_t { NONE, CORES, NUMA };
+
+Pinning pinningFrom(std::string_view rawText);
+std::string_view pinningToStrView(Pinning pinning);
+
+struct Task {
+  std::uint64_t mBegin;
+  std::uint64_t mEnd;
+};
+
+// Chase-Lev work-stealing deque (Le et al., "Correct and Efficient
+// Work-Stealing for Weak Memory Models"). Only the owner pushes and pops at
+// the bottom; thieves take from the top. Fixed capacity: a full deque makes
+// push fail and the owner keeps the work.
+class WorkStealingDeque {
+public:
+  static constexpr std::int64_t CAPACITY = 1024;
+
+  bool push(Task *task);
+  Task *pop();
+  Task *steal();
+
+private:
+  alignas(64) std::atomic<std::int64_t> mTop{0};
+  alignas(64) std::atomic<std::int64_t> mBottom{0};
+  std::array<std::atomic<Task *>, CAPACITY> mBuffer{};
+};
+
+struct WorkerStats {
+  std::uint64_t mTasks{0};
+  std::uint64_t mSteals{0};
+  std::uint64_t mFailedSteals{0};
+  std::uint64_t mBusyTicks{0};
+  std::uint64_t mIdleTicks{0};
+};
+
+struct PoolOptions {
+  // From --threads=N and --pin=none|cores|numa.
+  static PoolOptions from(const CliUtils::CommandLineOptions &options);
+
+  // 0 uses every CPU the process may run on.
+  std::uint32_t mThreads = 0;
+  Pinning mPinning = Pinning::NONE;
+};
+
+// Work-stealing pool. The thread that creates it is worker 0 and takes part
+// in every parallel call; parallelFor and parallelReduce must only be called
+// from that thread, and not from inside a task.
+//
+// A call splits [begin, end) into grain-sized chunks aligned to begin.
+// Ranges of chunks are split in halves lazily: a worker pushes the upper half
+// onto its deque and keeps going with the lower one, so idle workers steal
+// the largest pieces first.
+class Pool {
+public:
+  explicit Pool(const PoolOptions &options = {});
+  ~Pool();
+  Pool(const Pool &) = delete;
+  Pool &operator=(const Pool &) = delete;
+
+  std::uint32_t size() const { return std::uint32_t(mWorkers.size()); }
+  // Index of the worker running the caller, below size(); 0 outside pool
+  // threads. Lets a body keep one accumulator per worker.
+  static std::uint32_t currentWorker();
+  Pinning pinning() const { return mPinning; }
+
+  // body(chunkBegin, chunkEnd) for every chunk, in any order.
+  template <typename Body>
+  void parallelFor(std::uint64_t begin, std::uint64_t end, std::uint64_t grain,
+                   Body &&body);
+
+  // Maps every chunk and folds the results in chunk order starting from
+  // `init`, so the result does not depend on the number of workers.
+  template <typename T, typename Map, typename Combine>
+  T parallelReduce(std::uint64_t begin, std::uint64_t end,
+                   std::uint64_t grain, T init, Map &&map, Combine &&combine);
+
+  std::vector<WorkerStats> stats() const;
+  void resetStats();
+  void printStats(CliUtils::IoBufferedWriter &out) const;
+
+private:
+  struct alignas(64) Worker {
+    WorkStealingDeque mDeque;
+    std::atomic<std::uint64_t> mTasks{0};
+    std::atomic<std::uint64_t> mSteals{0};
+    std::atomic<std::uint64_t> mFailedSteals{0};
+    std::atomic<std::uint64_t> mBusyTicks{0};
+    std::atomic<std::uint64_t> mIdleTicks{0};
+    std::uint64_t mRandomState{0};
+    std::thread mThread;
+  };
+
+  using ChunkFunction = void (*)(void *context, std::uint64_t firstChunk,
+                                 std::uint64_t lastChunk);
+
+  void run(std::uint64_t chunkCount, ChunkFunction function, void *context);
+  void workerLoop(std::uint32_t index);
+  // Runs or steals tasks until the current call has no chunks left.
+  void helpUntilDone(std::uint32_t index);
+  bool tryRunOne(std::uint32_t index);
+  void execute(std::uint32_t index, Task *task);
+  Task *allocateTask(std::uint64_t begin, std::uint64_t end);
+
+  std::vector<std::unique_ptr<Worker>> mWorkers;
+  Pinning mPinning;
+
+  // Current call; written by worker 0 before the epoch is bumped.
+  ChunkFunction mFunction{nullptr};
+  void *mContext{nullptr};
+  std::vector<Task> mTasks;
+  std::atomic<std::uint64_t> mNextTask{0};
+  std::atomic<std::uint64_t> mRemainingChunks{0};
+
+  // 32 bits so that wait() maps directly onto a futex.
+  std::atomic<std::uint32_t> mEpoch{0};
+  std::atomic<bool> mStop{false};
+};
+
+template <typename Body>
+void Pool::parallelFor(std::uint64_t begin, std::uint64_t end,
+                       std::uint64_t grain, Body &&body) {
+  if (end <= begin)
+    return;
+  grain = std::max<std::uint64_t>(grain, 1);
+  struct Context {
+    std::uint64_t mBegin, mEnd, mGrain;
+    std::remove_reference_t<Body> *mBody;
+  } context{begin, end, grain, &body};
+  run((end - begin + grain - 1) / grain,
+      [](void *raw, std::uint64_t firstChunk, std::uint64_t lastChunk) {
+        auto &ctx = *static_cast<Context *>(raw);
+        for (auto chunk = firstChunk; chunk < lastChunk; ++chunk) {
+          const auto chunkBegin = ctx.mBegin + chunk * ctx.mGrain;
+          (*ctx.mBody)(chunkBegin,
+                       std::min(chunkBegin + ctx.mGrain, ctx.mEnd));
+        }
+      },
+      &context);
+}
+
+template <typename T, typename Map, typename Combine>
+T Pool::parallelReduce(std::uint64_t begin, std::uint64_t end,
+                       std::uint64_t grain, T init, Map &&map,
+                       Combine &&combine) {
+  if (end <= begin)
+    return init;
+  grain = std::max<std::uint64_t>(grain, 1);
+  // Optional so that T needs no default constructor.
+  std::vector<std::optional<T>> partials((end - begin + grain - 1) / grain);
+  parallelFor(begin, end, grain,
+              [&](std::uint64_t chunkBegin, std::uint64_t chunkEnd) {
+                partials[(chunkBegin - begin) / grain].emplace(
+                    map(chunkBegin, chunkEnd));
+              });
+  for (auto &partial : partials)
+    init = combine(std::move(init), *partial);
+  return init;
+}
+
+} // namespace Haversine::ThreadPool
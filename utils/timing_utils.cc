@@ -0,0 +1,41 @@
+#include "timing_utils.h"
+
+#include <x86intrin.h>
+
+extern "C" {
+#include <time.h>
+}
+
+namespace Haversine::TimingUtils {
+std::uint64_t getOsTimerFreq() { return 1000000000ULL; }
+
+std::uint64_t readOsTimer() {
+  timespec value{};
+  clock_gettime(CLOCK_MONOTONIC, &value);
+  return getOsTimerFreq() * std::uint64_t(value.tv_sec) +
+         std::uint64_t(value.tv_nsec);
+}
+
+std::uint64_t readCpuTimer() { return __rdtsc(); }
+
+std::uint64_t estimateCpuTimerFreq(std::uint64_t millisecondsToWait) {
+  const auto osFreq = getOsTimerFreq();
+  const auto osWaitTime = osFreq * millisecondsToWait / 1000;
+
+  const auto cpuStart = readCpuTimer();
+  const auto osStart = readOsTimer();
+  auto osEnd = osStart;
+  auto osElapsed = 0ULL;
+  while (osElapsed < osWaitTime) {
+    osEnd = readOsTimer();
+    osElapsed = osEnd - osStart;
+  }
+  const auto cpuElapsed = readCpuTimer() - cpuStart;
+
+  return osElapsed ? osFreq * cpuElapsed / osElapsed : 0;
+}
+
+double secondsFromOsTicks(std::uint64_t ticks) {
+  return double(ticks) / double(getOsTimerFreq());
+}
+} // namespace Haversine::TimingUtils
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Haversine::TimingUtils {
+std::uint64_t getOsTimerFreq();
+std::uint64_t readOsTimer();
+std::uint64_t readCpuTimer();
+std::uint64_t estimateCpuTimerFreq(std::uint64_t millisecondsToWait = 100);
+
+double secondsFromOsTicks(std::uint64_t ticks);
+} // namespace Haversine::TimingUtils
@@ -0,0 +1,177 @@
+#include "trace.h"
+#include "cli_utils.h"
+#include "timing_utils.h"
+
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+namespace Haversine::Trace {
+
+namespace Detail {
+constinit std::atomic<bool> gEnabled{false};
+constinit thread_local Buffer tBuffer;
+} // namespace Detail
+
+namespace {
+// 512 KiB per block.
+constexpr std::size_t BLOCK_EVENTS = 16384;
+
+// Blocks are zeroed when allocated, so the recorded part of the last one ends
+// at the first event without a phase.
+struct ThreadTrace {
+  std::uint64_t mId{0};
+  std::string mName;
+  std::vector<std::unique_ptr<Detail::Event[]>> mBlocks;
+};
+
+// Owns every thread's blocks, so they outlive the threads that wrote them.
+struct Registry {
+  std::mutex mMutex;
+  std::vector<std::unique_ptr<ThreadTrace>> mThreads;
+  std::string mFilename;
+  std::uint64_t mStartTimestamp{0};
+  std::uint64_t mStartOsTicks{0};
+  bool mWriteAtExit{false};
+};
+
+Registry &registry() {
+  static Registry instance;
+  return instance;
+}
+
+thread_local ThreadTrace *tThread = nullptr;
+thread_local std::string tThreadName;
+
+void writeAtExit() {
+  try {
+    write(registry().mFilename);
+  } catch (const std::exception &e) {
+    CliUtils::print(e.what(), STDERR_FILENO);
+    CliUtils::print("\n", STDERR_FILENO);
+  }
+}
+} // namespace
+
+Detail::Event *Detail::grow() {
+  if (!tThread) {
+    auto &instance = registry();
+    std::lock_guard lock{instance.mMutex};
+    auto thread = std::make_unique<ThreadTrace>();
+    thread->mId = instance.mThreads.size();
+    thread->mName = tThreadName.empty()
+                        ? "thread " + std::to_string(thread->mId)
+                        : tThreadName;
+    tThread = thread.get();
+    instance.mThreads.push_back(std::move(thread));
+  }
+  auto block = std::make_unique<Event[]>(BLOCK_EVENTS);
+  auto *first = block.get();
+  tBuffer = Buffer{.mNext = first + 1, .mEnd = first + BLOCK_EVENTS};
+  tThread->mBlocks.push_back(std::move(block));
+  return first;
+}
+
+void enable(std::string_view filename) {
+  auto &instance = registry();
+  if (tThreadName.empty())
+    setThreadName("main");
+  instance.mFilename = filename;
+  instance.mStartTimestamp = __rdtsc();
+  instance.mStartOsTicks = TimingUtils::readOsTimer();
+  // Registered after the registry was constructed, so it runs before the
+  // registry is destroyed.
+  if (!instance.mWriteAtExit) {
+    instance.mWriteAtExit = true;
+    std::atexit(writeAtExit);
+  }
+  Detail::gEnabled.store(true, std::memory_order_relaxed);
+}
+
+bool enabled() { return Detail::gEnabled.load(std::memory_order_relaxed); }
+
+void setThreadName(std::string_view name) {
+  tThreadName = name;
+  if (tThread) {
+    std::lock_guard lock{registry().mMutex};
+    tThread->mName = tThreadName;
+  }
+}
+
+void write(std::string_view filename) {
+  // Writing flushes buffers, which would record events of its own.
+  Detail::gEnabled.store(false, std::memory_order_relaxed);
+  auto &instance = registry();
+  std::lock_guard lock{instance.mMutex};
+  // Timestamp counter ticks per microsecond, measured over the run; short
+  // runs fall back to a separate estimate.
+  const auto osElapsed = TimingUtils::readOsTimer() - instance.mStartOsTicks;
+  const auto timestampElapsed = __rdtsc() - instance.mStartTimestamp;
+  const auto ticksPerMicrosecond =
+      osElapsed >= TimingUtils::getOsTimerFreq() / 100
+          ? double(timestampElapsed) /
+                (TimingUtils::secondsFromOsTicks(osElapsed) * 1e6)
+          : double(TimingUtils::estimateCpuTimerFreq(10)) / 1e6;
+
+  auto file = CliUtils::FileHandle::open(filename, O_WRONLY | O_CREAT | O_TRUNC,
+                                         S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  CliUtils::IoBufferedWriter out(file);
+  const auto processId = std::uint64_t(::getpid());
+  auto printIds = [&](const ThreadTrace &thread) {
+    out.printSv(",\"pid\":");
+    out.printNumber(processId);
+    out.printSv(",\"tid\":");
+    out.printNumber(thread.mId);
+  };
+
+  out.printSv("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  bool first = true;
+  for (const auto &thread : instance.mThreads) {
+    out.printSv(first ? "\n" : ",\n");
+    first = false;
+    out.printSv("{\"name\":\"thread_name\",\"ph\":\"M\"");
+    printIds(*thread);
+    out.printSv(",\"args\":{\"name\":\"");
+    out.printSv(thread->mName);
+    out.printSv("\"}}");
+    for (const auto &block : thread->mBlocks) {
+      for (std::size_t i = 0; i < BLOCK_EVENTS && block[i].mPhase; ++i) {
+        const auto &event = block[i];
+        out.printSv(",\n{");
+        if (event.mNameSize) {
+          out.printSv("\"name\":\"");
+          out.printSv(std::string_view(event.mName, event.mNameSize));
+          out.printSv("\",");
+        }
+        out.printSv("\"ph\":\"");
+        out.printSv(std::string_view(&event.mPhase, 1));
+        out.printSv("\",\"ts\":");
+        // Events recorded before a later enable() would go negative.
+        const auto ticks = event.mTimestamp >= instance.mStartTimestamp
+                               ? event.mTimestamp - instance.mStartTimestamp
+                               : 0;
+        out.printNumber(double(ticks) / ticksPerMicrosecond,
+                        std::chars_format::fixed, 3);
+        printIds(*thread);
+        if (event.mArgument != NO_ARGUMENT) {
+          out.printSv(",\"args\":{\"index\":");
+          out.printNumber(event.mArgument);
+          out.printSv("}");
+        }
+        out.printSv("}");
+      }
+    }
+  }
+  out.printSv("\n]}\n");
+  out.flush();
+}
+
+} // namespace Haversine::Trace
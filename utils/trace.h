@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+
+#include <x86intrin.h>
+
+namespace Haversine::Trace {
+
+// Timeline of begin/end events per thread, written as Chrome trace-event
+// JSON for Perfetto or chrome://tracing. Every thread appends to a buffer of
+// its own, so recording takes no lock and no atomic read-modify-write: a
+// relaxed load of the switch, a timestamp counter read and a 32-byte store.
+// Until enable() is called an event costs the load alone.
+//
+// Names must outlive the trace; string literals are the intended use.
+
+constexpr std::uint64_t NO_ARGUMENT = ~0ULL;
+
+namespace Detail {
+struct Event {
+  const char *mName;
+  std::uint32_t mNameSize;
+  char mPhase;
+  std::uint64_t mTimestamp;
+  std::uint64_t mArgument;
+};
+static_assert(sizeof(Event) == 32);
+
+struct Buffer {
+  Event *mNext{nullptr};
+  Event *mEnd{nullptr};
+};
+
+extern constinit std::atomic<bool> gEnabled;
+extern constinit thread_local Buffer tBuffer;
+
+// Registers the calling thread's buffer on its first event and moves it on to
+// a fresh block when the current one is full.
+Event *grow();
+
+inline void record(char phase, std::string_view name, std::uint64_t argument) {
+  if (!gEnabled.load(std::memory_order_relaxed))
+    return;
+  auto &buffer = tBuffer;
+  auto *event = buffer.mNext != buffer.mEnd ? buffer.mNext++ : grow();
+  *event = Event{.mName = name.data(),
+                 .mNameSize = std::uint32_t(name.size()),
+                 .mPhase = phase,
+                 .mTimestamp = __rdtsc(),
+                 .mArgument = argument};
+}
+} // namespace Detail
+
+// Starts recording; the trace is written to `filename` when the process
+// exits. Threads still recording by then must have been joined.
+void enable(std::string_view filename);
+bool enabled();
+
+// A begin with an argument shows it as args.index, e.g. the chunk a task
+// worked on. Every begin needs an end on the same thread.
+inline void begin(std::string_view name, std::uint64_t argument = NO_ARGUMENT) {
+  Detail::record('B', name, argument);
+}
+inline void end() { Detail::record('E', {}, NO_ARGUMENT); }
+
+// Shown as the thread's name; may be called before enable().
+void setThreadName(std::string_view name);
+
+// Stops recording and writes the events recorded so far; enable() arranges
+// this at exit.
+void write(std::string_view filename);
+
+class Scope {
+public:
+  explicit Scope(std::string_view name, std::uint64_t argument = NO_ARGUMENT) {
+    begin(name, argument);
+  }
+  ~Scope() { end(); }
+  Scope(const Scope &) = delete;
+  Scope &operator=(const Scope &) = delete;
+};
+
+} // namespace Haversine::Trace